@@ -1,10 +1,17 @@
 #ifndef ACTION_MGR_H
 #define ACTION_MGR_H
 
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
 #include "rclcpp/rclcpp.hpp"
 #include "tello_msgs/srv/tello_action.hpp"
 #include "tello_msgs/msg/tello_response.hpp"
 
+#include "latency_trace.hpp"
+
 namespace drone_base
 {
 
@@ -16,7 +23,16 @@ namespace drone_base
 // 2. the drone responds with a TelloAction::Response
 // 3. later, the drone sends a TelloResponse message on the tello_response topic
 //
-// Only one action can be active at a time.
+// The drone runs one action at a time, the rest wait in a queue:
+// - Every action has a deadline. If the drone hasn't finished by then (e.g., tello_driver was restarted
+//   and the response was lost) the action fails and the next one starts after a guard interval.
+//   A TelloResponse doesn't say which action it's for, so a late one arriving in the guard interval is
+//   dropped instead of completing the next action.
+// - A preempting action (land) drops everything still in the queue and runs next.
+// - The service response arrives in a client callback, there's no polling. The result of each action is
+//   reported to its completion callback.
+//
+// Call the methods with the owner's mutex held, the client callback takes the same mutex.
 //==========================
 
   enum class Action;
@@ -33,45 +49,92 @@ namespace drone_base
       succeeded,                   // Action succeeded, see the result string
       failed,                      // Action failed, see the result string
       failed_lost_connection,      // Action failed, there's no connection to the drone
+      failed_timeout,              // Action failed, the deadline passed
     };
 
+    // Called once per action, with the final state
+    using Callback = std::function<void(Action action, State state, const std::string &result)>;
+
   private:
 
+    struct Request
+    {
+      Action action;
+      std::string action_str;
+      int64_t timeout_ns;
+      Callback callback;
+    };
+
+    static constexpr size_t MAX_QUEUE = 8;
+
+    // Wait this long after a timeout before sending the next action
+    static constexpr int64_t GUARD_NS = RCL_S_TO_NS(2);
+
     // Init by constructor
     rclcpp::Logger logger_;
     rclcpp::Client<tello_msgs::srv::TelloAction>::SharedPtr client_;
+    rclcpp::Clock::SharedPtr clock_;
+    std::mutex &mutex_;
     State state_ = State::not_sent;
 
-    // Init by send()
-    Action action_;
-    std::string action_str_;
-    std::shared_future<tello_msgs::srv::TelloAction::Response::SharedPtr> future_;
+    // Records request and response times, null if tracing is off
+    LatencyTrace *trace_{};
+
+    // Actions waiting to be sent
+    std::deque<Request> queue_;
+
+    // The active action, valid if busy()
+    Request active_{};
+    int64_t deadline_ns_{};
+    uint64_t sequence_{};          // Ignore service responses for actions that already timed out
+    int64_t guard_until_ns_{};     // Ignore tello_response messages until then, set by a timeout
     std::string result_str_;
 
+    void send_next();
+
+    void finish(State state, const std::string &result);
+
+    void response_callback(uint64_t sequence, tello_msgs::srv::TelloAction::Response::SharedPtr response);
+
   public:
 
-    explicit ActionMgr(rclcpp::Logger logger, rclcpp::Client<tello_msgs::srv::TelloAction>::SharedPtr client) :
-      logger_{logger}, client_{client}
+    explicit ActionMgr(rclcpp::Logger logger, rclcpp::Client<tello_msgs::srv::TelloAction>::SharedPtr client,
+                       rclcpp::Clock::SharedPtr clock, std::mutex &mutex) :
+      logger_{logger}, client_{client}, clock_{clock}, mutex_{mutex}
     {}
 
     ~ActionMgr()
     {}
 
-    State send(Action action, std::string action_str);
+    void set_trace(LatencyTrace *trace)
+    { trace_ = trace; }
 
-    State spin_once();
+    // Queue an action, it's sent right away if the drone is idle
+    // A preempting action drops the queued actions, their callbacks get State::failed
+    // Returns false if the queue is full, or the action is already queued
+    bool send(Action action, std::string action_str, double timeout_sec, Callback callback, bool preempt = false);
 
-    State complete(tello_msgs::msg::TelloResponse::SharedPtr msg);
+    // Check the deadline of the active action, send the next action when the guard interval is over
+    void spin_once();
+
+    // The drone finished the active action
+    void complete(tello_msgs::msg::TelloResponse::SharedPtr msg);
+
+    // Drop the queued actions and forget the active action, e.g., when the connection is lost
+    void clear(const std::string &reason);
 
     Action action()
-    { return action_; }
+    { return active_.action; }
 
     std::string action_str()
-    { return action_str_; }
+    { return active_.action_str; }
 
     std::string result_str()
     { return result_str_; }
 
+    // The active action followed by the queued actions, in the order they will run
+    std::vector<Action> pending() const;
+
     bool busy()
     { return state_ == State::waiting_for_future || state_ == State::waiting_for_response; }
   };
@@ -79,4 +142,3 @@ namespace drone_base
 } // namespace drone_base
 
 #endif // ACTION_MGR_H
-
@@ -0,0 +1,85 @@
+#ifndef COLLISION_INDEX_H
+#define COLLISION_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace collision_index
+{
+
+//=============================================================================
+// A drone moving in a straight line at a constant speed from (p0, t0) to (p1, t1)
+//=============================================================================
+
+  struct Segment
+  {
+    int drone;
+    int64_t t0_ns;
+    int64_t t1_ns;
+    double p0[3];
+    double p1[3];
+  };
+
+  struct Conflict
+  {
+    int drone_a;
+    int drone_b;
+    int64_t t_ns;         // Approximate time of closest approach
+    double distance;
+  };
+
+//=============================================================================
+// CollisionIndex
+//
+// Uniform grid over (x, y, z, t). Segments are split at time slot boundaries, and each piece is stored in every
+// cell touched by its bounding box grown by half the minimum separation. Two pieces that come closer than the
+// minimum separation must share a cell, so a query only looks at the pieces in the cells it touches.
+// With S segments per drone and N drones, adding a plan and checking it against the others is O(S) cell
+// lookups plus the close pairs, instead of comparing N^2 S^2 segment pairs.
+//=============================================================================
+
+  class CollisionIndex
+  {
+    double min_separation_;
+    double cell_size_;
+    int64_t slot_ns_;
+
+    std::vector<Segment> pieces_;
+    std::unordered_map<uint64_t, std::vector<int>> cells_;
+
+    // Pieces already checked by the current query
+    mutable std::vector<int> visited_;
+    mutable int query_{};
+
+    // Call f(cell key) for every cell touched by a piece that fits in one time slot
+    template<typename F>
+    void for_each_cell(const Segment &piece, int64_t slot, F f) const;
+
+    // Split a segment at time slot boundaries, call f(piece, slot) for each piece
+    template<typename F>
+    void for_each_piece(const Segment &segment, F f) const;
+
+  public:
+
+    // Cells are at least min_separation across, all times are split into slots of slot_sec seconds
+    CollisionIndex(double min_separation, double slot_sec = 1.0);
+
+    void clear();
+
+    void insert(const Segment &segment);
+
+    // Find a segment in the index, from another drone, that comes closer than the minimum separation
+    bool query(const Segment &segment, Conflict &conflict) const;
+
+    size_t num_pieces() const
+    { return pieces_.size(); }
+
+    // Closest approach of 2 segments during the time they overlap, false if they don't overlap in time
+    static bool closest_approach(const Segment &a, const Segment &b, double &distance, int64_t &t_ns);
+  };
+
+} // namespace collision_index
+
+#endif // COLLISION_INDEX_H
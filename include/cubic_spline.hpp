@@ -0,0 +1,110 @@
+#ifndef CUBIC_SPLINE_H
+#define CUBIC_SPLINE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "nav_msgs/msg/path.hpp"
+
+namespace spline
+{
+
+//=============================================================================
+// Minimum acceleration cubic spline
+//
+// Same trajectory as smooth_path_4poly_2min.py: one cubic per segment, passing through every knot,
+// with fixed start and end velocities, minimizing the integral of the squared acceleration.
+// The optimum is C2 continuous, so the unknown knot velocities satisfy a tridiagonal system.
+// Fitting n knots is O(n) instead of inverting dense 4(n-1) x 4(n-1) matrices.
+//=============================================================================
+
+  // y(t) = a + b tau + c tau^2 + d tau^3, where tau is the time since the start of the segment
+  struct Cubic
+  {
+    double a, b, c, d;
+  };
+
+  struct SplinePoint
+  {
+    double y;
+    double y_dot;
+    double y_dotdot;
+  };
+
+  class CubicSpline
+  {
+    std::vector<double> ts_;
+    std::vector<Cubic> segments_;
+
+  public:
+
+    // Knot times must be strictly increasing, returns false if there are fewer than 2 knots or time goes backwards
+    bool fit(const std::vector<double> &ts, const std::vector<double> &ys, double v0 = 0, double vn = 0);
+
+    bool empty() const
+    { return segments_.empty(); }
+
+    int num_segments() const
+    { return static_cast<int>(segments_.size()); }
+
+    double t_begin() const
+    { return ts_.front(); }
+
+    double t_end() const
+    { return ts_.back(); }
+
+    const std::vector<Cubic> &segments() const
+    { return segments_; }
+
+    // Find the segment that contains t, starting the search at cursor
+    // Evaluating at increasing (or decreasing) times is O(1) per call
+    int locate(double t, int cursor) const;
+
+    // Times outside the spline are clamped to the first or last knot
+    SplinePoint eval(double t, int &cursor) const;
+
+    SplinePoint eval(double t) const
+    {
+      int cursor = 0;
+      return eval(t, cursor);
+    }
+  };
+
+//=============================================================================
+// x, y, z and yaw splines through the poses in a plan, with zero velocity at both ends
+//
+// Time is in seconds since the first waypoint, yaw is unwrapped so the drone turns the short way.
+//=============================================================================
+
+  struct PoseSplinePoint
+  {
+    double x, y, z, yaw;
+    double vx, vy, vz, vyaw;
+  };
+
+  class PoseSpline
+  {
+    int64_t t0_ns_{};
+    CubicSpline x_, y_, z_, yaw_;
+
+  public:
+
+    bool fit(const nav_msgs::msg::Path &path);
+
+    bool empty() const
+    { return x_.empty(); }
+
+    // Time of the first waypoint
+    int64_t t0_ns() const
+    { return t0_ns_; }
+
+    // Seconds from the first to the last waypoint
+    double duration() const
+    { return x_.t_end(); }
+
+    PoseSplinePoint eval(int64_t t_ns, int &cursor) const;
+  };
+
+} // namespace spline
+
+#endif // CUBIC_SPLINE_H
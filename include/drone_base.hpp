@@ -1,21 +1,37 @@
 #ifndef DRONE_BASE_H
 #define DRONE_BASE_H
 
+#include <atomic>
+#include <mutex>
+
 #include "rclcpp/rclcpp.hpp"
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
 #include "geometry_msgs/msg/twist.hpp"
 #include "nav_msgs/msg/odometry.hpp"
 #include "nav_msgs/msg/path.hpp"
-#include "sensor_msgs/msg/joy.hpp"
 #include "std_msgs/msg/empty.hpp"
+#include "std_msgs/msg/header.hpp"
+#include "std_msgs/msg/u_int8.hpp"
 #include "tello_msgs/msg/flight_data.hpp"
+#include "flock2/msg/compact_plan.hpp"
+#include "flock2/msg/manual_control.hpp"
 
 #include "action_mgr.hpp"
 #include "ros2_shared/context_macros.hpp"
-#include "joystick.hpp"
+#include "latency_histogram.hpp"
+#include "latency_trace.hpp"
+#include "parameters_callback.hpp"
+#include "plan_cache.hpp"
+#include "pose_predictor.hpp"
+#include "running_stats.hpp"
+#include "telemetry_recorder.hpp"
 
 namespace drone_base
 {
 
+  // Rate for spin_once, in Hz
+  constexpr int SPIN_RATE = 20;
+
 //=============================================================================
 // States, events and actions
 //=============================================================================
@@ -59,6 +75,63 @@ namespace drone_base
   CXT_MACRO_MEMBER(               /* Error if no additional odom message within this duration */ \
   odom_timeout_sec, \
   double, 1.5) \
+  CXT_MACRO_MEMBER(               /* 1: run callbacks as they arrive, spin_once on a timer; 0: poll at SPIN_RATE */ \
+  event_driven, \
+  int, 0) \
+  CXT_MACRO_MEMBER(               /* Log odom->cmd_vel latency this often, 0 to disable */ \
+  latency_report_sec, \
+  double, 10.0) \
+  CXT_MACRO_MEMBER(               /* 1: flock_controller publishes cmd_vel during missions */ \
+  external_control, \
+  int, 0) \
+  CXT_MACRO_MEMBER(               /* basic, simple or trajectory, changes take effect at the next mission */ \
+  flight_controller, \
+  std::string, "basic") \
+  CXT_MACRO_MEMBER(               /* Run this controller on the same odometry without publishing, "" for none */ \
+  shadow_controller, \
+  std::string, "") \
+  CXT_MACRO_MEMBER(               /* 1: trace hot path events, publish summaries on /diagnostics every latency_report_sec */ \
+  trace, \
+  int, 0) \
+  CXT_MACRO_MEMBER(               /* Record every control tick to a file in this directory, "" to disable */ \
+  telemetry_dir, \
+  std::string, "") \
+  CXT_MACRO_MEMBER(               /* Fail an action if tello_driver hasn't finished it within this duration */ \
+  action_timeout_sec, \
+  double, 15.0) \
+  CXT_MACRO_MEMBER(               /* 1: flock_base takes off all drones at once, wait for /flock_airborne */ \
+  flock_takeoff, \
+  int, 0) \
+  CXT_MACRO_MEMBER(               /* odom and flight_data subscriptions, best_effort or reliable, keep last 1 */ \
+  sensor_qos, \
+  std::string, "best_effort") \
+  CXT_MACRO_MEMBER(               /* cmd_vel publisher, best_effort or reliable, keep last 1 */ \
+  cmd_vel_qos, \
+  std::string, "reliable") \
+  CXT_MACRO_MEMBER(               /* 1: request odom and flight_data deadlines, the publishers must offer them */ \
+  qos_deadline, \
+  int, 0) \
+  CXT_MACRO_MEMBER(               /* Streamed plans: ring size in segments, must cover stream_lookahead_sec on the planner */ \
+  plan_ring_size, \
+  int, 64) \
+  CXT_MACRO_MEMBER(               /* 1: predict odometry forward to now from the cmd_vel sent since the odom stamp */ \
+  predict_odom, \
+  int, 0) \
+  CXT_MACRO_MEMBER(               /* Prediction model: horizontal speed at full stick, m/s */ \
+  predict_xy_speed, \
+  double, 1.0) \
+  CXT_MACRO_MEMBER(               /* Prediction model: vertical speed at full stick, m/s */ \
+  predict_z_speed, \
+  double, 1.0) \
+  CXT_MACRO_MEMBER(               /* Prediction model: yaw rate at full stick, rad/s */ \
+  predict_yaw_rate, \
+  double, 1.7) \
+  CXT_MACRO_MEMBER(               /* Never predict further ahead than this, s */ \
+  max_predict_sec, \
+  double, 0.5) \
+  CXT_MACRO_MEMBER(               /* Run the controllers on a timer at this rate, Hz, 0 to run them on each odom message */ \
+  control_rate, \
+  double, 0.0) \
   /* End of list */
 
 #define DRONE_BASE_ALL_OTHERS \
@@ -68,6 +141,9 @@ namespace drone_base
   CXT_MACRO_MEMBER(             /* Error if no additional odom message within this duration */ \
   odom_timeout,  \
   rclcpp::Duration, 0) \
+  CXT_MACRO_MEMBER(             /* Log odom->cmd_vel latency this often */ \
+  latency_report,  \
+  rclcpp::Duration, 0) \
   /* End of list */
 
 
@@ -80,6 +156,34 @@ namespace drone_base
     DRONE_BASE_ALL_OTHERS
   };
 
+//=============================================================================
+// Control law CPU time and tracking error, to compare the active and shadow controllers
+//=============================================================================
+
+  struct ControllerStats
+  {
+    LatencyHistogram cost;
+    double error_sum{};
+    uint64_t error_count{};
+
+    void add(int64_t cost_ns, double error)
+    {
+      cost.add(cost_ns);
+      error_sum += error;
+      error_count++;
+    }
+
+    double mean_error() const
+    { return error_count > 0 ? error_sum / error_count : 0; }
+
+    void reset()
+    {
+      cost.reset();
+      error_sum = 0;
+      error_count = 0;
+    }
+  };
+
 //=============================================================================
 // DroneBase node
 //=============================================================================
@@ -100,69 +204,189 @@ namespace drone_base
     // Odom data
     rclcpp::Time odom_time_;
 
+    // Time from odom stamp to cmd_vel publish, covers queueing and the control law
+    LatencyHistogram odom_latency_;
+    rclcpp::Time latency_report_time_;
+
+    // Settle time and odom lag, learned across missions, used by the flight controllers to size time buffers
+    TimingStats timing_;
+
+    // With predict_odom or control_rate, the controllers see predicted_odom_ instead of the odom message
+    PosePredictor predictor_;
+    nav_msgs::msg::Odometry::SharedPtr predicted_odom_;
+    nav_msgs::msg::Odometry::SharedPtr latest_odom_;
+
+    // Time between control ticks, steady clock
+    LatencyHistogram control_period_;
+    RunningStats control_jitter_;           // ms
+    int64_t last_control_tick_ns_{};
+    int64_t last_tick_odom_ns_{};           // Stamp of the odometry the control timer last used
+
+    // Hot path trace, null if the trace parameter is 0
+    std::unique_ptr<LatencyTrace> trace_;
+
+    // Control loop telemetry, null if telemetry_dir is ""
+    std::unique_ptr<TelemetryRecorder> telemetry_;
+
     // Drone action manager
     std::unique_ptr<ActionMgr> action_mgr_;
 
     // Mission state
     bool mission_ = false;                  // We're in a mission (flying autonomously)
+
+    // flock_base only sends stick changes, so a stick moved during an action is kept and sent when it finishes
+    flock2::msg::ManualControl manual_{};
+    bool manual_pending_ = false;
+
+    // Created at the first plan (or manual command), see controller()
     std::unique_ptr<FlightControllerInterface> fc_{};
+    std::string fc_name_;
+    ControllerStats fc_stats_;
+
+    // Optional shadow controller, sees the same plan and odometry as fc_ but never publishes
+    std::unique_ptr<FlightControllerInterface> shadow_fc_{};
+    std::string shadow_name_;
+    ControllerStats shadow_stats_;
 
-    // Joystick assignments
-    int joy_axis_throttle_ = JOY_AXIS_RIGHT_FB;
-    int joy_axis_strafe_ = JOY_AXIS_RIGHT_LR;
-    int joy_axis_vertical_ = JOY_AXIS_LEFT_FB;
-    int joy_axis_yaw_ = JOY_AXIS_LEFT_LR;
-    int joy_button_takeoff_ = JOY_BUTTON_MENU;
-    int joy_button_land_ = JOY_BUTTON_VIEW;
-    int joy_button_shift_ = JOY_BUTTON_LEFT_BUMPER;
-    int joy_axis_trim_lr_ = JOY_AXIS_TRIM_LR;
-    int joy_axis_trim_fb_ = JOY_AXIS_TRIM_FB;
+    // Plans are converted here, outside the lock, then swapped into the controllers
+    // Only the plan callbacks use them, and they all run in the default callback group
+    PlanCache fc_plan_;
+    PlanCache shadow_plan_;
 
     // Publications
     rclcpp::Publisher<geometry_msgs::msg::Twist>::SharedPtr cmd_vel_pub_;
+    rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr diagnostics_pub_;
+    rclcpp::Publisher<std_msgs::msg::UInt8>::SharedPtr state_pub_;
 
     // Subscriptions
     rclcpp::Subscription<std_msgs::msg::Empty>::SharedPtr start_mission_sub_;
     rclcpp::Subscription<std_msgs::msg::Empty>::SharedPtr stop_mission_sub_;
-    rclcpp::Subscription<sensor_msgs::msg::Joy>::SharedPtr joy_sub_;
+    rclcpp::Subscription<std_msgs::msg::Header>::SharedPtr flock_airborne_sub_;
+    rclcpp::Subscription<flock2::msg::ManualControl>::SharedPtr manual_control_sub_;
     rclcpp::Subscription<tello_msgs::msg::TelloResponse>::SharedPtr tello_response_sub_;
     rclcpp::Subscription<tello_msgs::msg::FlightData>::SharedPtr flight_data_sub_;
     rclcpp::Subscription<nav_msgs::msg::Odometry>::SharedPtr odom_sub_;
     rclcpp::Subscription<nav_msgs::msg::Path>::SharedPtr plan_sub_;
+    rclcpp::Subscription<flock2::msg::CompactPlan>::SharedPtr compact_plan_sub_;
+
+    // Calls spin_once in event-driven mode
+    rclcpp::TimerBase::SharedPtr spin_timer_;
+
+    // Runs the controllers if control_rate > 0
+    rclcpp::TimerBase::SharedPtr control_timer_;
+
+    // Odom, flight_data and tello_response callbacks, the rest use the default group
+    rclcpp::callback_group::CallbackGroup::SharedPtr control_group_;
+
+    // The two callback groups may run concurrently on a MultiThreadedExecutor, so every callback holds this
+    // while it touches the state or the controllers. Slow work (plan conversion) is done outside it.
+    // fc_ and shadow_fc_ are only replaced in the default group, under the lock.
+    std::mutex mutex_;
+
+    // Parameters are logged at debug level while the node starts, and at info level when they change
+    bool started_{false};
+
+    // DroneBase's own parameter callback, the node's callback is parameters_changed()
+    ParametersCallback parameters_callback_;
+
+    // Controllers declare their parameters as they're created, and have already read them. Set while
+    // select_controllers() holds mutex_, so a parameter callback that sees it re-entered from declare_parameter
+    std::atomic<bool> creating_controllers_{false};
 
   public:
 
-    explicit DroneBase();
+    explicit DroneBase(const rclcpp::NodeOptions &options = rclcpp::NodeOptions());
+
+    // Defined where FlightControllerInterface is complete
+    ~DroneBase();
 
     void spin_once();
 
+    bool event_driven() const
+    { return cxt_.event_driven_ != 0; }
+
+    const LatencyHistogram &odom_latency() const
+    { return odom_latency_; }
+
+    // Create the controllers now instead of at the first plan, e.g., to snapshot their parameters
+    void create_controllers();
+
   private:
+    // No flight data or odometry for too long
+    void flight_data_timeout(const rclcpp::Time &ros_time);
+
+    void odom_timeout(const rclcpp::Time &ros_time);
+
     void validate_parameters();
 
+    // The node's parameter callback: DroneBase first, then the controllers
+    rcl_interfaces::msg::SetParametersResult parameters_changed(const std::vector<rclcpp::Parameter> &parameters);
+
+    void report_latency(const rclcpp::Time &ros_time);
+
+    // Open a telemetry file in telemetry_dir
+    void open_telemetry();
+
+    // Publish trace summaries on /diagnostics
+    void publish_diagnostics(const rclcpp::Time &ros_time);
+
+    // Create the controllers named by the flight_controller and shadow_controller parameters. During a mission
+    // the new controllers get the current plan, between missions they start without one
+    void select_controllers();
+
+    // The active controller, created on first use so the node starts without it
+    FlightControllerInterface &controller();
+
     // Callbacks
-    void joy_callback(sensor_msgs::msg::Joy::SharedPtr msg);
+    void manual_control_callback(flock2::msg::ManualControl::SharedPtr msg);
 
     void start_mission_callback(std_msgs::msg::Empty::SharedPtr msg);
 
     void stop_mission_callback(std_msgs::msg::Empty::SharedPtr msg);
 
+    void flock_airborne_callback(std_msgs::msg::Header::SharedPtr msg);
+
     void tello_response_callback(tello_msgs::msg::TelloResponse::SharedPtr msg);
 
     void flight_data_callback(tello_msgs::msg::FlightData::SharedPtr msg);
 
     void odom_callback(nav_msgs::msg::Odometry::SharedPtr msg);
 
+    // Fill in predicted_odom_ with the pose at now(), the pose in msg is held if predict_odom is 0
+    const nav_msgs::msg::Odometry::SharedPtr &predict_odom(const nav_msgs::msg::Odometry::SharedPtr &msg);
+
+    bool controlling() const;
+
+    void control_timer_callback();
+
+    // One control tick: fc_odom drives the controllers, msg is the odometry it came from
+    void run_controllers(const nav_msgs::msg::Odometry::SharedPtr &fc_odom,
+                         const nav_msgs::msg::Odometry::SharedPtr &msg);
+
     void plan_callback(nav_msgs::msg::Path::SharedPtr msg);
 
+    // Convert a whole plan to a Path once, the controllers and the shadow controller share it
+    // Windows of a streamed plan go straight into the controllers' rings
+    void compact_plan_callback(flock2::msg::CompactPlan::SharedPtr msg);
+
     // State transition
     void start_action(Action action);
 
+    void action_callback(Action action, ActionMgr::State state, const std::string &result);
+
+    // Send manual_ to the drone
+    void publish_manual();
+
+    State expected_state();
+
     void transition_state(Action action);
 
     void transition_state(Event event);
 
     void transition_state(State next_state);
 
+    void publish_state();
+
     // All stop: set twist_ to 0, 0, 0, 0 and publish
     void all_stop();
 
@@ -40,6 +40,19 @@ namespace drone_base
       return v > max ? max : (v < min ? min : v);
     }
 
+    // Message stamp to nanoseconds, without building an rclcpp::Time
+    static int64_t to_ns(const builtin_interfaces::msg::Time &stamp)
+    {
+      return static_cast<int64_t>(stamp.sec) * 1000000000 + stamp.nanosec;
+    }
+
+    // Nanoseconds to message stamp, ns must not be negative
+    static void from_ns(int64_t ns, builtin_interfaces::msg::Time &stamp)
+    {
+      stamp.sec = static_cast<int32_t>(ns / 1000000000);
+      stamp.nanosec = static_cast<uint32_t>(ns % 1000000000);
+    }
+
     // rclcpp::Time t() initializes nanoseconds to 0
     static bool is_valid_time(rclcpp::Time &t)
     {
@@ -67,11 +80,12 @@ namespace drone_base
       y = msg.position.y;
       z = msg.position.z;
 
-      // Quaternion to yaw
-      tf2::Quaternion q;
-      tf2::fromMsg(msg.orientation, q);
-      double roll = 0, pitch = 0;
-      tf2::Matrix3x3(q).getRPY(roll, pitch, yaw);
+      // Quaternion to yaw, same result as tf2::Matrix3x3(q).getRPY() away from +/-90 degrees of pitch
+      // Called on every odom message, skip building the rotation matrix
+      const auto &q = msg.orientation;
+      double norm2 = q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w;
+      double s = norm2 > 0 ? 2 / norm2 : 0;
+      yaw = atan2(s * (q.w * q.z + q.x * q.y), 1 - s * (q.y * q.y + q.z * q.z));
     }
 
     void toMsg(geometry_msgs::msg::Pose &msg) const
@@ -12,6 +12,15 @@ namespace drone_base
   CXT_MACRO_MEMBER(               /* Allow drone to stabilize for this duration */ \
   stabilize_time_sec, \
   double, 5.) \
+  CXT_MACRO_MEMBER(               /* 1: learn the settle time and odom lag, stabilize_time_sec is the upper bound */ \
+  adaptive_stabilize, \
+  int, 0) \
+  CXT_MACRO_MEMBER(               /* With adaptive_stabilize, never allow less than this duration */ \
+  min_stabilize_time_sec, \
+  double, 0.5) \
+  CXT_MACRO_MEMBER(               /* Learned buffers are mean + timing_sigmas * stddev */ \
+  timing_sigmas, \
+  double, 3.) \
   /* End of list */
 
 #define BASIC_CONTROLLER_ALL_OTHERS \
@@ -29,22 +38,23 @@ namespace drone_base
     BASIC_CONTROLLER_ALL_OTHERS
 
     DronePose last_pose_;                   // Last pose from odom
-    rclcpp::Time last_odom_time_;           // Last pose from odom
+    int64_t last_odom_ns_{};                // Time of last odom message, 0 if none
 
     DronePose prev_target_;                 // Previous target pose
     DronePose curr_target_;                 // Current target pose
-    rclcpp::Time prev_target_time_;         // Time we left the previous target
-    rclcpp::Time curr_target_time_;         // Deadline to hit the current target
+    int64_t prev_target_ns_{};              // Time we left the previous target
+    int64_t curr_target_ns_{};              // Deadline to hit the current target
     double vx_{}, vy_{}, vz_{}, vyaw_{};    // Velocity required to hit the current target
+    bool settled_{};                        // Close enough to the current target after the deadline
+    int64_t offset_ns_{};                   // Deadlines are this long before the waypoint timestamps
 
-    // PID controllers
-    pid::Controller x_controller_{false, 0.1, 0, 0};
-    pid::Controller y_controller_{false, 0.1, 0, 0};
-    pid::Controller z_controller_{false, 0.1, 0, 0};
-    pid::Controller yaw_controller_{true, 0.2, 0, 0};
+    // PID controllers for x, y, z and yaw
+    pid::BatchController controller_{1};
 
     void validate_parameters();
 
+    int64_t _deadline_offset_ns() const override;
+
   public:
     FlightControllerBasic(rclcpp::Node &node, rclcpp::Publisher<geometry_msgs::msg::Twist>::SharedPtr &cmd_vel_pub);
 
@@ -1,23 +1,96 @@
 #ifndef FLIGHT_CONTROLLER_INTERFACE_HPP
 #define FLIGHT_CONTROLLER_INTERFACE_HPP
 
+#include <cmath>
+#include <functional>
+
 #include "geometry_msgs/msg/twist.hpp"
 #include "nav_msgs/msg/odometry.hpp"
 #include "nav_msgs/msg/path.hpp"
+#include "flock2/msg/compact_plan.hpp"
 
+#include "ros2_shared/context_macros.hpp"
 #include "drone_pose.hpp"
+#include "latency_trace.hpp"
+#include "parameters_callback.hpp"
+#include "plan_cache.hpp"
+#include "plan_codec.hpp"
+#include "pose_predictor.hpp"
+#include "running_stats.hpp"
+#include "telemetry_recorder.hpp"
 
 namespace drone_base
 {
+
+// Controllers share some parameter names (e.g., stabilize_time_sec), and a shadow controller can run next to
+// the active controller, so use the value of a parameter that's already declared instead of declaring it again
+#define FC_MACRO_LOAD_PARAMETER(node_ref, cxt_ref, n, t, d) \
+  if (node_ref.has_parameter(#n)) { \
+    cxt_ref.n##_ = node_ref.get_parameter(#n).get_value<t>(); \
+  } else { \
+    CXT_MACRO_LOAD_PARAMETER(node_ref, cxt_ref, n, t, d) \
+  }
+
   class FlightControllerInterface
   {
   protected:
     int target_{};                            // Current target (index into plan_)
-    nav_msgs::msg::Path plan_{};              // The flight plan
+    PlanCache plan_{};                        // The flight plan
 
     rclcpp::Node &node_;
     rclcpp::Publisher<geometry_msgs::msg::Twist>::SharedPtr &cmd_vel_pub_;
 
+    // False if another node (e.g., flock_controller) publishes cmd_vel during the mission, or in shadow mode
+    bool publish_control_{true};
+
+    // If set, gets every cmd_vel after it's published, e.g., so controller_bench can fly a simulated drone
+    std::function<void(const geometry_msgs::msg::Twist &)> cmd_vel_callback_;
+
+    // The last cmd_vel, reused so publishing to other processes doesn't allocate
+    geometry_msgs::msg::Twist twist_;
+
+    // Records cmd_vel publish times, null if tracing is off
+    LatencyTrace *trace_{};
+
+    // Records every control tick, null if telemetry is off
+    TelemetryRecorder *telemetry_{};
+
+    // Learned timing for this drone, null if the controller runs on its own (e.g., shadow mode)
+    TimingStats *timing_{};
+
+    // Gets every cmd_vel, null if drone_base doesn't predict odometry
+    PosePredictor *predictor_{};
+
+    // Distance from the reference position to the actual position, set on every odom tick
+    double tracking_error_{};
+
+    // The controller's parameter callback, see parameters_changed()
+    ParametersCallback parameters_callback_;
+
+    // Parameters are logged at debug level while the controller is created, and at info level when they change
+    bool created_{false};
+
+    void set_tracking_error(const DronePose &reference, const DronePose &actual)
+    {
+      tracking_error_ = std::sqrt(std::pow(reference.x - actual.x, 2) + std::pow(reference.y - actual.y, 2) +
+                                  std::pow(reference.z - actual.z, 2));
+    }
+
+    void record_telemetry(int64_t t_ns, double dt, const DronePose &target, const DronePose &actual,
+                          double throttle, double strafe, double vertical, double yaw)
+    {
+      if (telemetry_) {
+        telemetry_->record(TelemetryRecord{
+          t_ns, target_, static_cast<float>(dt),
+          {static_cast<float>(target.x), static_cast<float>(target.y),
+           static_cast<float>(target.z), static_cast<float>(target.yaw)},
+          {static_cast<float>(actual.x), static_cast<float>(actual.y),
+           static_cast<float>(actual.z), static_cast<float>(actual.yaw)},
+          {static_cast<float>(throttle), static_cast<float>(strafe),
+           static_cast<float>(vertical), static_cast<float>(yaw)}});
+      }
+    }
+
     // Implemented by the overriding class.
     virtual void _reset() = 0;
 
@@ -25,6 +98,14 @@ namespace drone_base
 
     virtual bool _odom_callback(const nav_msgs::msg::Odometry::SharedPtr &msg) = 0;
 
+    // Segment deadlines are the waypoint timestamps minus this offset
+    virtual int64_t _deadline_offset_ns() const
+    { return 0; }
+
+    // False if the controller needs the whole plan up front
+    virtual bool _can_stream() const
+    { return true; }
+
   public:
     explicit FlightControllerInterface(rclcpp::Node &node,
                                        rclcpp::Publisher<geometry_msgs::msg::Twist>::SharedPtr &cmd_vel_pub)
@@ -37,45 +118,188 @@ namespace drone_base
 
     void reset()
     {
-      plan_ = nav_msgs::msg::Path();
+      plan_.clear();
       _reset();
     }
 
+    // DroneBase owns the node's parameter callback and forwards every change here
+    void parameters_changed(const std::vector<rclcpp::Parameter> &parameters)
+    {
+      (void) parameters_callback_(parameters);
+    }
+
     void set_target(int target)
     {
+      // A streamed plan that ran out of segments waits at the end for the next window
+      if (!plan_.complete() && target > plan_.size()) {
+        target = plan_.size();
+      }
       _set_target(target);
     }
 
-    void set_plan(const nav_msgs::msg::Path::SharedPtr &msg)
+    // Share the message, don't copy it
+    void set_plan(const nav_msgs::msg::Path::ConstSharedPtr &msg)
+    {
+      _reset();
+      plan_.build(msg, _deadline_offset_ns());
+      _set_target(0);
+    }
+
+    // Segment deadlines are the waypoint timestamps minus this, for building a PlanCache outside set_plan
+    int64_t deadline_offset_ns() const
+    { return _deadline_offset_ns(); }
+
+    // Take a plan built with deadline_offset_ns(), plan gets the old plan so its storage is reused
+    void set_plan(PlanCache &plan)
     {
       _reset();
-      plan_ = *msg;
+      std::swap(plan_, plan);
       _set_target(0);
     }
 
+    // The controllers work on a Path, so a compact plan is expanded first, false if it isn't valid
+    bool set_plan(const flock2::msg::CompactPlan &msg)
+    {
+      auto path = std::make_shared<nav_msgs::msg::Path>();
+      if (!from_compact(msg, *path)) {
+        return false;
+      }
+      set_plan(path);
+      return true;
+    }
+
+    // Streaming: a window with first_index 0 starts a new plan in a ring of capacity segments,
+    // later windows are appended without touching the PID state or the target
+    bool set_plan_window(const flock2::msg::CompactPlan &msg, int capacity)
+    {
+      if (!_can_stream()) {
+        return false;
+      }
+
+      if (msg.first_index == 0) {
+        _reset();
+        plan_.start_stream(capacity, _deadline_offset_ns());
+        if (!plan_.append(msg, 0)) {
+          plan_.clear();
+          return false;
+        }
+        _set_target(0);
+        return true;
+      }
+
+      // If the controller is waiting at the end of the ring, pick up the new target
+      bool waiting = target_ >= plan_.size();
+      if (!plan_.append(msg, target_)) {
+        return false;
+      }
+      if (waiting) {
+        _set_target(target_);
+      }
+      return true;
+    }
+
     bool odom_callback(const nav_msgs::msg::Odometry::SharedPtr &msg)
     {
       return _odom_callback(msg);
     }
 
-    void publish_velocity(double throttle, double strafe, double vertical, double yaw)
+    static void set_twist(geometry_msgs::msg::Twist &twist, double throttle, double strafe, double vertical, double yaw)
     {
-      geometry_msgs::msg::Twist twist;
       twist.linear.x = PoseUtil::clamp(throttle, -1.0, 1.0);
       twist.linear.y = PoseUtil::clamp(strafe, -1.0, 1.0);
       twist.linear.z = PoseUtil::clamp(vertical, -1.0, 1.0);
       twist.angular.z = PoseUtil::clamp(yaw, -1.0, 1.0);
-      cmd_vel_pub_->publish(twist);
+    }
+
+    void publish_velocity(double throttle, double strafe, double vertical, double yaw)
+    {
+      set_twist(twist_, throttle, strafe, vertical, yaw);
+
+      if (cmd_vel_pub_->can_loan_messages()) {
+        // The middleware owns the message, no heap allocation
+        auto loan = cmd_vel_pub_->borrow_loaned_message();
+        loan.get() = twist_;
+        cmd_vel_pub_->publish(std::move(loan));
+      } else if (cmd_vel_pub_->get_intra_process_subscription_count() > 0) {
+        // Publish a unique_ptr so intra-process subscribers can take ownership without a copy
+        cmd_vel_pub_->publish(std::make_unique<geometry_msgs::msg::Twist>(twist_));
+      } else {
+        // Nobody in this process is listening, publish by reference, no heap allocation in rclcpp
+        cmd_vel_pub_->publish(twist_);
+      }
+
+      if (cmd_vel_callback_) {
+        cmd_vel_callback_(twist_);
+      }
+
+      if (predictor_) {
+        predictor_->add_command(node_.now().nanoseconds(), twist_.linear.x, twist_.linear.y, twist_.linear.z,
+                                twist_.angular.z);
+      }
+    }
+
+    // Publish the output of the control law, only these close an odom to cmd_vel trace interval
+    void publish_control(double throttle, double strafe, double vertical, double yaw)
+    {
+      if (publish_control_) {
+        publish_velocity(throttle, strafe, vertical, yaw);
+
+        if (trace_) {
+          trace_->record(TraceEvent::cmd_vel_published);
+        }
+      }
+    }
+
+    // Track the plan but leave cmd_vel to someone else, manual flight is not affected
+    void set_publish_control(bool publish_control)
+    {
+      publish_control_ = publish_control;
+    }
+
+    void set_trace(LatencyTrace *trace)
+    {
+      trace_ = trace;
+    }
+
+    void set_cmd_vel_callback(std::function<void(const geometry_msgs::msg::Twist &)> callback)
+    {
+      cmd_vel_callback_ = std::move(callback);
+    }
+
+    void set_telemetry(TelemetryRecorder *telemetry)
+    {
+      telemetry_ = telemetry;
+    }
+
+    void set_timing(TimingStats *timing)
+    {
+      timing_ = timing;
+    }
+
+    void set_predictor(PosePredictor *predictor)
+    {
+      predictor_ = predictor;
     }
 
     bool is_plan_complete()
     {
-      return target_ >= plan_.poses.size();
+      return target_ >= plan_.size() && plan_.complete();
     }
 
     bool have_plan()
     {
-      return !plan_.poses.empty();
+      return !plan_.empty();
+    }
+
+    // The plan message, shared with whoever sent it, so it can be handed to another controller, null if streamed
+    const nav_msgs::msg::Path::ConstSharedPtr &plan_msg() const
+    {
+      return plan_.msg();
+    }
+
+    double tracking_error() const
+    {
+      return tracking_error_;
     }
   };
 }
@@ -0,0 +1,41 @@
+#ifndef FLIGHT_CONTROLLER_REGISTRY_HPP
+#define FLIGHT_CONTROLLER_REGISTRY_HPP
+
+#include <functional>
+#include <map>
+#include <memory>
+
+#include "flight_controller_interface.hpp"
+
+namespace drone_base
+{
+  using FlightControllerFactory = std::function<std::unique_ptr<FlightControllerInterface>(
+    rclcpp::Node &node, rclcpp::Publisher<geometry_msgs::msg::Twist>::SharedPtr &cmd_vel_pub)>;
+
+  // Flight controllers by name, DroneBase picks one with the flight_controller parameter
+  // basic, simple and trajectory are always registered
+  class FlightControllerRegistry
+  {
+    std::map<std::string, FlightControllerFactory> factories_;
+
+    FlightControllerRegistry();
+
+  public:
+
+    static FlightControllerRegistry &instance();
+
+    // Add a controller, or replace a controller with the same name
+    void add(const std::string &name, FlightControllerFactory factory);
+
+    bool has(const std::string &name) const;
+
+    // Returns nullptr if there's no controller called name
+    std::unique_ptr<FlightControllerInterface> create(
+      const std::string &name, rclcpp::Node &node, rclcpp::Publisher<geometry_msgs::msg::Twist>::SharedPtr &cmd_vel_pub) const;
+
+    // Comma-separated list, for error messages
+    std::string names() const;
+  };
+}
+
+#endif //FLIGHT_CONTROLLER_REGISTRY_HPP
@@ -75,17 +75,14 @@ namespace drone_base
     SIMPLE_CONTROLLER_ALL_PARAMS
     SIMPLE_CONTROLLER_ALL_OTHERS
 
-    rclcpp::Time last_odom_time_;           // time of last odometry message
+    int64_t last_odom_ns_{};                // Time of last odometry message, 0 if none
     DronePose last_pose_;                   // pose from last odometry message
 
-    rclcpp::Time curr_target_time_;         // Deadline to hit the current target
+    int64_t curr_target_ns_{};              // Deadline to hit the current target
     DronePose curr_target_;                 // Current target pose
 
-    // PID controllers
-    pid::Controller2 x_controller_{false, 0.1, 0};
-    pid::Controller2 y_controller_{false, 0.1, 0};
-    pid::Controller2 z_controller_{false, 0.1, 0};
-    pid::Controller2 yaw_controller_{true, 0.2, 0};
+    // PD controllers for x, y, z and yaw
+    pid::BatchController controller_{1};
 
     void validate_parameters();
 
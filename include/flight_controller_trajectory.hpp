@@ -0,0 +1,88 @@
+#ifndef FLIGHT_CONTROLLER_TRAJECTORY_HPP
+#define FLIGHT_CONTROLLER_TRAJECTORY_HPP
+
+#include "rclcpp/rclcpp.hpp"
+
+#include "geometry_msgs/msg/twist.hpp"
+#include "nav_msgs/msg/odometry.hpp"
+#include "nav_msgs/msg/path.hpp"
+
+#include "ros2_shared/context_macros.hpp"
+#include "cubic_spline.hpp"
+#include "flight_controller_interface.hpp"
+#include "pid.hpp"
+
+namespace drone_base
+{
+#define TRAJECTORY_CONTROLLER_ALL_PARAMS \
+  CXT_MACRO_MEMBER(               /* Allow drone to stabilize for this duration */ \
+  stabilize_time_sec, \
+  double, 5.) \
+  CXT_MACRO_MEMBER(               /* PD coefficients */ \
+  traj_xy_kp, \
+  double, 0.8) \
+  CXT_MACRO_MEMBER(               /* PD coefficients */ \
+  traj_xy_kd, \
+  double, 0.2) \
+  CXT_MACRO_MEMBER(               /* PD coefficients */ \
+  traj_z_kp, \
+  double, 0.5) \
+  CXT_MACRO_MEMBER(               /* PD coefficients */ \
+  traj_z_kd, \
+  double, 0.1) \
+  CXT_MACRO_MEMBER(               /* PD coefficients */ \
+  traj_yaw_kp, \
+  double, 0.5) \
+  CXT_MACRO_MEMBER(               /* PD coefficients */ \
+  traj_yaw_kd, \
+  double, 0.0) \
+  CXT_MACRO_MEMBER(               /* Feed-forward gain, cmd_vel per m/s (or rad/s) of planned velocity */ \
+  traj_ff, \
+  double, 1.0) \
+  /* End of list */
+
+#define TRAJECTORY_CONTROLLER_ALL_OTHERS \
+  CXT_MACRO_MEMBER(             /* Allow drone to stabilize for this duration */ \
+  stabilize_time,  \
+  rclcpp::Duration, 0) \
+  /* End of list */
+
+  // Follow a minimum acceleration spline through the waypoints, see spline_planner
+  // The planned velocity is fed forward, the PD loop only corrects the tracking error
+  class FlightControllerTrajectory : public FlightControllerInterface
+  {
+
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_DEFINE_MEMBER(n, t, d)
+    TRAJECTORY_CONTROLLER_ALL_PARAMS
+    TRAJECTORY_CONTROLLER_ALL_OTHERS
+
+    int64_t last_odom_ns_{};                // Time of last odometry message, 0 if none
+    DronePose last_pose_;                   // Pose from last odometry message
+
+    spline::PoseSpline trajectory_;         // Fitted when the plan arrives
+    int cursor_{};                          // Current spline segment, odom times only move forward
+    int64_t end_ns_{};                      // Time of the last waypoint
+
+    // PD controllers for x, y, z and yaw
+    pid::BatchController controller_{1};
+
+    void validate_parameters();
+
+  public:
+    FlightControllerTrajectory(rclcpp::Node &node,
+                               rclcpp::Publisher<geometry_msgs::msg::Twist>::SharedPtr &cmd_vel_pub);
+
+    void _reset() override;
+
+    void _set_target(int target) override;
+
+    bool _odom_callback(const nav_msgs::msg::Odometry::SharedPtr &msg) override;
+
+    // The spline is fit to the whole plan
+    bool _can_stream() const override
+    { return false; }
+  };
+}
+
+#endif //FLIGHT_CONTROLLER_TRAJECTORY_HPP
@@ -0,0 +1,108 @@
+#ifndef FLOCK_ACTION_MGR_H
+#define FLOCK_ACTION_MGR_H
+
+#include <functional>
+
+#include "rclcpp/rclcpp.hpp"
+#include "tello_msgs/srv/tello_action.hpp"
+#include "tello_msgs/msg/tello_response.hpp"
+
+namespace flock_base
+{
+
+//==========================
+// Send the same action to every drone at the same time, and wait for all of them to finish.
+//
+// Each drone goes through the same steps as with drone_base::ActionMgr:
+// a TelloAction::Request, a TelloAction::Response, then a TelloResponse message.
+// All requests go out in one pass, and the responses are tracked together. The action is done when every drone
+// succeeded (the barrier), or when any drone failed or the deadline passed.
+// An action can also go to some of the drones, e.g., to land the drones that may have taken off when the rest
+// didn't.
+//
+// All callbacks run in the node's default callback group, so they don't need a lock.
+//==========================
+
+  class FlockActionMgr
+  {
+  public:
+
+    // Called once per send_all(), barrier_ns is the time the last drone finished, 0 on failure
+    using Callback = std::function<void(bool succeeded, int64_t barrier_ns, const std::string &result)>;
+
+  private:
+
+    enum class State
+    {
+      idle,
+      waiting_for_future,
+      waiting_for_response,
+      succeeded,
+      failed,
+    };
+
+    struct Drone
+    {
+      std::string ns_;
+      rclcpp::Client<tello_msgs::srv::TelloAction>::SharedPtr client_;
+      rclcpp::Subscription<tello_msgs::msg::TelloResponse>::SharedPtr tello_response_sub_;
+      State state_{State::idle};
+      bool rejected_{};             // The request was refused, the drone never started the action
+      int64_t done_ns_{};
+    };
+
+    rclcpp::Node &node_;
+    std::vector<Drone> drones_;
+
+    // Init by send_all()
+    std::string action_str_;
+    int64_t start_ns_{};
+    int64_t deadline_ns_{};
+    uint64_t sequence_{};           // Ignore responses to an earlier send_all()
+    Callback callback_;
+    std::vector<size_t> started_;   // Set by finish() and cancel()
+
+    void response_callback(size_t drone, uint64_t sequence,
+                           tello_msgs::srv::TelloAction::Response::SharedPtr response);
+
+    void tello_response_callback(size_t drone, tello_msgs::msg::TelloResponse::SharedPtr msg);
+
+    void set_state(size_t drone, State state);
+
+    void finish(bool succeeded, int64_t barrier_ns, const std::string &result);
+
+    // Fill started_ and make every drone idle
+    void end_action();
+
+  public:
+
+    explicit FlockActionMgr(rclcpp::Node &node, const std::vector<std::string> &drones);
+
+    ~FlockActionMgr()
+    {}
+
+    // Send an action to all drones, returns false if the last action hasn't finished
+    bool send_all(const std::string &action_str, double timeout_sec, Callback callback);
+
+    // Send an action to these drones (indices into the drone list), the other drones don't take part
+    bool send(const std::vector<size_t> &drones, const std::string &action_str, double timeout_sec,
+              Callback callback);
+
+    // The drones that were sent the last action and didn't refuse it, valid in its callback and after cancel().
+    // They may be partway through the action, e.g., still climbing, even if the action failed or timed out
+    const std::vector<size_t> &started() const
+    { return started_; }
+
+    // Check the deadline
+    void spin_once();
+
+    // Forget the active action, the callback isn't called, see started()
+    void cancel();
+
+    bool busy() const
+    { return static_cast<bool>(callback_); }
+  };
+
+} // namespace flock_base
+
+#endif // FLOCK_ACTION_MGR_H
@@ -4,8 +4,12 @@
 #include "rclcpp/rclcpp.hpp"
 #include "sensor_msgs/msg/joy.hpp"
 #include "std_msgs/msg/empty.hpp"
+#include "std_msgs/msg/header.hpp"
+#include "flock2/msg/manual_control.hpp"
 
 #include "ros2_shared/context_macros.hpp"
+#include "flock_action_mgr.hpp"
+#include "flock_monitor.hpp"
 #include "joystick.hpp"
 
 namespace flock_base
@@ -15,6 +19,30 @@ namespace flock_base
   CXT_MACRO_MEMBER(               /*  */ \
   drones, \
   std::vector<std::string>, "solo") \
+  CXT_MACRO_MEMBER(               /* 1: take off all drones at once and publish /flock_airborne */ \
+  flock_takeoff, \
+  int, 0) \
+  CXT_MACRO_MEMBER(               /* Stop the mission if the drones aren't all airborne within this duration */ \
+  takeoff_timeout_sec, \
+  double, 15.0) \
+  CXT_MACRO_MEMBER(               /* Send at most this many manual control messages per second */ \
+  manual_control_rate, \
+  double, 20.0) \
+  CXT_MACRO_MEMBER(               /* Joystick axes closer to 0 than this are 0 */ \
+  deadband, \
+  double, 0.05) \
+  CXT_MACRO_MEMBER(               /* Publish /flock_status at this rate, Hz, 0 to disable the monitor */ \
+  status_rate, \
+  double, 1.0) \
+  CXT_MACRO_MEMBER(               /* drone_base lands at this battery level, percent */ \
+  min_battery, \
+  int, 20) \
+  CXT_MACRO_MEMBER(               /* Warn when a drone will reach min_battery within this duration */ \
+  battery_warn_sec, \
+  double, 120.0) \
+  CXT_MACRO_MEMBER(               /* The discharge trend follows roughly this much of the battery history */ \
+  battery_trend_sec, \
+  double, 60.0) \
   /* End of list */
 
   class FlockBase : public rclcpp::Node
@@ -24,7 +52,7 @@ namespace flock_base
     FLOCK_BASE_ALL_PARAMS
 
     // Global state
-    bool mission_;
+    bool mission_{false};
 
     // Users can use the joystick to manually control one drone at a time
     int manual_control_{0};
@@ -33,24 +61,64 @@ namespace flock_base
     int joy_button_stop_mission_ = JOY_BUTTON_A;
     int joy_button_start_mission_ = JOY_BUTTON_B;
     int joy_button_next_drone_ = JOY_BUTTON_RIGHT_BUMPER;
+    int joy_axis_throttle_ = JOY_AXIS_RIGHT_FB;
+    int joy_axis_strafe_ = JOY_AXIS_RIGHT_LR;
+    int joy_axis_vertical_ = JOY_AXIS_LEFT_FB;
+    int joy_axis_yaw_ = JOY_AXIS_LEFT_LR;
+    int joy_button_takeoff_ = JOY_BUTTON_MENU;
+    int joy_button_land_ = JOY_BUTTON_VIEW;
+    int joy_button_shift_ = JOY_BUTTON_LEFT_BUMPER;
+    int joy_axis_trim_lr_ = JOY_AXIS_TRIM_LR;
+    int joy_axis_trim_fb_ = JOY_AXIS_TRIM_FB;
+
+    // Previous joystick buttons, used to detect button presses
+    std::vector<int32_t> prev_buttons_;
+
+    // The latest manual control command, and the last one sent
+    flock2::msg::ManualControl manual_;
+    flock2::msg::ManualControl sent_;
+    rclcpp::TimerBase::SharedPtr manual_timer_;
+
+    // Flock takeoff
+    std::unique_ptr<FlockActionMgr> action_mgr_;
+    rclcpp::TimerBase::SharedPtr spin_timer_;
+
+    // Flock health
+    std::unique_ptr<FlockMonitor> monitor_;
+    rclcpp::TimerBase::SharedPtr status_timer_;
 
     // Subscriptions
     rclcpp::Subscription<sensor_msgs::msg::Joy>::SharedPtr joy_sub_;
 
     // Publications
-    std::vector<rclcpp::Publisher<sensor_msgs::msg::Joy>::SharedPtr> joy_pubs_;
+    std::vector<rclcpp::Publisher<flock2::msg::ManualControl>::SharedPtr> manual_pubs_;
     rclcpp::Publisher<std_msgs::msg::Empty>::SharedPtr start_mission_pub_;
     rclcpp::Publisher<std_msgs::msg::Empty>::SharedPtr stop_mission_pub_;
+    rclcpp::Publisher<std_msgs::msg::Header>::SharedPtr airborne_pub_;
 
   public:
 
-    explicit FlockBase();
+    explicit FlockBase(const rclcpp::NodeOptions &options = rclcpp::NodeOptions());
 
     ~FlockBase()
     {}
 
   private:
-    void joy_callback(const sensor_msgs::msg::Joy::SharedPtr msg);
+    void joy_callback(sensor_msgs::msg::Joy::SharedPtr msg);
+
+    // Turn the joystick into a manual control command
+    void update_manual(const sensor_msgs::msg::Joy &msg);
+
+    void manual_timer_callback();
+
+    void start_mission();
+
+    void stop_mission();
+
+    void takeoff_callback(bool succeeded, int64_t barrier_ns, const std::string &result);
+
+    // Land these drones, e.g., the drones that may have taken off in a flock takeoff that didn't finish
+    void land(const std::vector<size_t> &drones);
 
     void validate_parameters();
   };
@@ -0,0 +1,139 @@
+#ifndef FLOCK_CONTROLLER_H
+#define FLOCK_CONTROLLER_H
+
+#include "rclcpp/rclcpp.hpp"
+#include "geometry_msgs/msg/twist.hpp"
+#include "nav_msgs/msg/odometry.hpp"
+#include "nav_msgs/msg/path.hpp"
+#include "std_msgs/msg/empty.hpp"
+#include "std_msgs/msg/u_int8.hpp"
+#include "flock2/msg/drone_status.hpp"
+
+#include "ros2_shared/context_macros.hpp"
+#include "pid.hpp"
+#include "plan_cache.hpp"
+
+namespace flock_controller
+{
+
+//=============================================================================
+// FlockController parameters
+//=============================================================================
+
+#define FLOCK_CONTROLLER_ALL_PARAMS \
+  CXT_MACRO_MEMBER(               /* Topic prefix for each drone */ \
+  drones, \
+  std::vector<std::string>, "solo") \
+  CXT_MACRO_MEMBER(               /* Control loop rate, Hz */ \
+  control_rate, \
+  double, 20.0) \
+  CXT_MACRO_MEMBER(               /* Allow drone to stabilize for this duration */ \
+  stabilize_time_sec, \
+  double, 5.) \
+  CXT_MACRO_MEMBER(               /* Drones closer than this, in meters, are told to hover */ \
+  min_separation, \
+  double, 0.5) \
+  CXT_MACRO_MEMBER(               /* Only control drones above this height, in meters */ \
+  min_control_z, \
+  double, 0.3) \
+  CXT_MACRO_MEMBER(               /* Stop controlling a drone if odometry is older than this */ \
+  odom_timeout_sec, \
+  double, 1.5) \
+  CXT_MACRO_MEMBER(               /* odom subscriptions, best_effort or reliable, keep last 1 */ \
+  sensor_qos, \
+  std::string, "best_effort") \
+  CXT_MACRO_MEMBER(               /* cmd_vel publishers, best_effort or reliable, keep last 1 */ \
+  cmd_vel_qos, \
+  std::string, "reliable") \
+  /* End of list */
+
+  struct FlockControllerContext
+  {
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_DEFINE_MEMBER(n, t, d)
+    FLOCK_CONTROLLER_ALL_PARAMS
+  };
+
+//=============================================================================
+// ControlledDrone: plan tracking for one drone, the control state lives in FlockController
+//=============================================================================
+
+  struct ControlledDrone
+  {
+    std::string ns_;
+
+    rclcpp::Subscription<nav_msgs::msg::Odometry>::SharedPtr odom_sub_;
+    rclcpp::Subscription<nav_msgs::msg::Path>::SharedPtr plan_sub_;
+    rclcpp::Subscription<std_msgs::msg::UInt8>::SharedPtr state_sub_;
+    rclcpp::Publisher<geometry_msgs::msg::Twist>::SharedPtr cmd_vel_pub_;
+
+    drone_base::PlanCache plan_;
+    int target_{};                          // Current target (index into plan_)
+    drone_base::PlanSegment segment_{};     // Current segment
+    int64_t prev_target_ns_{};              // Time we left the previous target
+    int64_t odom_ns_{};                     // Time of the last odom message, 0 if none
+    uint8_t state_{flock2::msg::DroneStatus::STATE_UNKNOWN};  // drone_base's ~state
+  };
+
+//=============================================================================
+// FlockController node
+//
+// Computes cmd_vel for all drones in one pass:
+//    Odometry for all drones is kept in one structure-of-arrays table
+//    Each tick a single BatchController call runs the x, y, z and yaw PID controllers for every drone
+//    Drones that are too close to each other are told to hover
+//
+// Target tracking is the same as FlightControllerBasic. drone_base should run with external_control set to 1:
+// it still handles takeoff, landing and mission logic, but doesn't publish cmd_vel during the mission.
+// A drone is only controlled during a mission, while drone_base's ~state is flight_odom: it's done taking off
+// and has odometry.
+//=============================================================================
+
+  class FlockController : public rclcpp::Node
+  {
+    FlockControllerContext cxt_{};
+
+    std::vector<ControlledDrone> drones_;
+
+    // Structure-of-arrays state, in pid::BatchController order
+    std::vector<double> state_;
+    std::vector<double> ubar_;
+    std::vector<bool> active_;
+
+    pid::BatchController controller_{0};
+
+    rclcpp::Subscription<std_msgs::msg::Empty>::SharedPtr start_mission_sub_;
+    rclcpp::Subscription<std_msgs::msg::Empty>::SharedPtr stop_mission_sub_;
+    rclcpp::TimerBase::SharedPtr timer_;
+    bool mission_{false};
+    int64_t prev_tick_ns_{};                // Time of the previous control tick, 0 if none
+
+    void odom_callback(int drone, const nav_msgs::msg::Odometry::SharedPtr &msg);
+
+    void plan_callback(int drone, const nav_msgs::msg::Path::SharedPtr &msg);
+
+    void timer_callback();
+
+    void start_mission_callback(const std_msgs::msg::Empty::SharedPtr msg);
+
+    void stop_mission_callback(const std_msgs::msg::Empty::SharedPtr msg);
+
+    void set_target(int drone, int target, int64_t now_ns);
+
+    bool update_target(int drone, int64_t now_ns);
+
+    void check_separation();
+
+    void validate_parameters();
+
+  public:
+
+    explicit FlockController(const rclcpp::NodeOptions &options = rclcpp::NodeOptions());
+
+    ~FlockController()
+    {}
+  };
+
+} // namespace flock_controller
+
+#endif // FLOCK_CONTROLLER_H
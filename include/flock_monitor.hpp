@@ -0,0 +1,112 @@
+#ifndef FLOCK_MONITOR_H
+#define FLOCK_MONITOR_H
+
+#include <cmath>
+
+#include "rclcpp/rclcpp.hpp"
+#include "nav_msgs/msg/odometry.hpp"
+#include "std_msgs/msg/u_int8.hpp"
+#include "tello_msgs/msg/flight_data.hpp"
+#include "flock2/msg/flock_status.hpp"
+
+namespace flock_base
+{
+
+//==========================
+// Exponentially weighted least squares fit of y = a + b * t, O(1) per sample
+//
+// Old samples fade with time constant tau, so the slope follows the recent trend.
+//==========================
+
+  class Trend
+  {
+    double tau_;
+    double w_{}, st_{}, sy_{}, stt_{}, sty_{};
+    double last_t_{};
+
+  public:
+
+    explicit Trend(double tau) : tau_{tau}
+    {}
+
+    void add(double t, double y)
+    {
+      double decay = w_ > 0 ? std::exp(-(t - last_t_) / tau_) : 1;
+      w_ = w_ * decay + 1;
+      st_ = st_ * decay + t;
+      sy_ = sy_ * decay + y;
+      stt_ = stt_ * decay + t * t;
+      sty_ = sty_ * decay + t * y;
+      last_t_ = t;
+    }
+
+    void reset()
+    { w_ = st_ = sy_ = stt_ = sty_ = 0; }
+
+    // 0 until there's enough spread in t
+    double slope() const
+    {
+      double den = w_ * stt_ - st_ * st_;
+      return den > 1e-6 ? (w_ * sty_ - st_ * sy_) / den : 0;
+    }
+  };
+
+//==========================
+// Keep a compact health record for every drone, and publish them all in one message
+//
+// The flight_data, base_odom and state callbacks only update counters and the latest values, nothing is logged
+// or allocated per message. The status timer computes rates and the battery trend, warns when a drone is
+// about to reach min_battery, and publishes /flock_status.
+//
+// All callbacks run in the node's default callback group, so they don't need a lock.
+//==========================
+
+  class FlockMonitor
+  {
+    struct Drone
+    {
+      rclcpp::Subscription<tello_msgs::msg::FlightData>::SharedPtr flight_data_sub_;
+      rclcpp::Subscription<nav_msgs::msg::Odometry>::SharedPtr odom_sub_;
+      rclcpp::Subscription<std_msgs::msg::UInt8>::SharedPtr state_sub_;
+
+      // Updated by the callbacks
+      uint8_t state_{flock2::msg::DroneStatus::STATE_UNKNOWN};
+      int battery_{-1};
+      uint64_t flight_data_count_{};
+      uint64_t odom_count_{};
+      int64_t flight_data_ns_{};
+
+      // Updated by the status timer
+      Trend discharge_;
+      bool warned_{false};
+
+      explicit Drone(double tau) : discharge_{tau}
+      {}
+    };
+
+    rclcpp::Node &node_;
+    int min_battery_;
+    double warn_sec_;
+
+    std::vector<Drone> drones_;
+    flock2::msg::FlockStatus status_;               // Reused, the strings are set once
+    rclcpp::Publisher<flock2::msg::FlockStatus>::SharedPtr status_pub_;
+    int64_t start_ns_;                              // Trend times are relative to this, keeps t * t small
+    int64_t last_publish_ns_{};
+
+  public:
+
+    // The discharge trend follows the last trend_sec or so
+    explicit FlockMonitor(rclcpp::Node &node, const std::vector<std::string> &drones, int min_battery,
+                          double warn_sec, double trend_sec);
+
+    ~FlockMonitor()
+    {}
+
+    // Compute rates and trends, warn, and publish /flock_status
+    void publish();
+  };
+
+} // namespace flock_base
+
+#endif // FLOCK_MONITOR_H
@@ -0,0 +1,145 @@
+#ifndef FLOCK_SIM_H
+#define FLOCK_SIM_H
+
+#include "rclcpp/rclcpp.hpp"
+#include "geometry_msgs/msg/twist.hpp"
+#include "nav_msgs/msg/odometry.hpp"
+#include "rosgraph_msgs/msg/clock.hpp"
+#include "tello_msgs/msg/flight_data.hpp"
+#include "tello_msgs/msg/tello_response.hpp"
+#include "tello_msgs/srv/tello_action.hpp"
+
+#include "ros2_shared/context_macros.hpp"
+
+namespace flock_sim
+{
+
+//=============================================================================
+// FlockSim parameters
+//=============================================================================
+
+#define FLOCK_SIM_ALL_PARAMS \
+  CXT_MACRO_MEMBER(               /* Topic prefix for each drone */ \
+  drones, \
+  std::vector<std::string>, "solo") \
+  CXT_MACRO_MEMBER(               /* Integration and odometry rate, Hz */ \
+  sim_rate, \
+  double, 30.0) \
+  CXT_MACRO_MEMBER(               /* Flight data rate, Hz */ \
+  flight_data_rate, \
+  double, 10.0) \
+  CXT_MACRO_MEMBER(               /* Drones start on the ground in a grid with this spacing, m */ \
+  spacing, \
+  double, 1.0) \
+  CXT_MACRO_MEMBER(               /* Horizontal speed at full stick, m/s */ \
+  max_xy_speed, \
+  double, 1.0) \
+  CXT_MACRO_MEMBER(               /* Vertical speed at full stick, m/s */ \
+  max_z_speed, \
+  double, 1.0) \
+  CXT_MACRO_MEMBER(               /* Yaw rate at full stick, rad/s */ \
+  max_yaw_rate, \
+  double, 1.7) \
+  CXT_MACRO_MEMBER(               /* Velocity time constant, s */ \
+  tau, \
+  double, 0.2) \
+  CXT_MACRO_MEMBER(               /* Takeoff height, m */ \
+  takeoff_z, \
+  double, 1.0) \
+  CXT_MACRO_MEMBER(               /* Takeoff and land take this long */ \
+  action_sec, \
+  double, 3.0) \
+  CXT_MACRO_MEMBER(               /* 1: own the clock, publish /clock, run other nodes with use_sim_time */ \
+  publish_clock, \
+  int, 0) \
+  CXT_MACRO_MEMBER(               /* With publish_clock, simulated seconds per wall second */ \
+  time_scale, \
+  double, 1.0) \
+  /* End of list */
+
+  struct FlockSimContext
+  {
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_DEFINE_MEMBER(n, t, d)
+    FLOCK_SIM_ALL_PARAMS
+  };
+
+//=============================================================================
+// SimDrone: ROS entities for one drone, the kinematic state lives in FlockSim
+//=============================================================================
+
+  enum class Phase
+  {
+    landed,
+    taking_off,
+    flying,
+    landing,
+  };
+
+  struct SimDrone
+  {
+    std::string ns_;
+
+    rclcpp::Subscription<geometry_msgs::msg::Twist>::SharedPtr cmd_vel_sub_;
+    rclcpp::Publisher<nav_msgs::msg::Odometry>::SharedPtr odom_pub_;
+    rclcpp::Publisher<tello_msgs::msg::FlightData>::SharedPtr flight_data_pub_;
+    rclcpp::Publisher<tello_msgs::msg::TelloResponse>::SharedPtr tello_response_pub_;
+    rclcpp::Service<tello_msgs::srv::TelloAction>::SharedPtr tello_action_srv_;
+
+    Phase phase_{Phase::landed};
+    int64_t action_end_ns_{};       // Takeoff or land completes at this time
+  };
+
+//=============================================================================
+// FlockSim node
+//
+// Kinematic simulation of many Tello drones, stands in for gazebo, tello_driver and vloc_node:
+//    cmd_vel sets a target velocity, the actual velocity follows it with a first order lag
+//    The state for all drones is kept in structure-of-arrays form and integrated in one loop
+//    tello_action accepts takeoff and land, and sends tello_response when the maneuver is done
+//    base_odom is published at sim_rate, flight_data at flight_data_rate
+//=============================================================================
+
+  class FlockSim : public rclcpp::Node
+  {
+    FlockSimContext cxt_{};
+
+    std::vector<SimDrone> drones_;
+
+    // Structure-of-arrays state, one entry per drone
+    std::vector<double> x_, y_, z_, yaw_;         // World frame
+    std::vector<double> vx_, vy_, vz_, vyaw_;     // World frame
+    std::vector<double> cmd_x_, cmd_y_, cmd_z_, cmd_yaw_;  // Body frame, [-1, 1]
+
+    rclcpp::Publisher<rosgraph_msgs::msg::Clock>::SharedPtr clock_pub_;
+    rclcpp::TimerBase::SharedPtr sim_timer_;
+    int64_t sim_ns_{};                            // Simulated time
+    int64_t next_flight_data_ns_{};
+
+    int64_t now_ns();
+
+    void cmd_vel_callback(int drone, const geometry_msgs::msg::Twist::SharedPtr &msg);
+
+    void tello_action_callback(int drone, const std::shared_ptr<tello_msgs::srv::TelloAction::Request> &request,
+                               std::shared_ptr<tello_msgs::srv::TelloAction::Response> &response);
+
+    void sim_callback();
+
+    // Advance all drones by dt seconds
+    void integrate(double dt, int64_t t_ns);
+
+    void publish(int64_t t_ns);
+
+    void validate_parameters();
+
+  public:
+
+    explicit FlockSim(const rclcpp::NodeOptions &options = rclcpp::NodeOptions());
+
+    ~FlockSim()
+    {}
+  };
+
+} // namespace flock_sim
+
+#endif // FLOCK_SIM_H
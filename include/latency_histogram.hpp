@@ -0,0 +1,105 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <array>
+#include <cstdint>
+
+namespace drone_base
+{
+
+//=============================================================================
+// Log2 latency histogram
+//
+// Bucket i counts samples in [2^i, 2^(i+1)) microseconds, bucket 0 also holds
+// everything below 1us. Percentiles are reported as the upper bound of the bucket
+// that contains them, which is good enough to tell 1ms from 50ms.
+// Adding a sample is O(1) and never allocates.
+//=============================================================================
+
+  class LatencyHistogram
+  {
+  public:
+    static constexpr int NUM_BUCKETS = 32;
+
+  private:
+    std::array<uint64_t, NUM_BUCKETS> buckets_{};
+    uint64_t count_{0};
+    int64_t sum_ns_{0};
+    int64_t max_ns_{0};
+
+    static int bucket(int64_t ns)
+    {
+      uint64_t us = ns > 0 ? static_cast<uint64_t>(ns) / 1000 : 0;
+      int b = 0;
+      while (us > 1 && b < NUM_BUCKETS - 1) {
+        us >>= 1;
+        b++;
+      }
+      return b;
+    }
+
+  public:
+
+    void add(int64_t ns)
+    {
+      buckets_[bucket(ns)]++;
+      count_++;
+      sum_ns_ += ns;
+      if (ns > max_ns_) {
+        max_ns_ = ns;
+      }
+    }
+
+    void merge(const LatencyHistogram &that)
+    {
+      for (int i = 0; i < NUM_BUCKETS; i++) {
+        buckets_[i] += that.buckets_[i];
+      }
+      count_ += that.count_;
+      sum_ns_ += that.sum_ns_;
+      if (that.max_ns_ > max_ns_) {
+        max_ns_ = that.max_ns_;
+      }
+    }
+
+    void reset()
+    {
+      *this = LatencyHistogram();
+    }
+
+    uint64_t count() const
+    { return count_; }
+
+    int64_t max_ns() const
+    { return max_ns_; }
+
+    int64_t mean_ns() const
+    { return count_ ? sum_ns_ / static_cast<int64_t>(count_) : 0; }
+
+    // p is [0, 1], result is the upper bound of the bucket in ns, capped at max
+    int64_t percentile_ns(double p) const
+    {
+      if (count_ == 0) {
+        return 0;
+      }
+
+      auto rank = static_cast<uint64_t>(p * static_cast<double>(count_ - 1)) + 1;
+      uint64_t seen = 0;
+      for (int i = 0; i < NUM_BUCKETS; i++) {
+        seen += buckets_[i];
+        if (seen >= rank) {
+          int64_t upper = (int64_t{2} << i) * 1000;
+          return upper < max_ns_ ? upper : max_ns_;
+        }
+      }
+
+      return max_ns_;
+    }
+
+    uint64_t bucket_count(int i) const
+    { return buckets_[i]; }
+  };
+
+} // namespace drone_base
+
+#endif // LATENCY_HISTOGRAM_H
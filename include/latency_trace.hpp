@@ -0,0 +1,198 @@
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "latency_histogram.hpp"
+
+namespace drone_base
+{
+
+//=============================================================================
+// Trace events, recorded on the hot path
+//=============================================================================
+
+  enum class TraceEvent : uint32_t
+  {
+    odom_received,      // DroneBase::odom_callback
+    plan_received,      // DroneBase::plan_callback
+    cmd_vel_published,  // FlightControllerInterface::publish_control
+    action_sent,        // ActionMgr::send
+    action_accepted,    // ActionMgr::spin_once got the TelloAction::Response
+    action_complete,    // ActionMgr::complete got the TelloResponse
+  };
+
+//=============================================================================
+// Lock-free ring of (event, steady_clock time) records
+//
+// Any number of threads may record, one thread drains. Recording is a fetch_add and a few relaxed stores,
+// it never blocks and never allocates. Each slot is guarded by a sequence number, so a reader that races
+// a writer wrapping around the ring drops the record instead of reading a torn one.
+// If the reader falls more than SIZE records behind the oldest records are lost, see dropped().
+//=============================================================================
+
+  class TraceRing
+  {
+  public:
+    static constexpr uint64_t SIZE = 4096;  // Power of 2
+
+  private:
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of 2");
+
+    struct Slot
+    {
+      std::atomic<uint64_t> seq{0};   // Record index + 1, 0 while the slot is being written
+      std::atomic<uint32_t> event{0};
+      std::atomic<int64_t> t_ns{0};
+    };
+
+    Slot slots_[SIZE];
+    std::atomic<uint64_t> head_{0};
+    uint64_t tail_{0};
+    uint64_t dropped_{0};
+
+  public:
+
+    static int64_t now_ns()
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void record(TraceEvent event)
+    {
+      uint64_t i = head_.fetch_add(1, std::memory_order_relaxed);
+      Slot &slot = slots_[i & (SIZE - 1)];
+      slot.seq.store(0, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      slot.event.store(static_cast<uint32_t>(event), std::memory_order_relaxed);
+      slot.t_ns.store(now_ns(), std::memory_order_relaxed);
+      slot.seq.store(i + 1, std::memory_order_release);
+    }
+
+    // Call f(event, t_ns) for every record since the last drain, oldest first. Single reader only.
+    template<typename F>
+    void drain(F f)
+    {
+      uint64_t head = head_.load(std::memory_order_acquire);
+      if (head - tail_ > SIZE) {
+        dropped_ += head - tail_ - SIZE;
+        tail_ = head - SIZE;
+      }
+
+      while (tail_ < head) {
+        Slot &slot = slots_[tail_ & (SIZE - 1)];
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq == 0 || seq < tail_ + 1) {
+          // Still being written, pick it up next time
+          break;
+        }
+
+        auto event = static_cast<TraceEvent>(slot.event.load(std::memory_order_relaxed));
+        int64_t t_ns = slot.t_ns.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (seq == tail_ + 1 && slot.seq.load(std::memory_order_relaxed) == seq) {
+          f(event, t_ns);
+        } else {
+          // Overwritten by a writer that wrapped around
+          dropped_++;
+        }
+        tail_++;
+      }
+    }
+
+    uint64_t dropped() const
+    { return dropped_; }
+  };
+
+//=============================================================================
+// LatencyTrace
+//
+// Pairs trace events into intervals:
+//    odom_received -> next cmd_vel_published
+//    plan_received -> first cmd_vel_published after the plan
+//    action_sent -> action_accepted, action_sent -> action_complete
+//
+// Hot path code holds a LatencyTrace pointer that is null when tracing is off, so the cost of tracing
+// when it's turned off is a single branch.
+//=============================================================================
+
+  class LatencyTrace
+  {
+    TraceRing ring_;
+
+    // Start times of the intervals in progress, 0 if none
+    int64_t odom_ns_{};
+    int64_t plan_ns_{};
+    int64_t action_ns_{};
+
+  public:
+    LatencyHistogram odom_to_cmd_vel;
+    LatencyHistogram plan_to_cmd_vel;
+    LatencyHistogram action_to_accepted;
+    LatencyHistogram action_to_complete;
+
+    void record(TraceEvent event)
+    {
+      ring_.record(event);
+    }
+
+    // Move the recorded events into the histograms, call from one thread only
+    void update()
+    {
+      ring_.drain([this](TraceEvent event, int64_t t_ns)
+      {
+        switch (event) {
+          case TraceEvent::odom_received:
+            odom_ns_ = t_ns;
+            break;
+          case TraceEvent::plan_received:
+            plan_ns_ = t_ns;
+            break;
+          case TraceEvent::cmd_vel_published:
+            if (odom_ns_) {
+              odom_to_cmd_vel.add(t_ns - odom_ns_);
+              odom_ns_ = 0;
+            }
+            if (plan_ns_) {
+              plan_to_cmd_vel.add(t_ns - plan_ns_);
+              plan_ns_ = 0;
+            }
+            break;
+          case TraceEvent::action_sent:
+            action_ns_ = t_ns;
+            break;
+          case TraceEvent::action_accepted:
+            if (action_ns_) {
+              action_to_accepted.add(t_ns - action_ns_);
+            }
+            break;
+          case TraceEvent::action_complete:
+            if (action_ns_) {
+              action_to_complete.add(t_ns - action_ns_);
+              action_ns_ = 0;
+            }
+            break;
+        }
+      });
+    }
+
+    // Clear the histograms, intervals in progress are kept
+    void reset()
+    {
+      odom_to_cmd_vel.reset();
+      plan_to_cmd_vel.reset();
+      action_to_accepted.reset();
+      action_to_complete.reset();
+    }
+
+    uint64_t dropped() const
+    { return ring_.dropped(); }
+  };
+
+} // namespace drone_base
+
+#endif // LATENCY_TRACE_H
@@ -0,0 +1,23 @@
+#ifndef PARAM_SNAPSHOT_H
+#define PARAM_SNAPSHOT_H
+
+#include <string>
+
+#include "rclcpp/rclcpp.hpp"
+
+namespace drone_base
+{
+
+//=============================================================================
+// Write every parameter a node has declared to a ROS 2 parameter file
+//
+// Load the file with --ros-args --params-file, the node then starts with the same values without the launch
+// file computing them. use_sim_time is left out, the launch file still decides the clock.
+// Returns false if the file can't be written.
+//=============================================================================
+
+  bool write_param_snapshot(rclcpp::Node &node, const std::string &path);
+
+} // namespace drone_base
+
+#endif // PARAM_SNAPSHOT_H
@@ -0,0 +1,46 @@
+#ifndef PARAMETERS_CALLBACK_HPP
+#define PARAMETERS_CALLBACK_HPP
+
+#include <utility>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+
+namespace drone_base
+{
+
+//=============================================================================
+// ParametersCallback
+//
+// A node has one parameter callback, and CXT_MACRO_REGISTER_PARAMETERS_CHANGED replaces it. DroneBase and
+// each flight controller register with one of these instead, and DroneBase's node callback calls them all.
+//=============================================================================
+
+  class ParametersCallback
+  {
+    rclcpp::Node::OnParametersSetCallbackType callback_;
+
+  public:
+
+    // Same as rclcpp::Node, so CXT_MACRO_REGISTER_PARAMETERS_CHANGED can register with this
+    rclcpp::Node::OnParametersSetCallbackType set_on_parameters_set_callback(
+      rclcpp::Node::OnParametersSetCallbackType callback)
+    {
+      std::swap(callback_, callback);
+      return callback;
+    }
+
+    rcl_interfaces::msg::SetParametersResult operator()(const std::vector<rclcpp::Parameter> &parameters) const
+    {
+      if (callback_) {
+        return callback_(parameters);
+      }
+      rcl_interfaces::msg::SetParametersResult result;
+      result.successful = true;
+      return result;
+    }
+  };
+
+} // namespace drone_base
+
+#endif // PARAMETERS_CALLBACK_HPP
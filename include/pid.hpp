@@ -3,9 +3,18 @@
 
 #include <math.h>
 
+#include <cmath>
+#include <vector>
+
 namespace pid
 {
 
+  // Move an angle to [-pi, pi] without branches, so loops over many angles can be vectorized
+  inline double norm_angle(double a)
+  {
+    return a - 2 * M_PI * std::nearbyint(a / (2 * M_PI));
+  }
+
   class Controller
   {
   private:
@@ -65,12 +74,7 @@ namespace pid
 
       if (angle_) {
         // Deal with discontinuity
-        while (error < -M_PI) {
-          error += 2 * M_PI;
-        }
-        while (error > M_PI) {
-          error -= 2 * M_PI;
-        }
+        error = norm_angle(error);
       }
 
       integral_ = integral_ + (error * dt);
@@ -113,18 +117,143 @@ namespace pid
 
       if (angle_) {
         // Deal with discontinuity
-        while (y_error < -M_PI) {
-          y_error += 2 * M_PI;
-        }
-        while (y_error > M_PI) {
-          y_error -= 2 * M_PI;
-        }
+        y_error = norm_angle(y_error);
       }
 
       return Kp_ * y_error + Kd_ * y_dot_error;
     }
   };
 
+  // Axes controlled by BatchController
+  enum Axis
+  {
+    X,
+    Y,
+    Z,
+    YAW,
+    NUM_AXES,
+  };
+
+  // Runs x, y, z and yaw controllers for many drones in one pass
+  //
+  // State is kept in structure-of-arrays form, element i is axis i % NUM_AXES of drone i / NUM_AXES.
+  // Inputs and outputs are arrays of size() doubles in the same order.
+  // A BatchController for 1 drone behaves like 4 Controllers (or Controller2s) with the same gains.
+  class BatchController
+  {
+  private:
+
+    int num_drones_;
+    std::vector<double> angle_;       // 1 if we're controlling an angle [-pi, pi], 0 otherwise
+    std::vector<double> target_;
+    std::vector<double> prev_error_;
+    std::vector<double> integral_;
+    std::vector<double> Kp_;
+    std::vector<double> Ki_;
+    std::vector<double> Kd_;
+
+    double error(int i, double state) const
+    {
+      double error = target_[i] - state;
+
+      // Deal with discontinuity, without a branch
+      return error - angle_[i] * 2 * M_PI * std::nearbyint(error / (2 * M_PI));
+    }
+
+  public:
+
+    explicit BatchController(int num_drones) :
+      num_drones_{num_drones},
+      angle_(num_drones * NUM_AXES, 0.),
+      target_(num_drones * NUM_AXES, 0.),
+      prev_error_(num_drones * NUM_AXES, 0.),
+      integral_(num_drones * NUM_AXES, 0.),
+      Kp_(num_drones * NUM_AXES, 0.),
+      Ki_(num_drones * NUM_AXES, 0.),
+      Kd_(num_drones * NUM_AXES, 0.)
+    {
+      for (int drone = 0; drone < num_drones_; drone++) {
+        angle_[index(drone, YAW)] = 1.;
+      }
+    }
+
+    int num_drones() const
+    { return num_drones_; }
+
+    int size() const
+    { return num_drones_ * NUM_AXES; }
+
+    static int index(int drone, int axis)
+    { return drone * NUM_AXES + axis; }
+
+    // Set coefficients for one axis of one drone
+    void set_coefficients(int drone, int axis, double Kp, double Ki, double Kd)
+    {
+      int i = index(drone, axis);
+      Kp_[i] = Kp;
+      Ki_[i] = Ki;
+      Kd_[i] = Kd;
+    }
+
+    // Set coefficients for one axis of all drones
+    void set_coefficients(int axis, double Kp, double Ki, double Kd)
+    {
+      for (int drone = 0; drone < num_drones_; drone++) {
+        set_coefficients(drone, axis, Kp, Ki, Kd);
+      }
+    }
+
+    // Set target, same as Controller::set_target
+    void set_target(int drone, int axis, double target)
+    {
+      int i = index(drone, axis);
+      target_[i] = target;
+      prev_error_[i] = 0;
+      integral_[i] = 0;
+    }
+
+    double target(int drone, int axis) const
+    {
+      return target_[index(drone, axis)];
+    }
+
+    // PID calculation for all axes of all drones, same as Controller::calc
+    void calc(const double *state, double dt, const double *bias, double *u)
+    {
+      const int n = size();
+      for (int i = 0; i < n; i++) {
+        double e = error(i, state[i]);
+        integral_[i] = integral_[i] + (e * dt);
+        double derivative = (e - prev_error_[i]) / dt;
+        prev_error_[i] = e;
+        u[i] = Kp_[i] * e + Ki_[i] * integral_[i] + Kd_[i] * derivative + bias[i];
+      }
+    }
+
+    // PID calculation with no bias
+    void calc(const double *state, double dt, double *u)
+    {
+      const int n = size();
+      for (int i = 0; i < n; i++) {
+        double e = error(i, state[i]);
+        integral_[i] = integral_[i] + (e * dt);
+        double derivative = (e - prev_error_[i]) / dt;
+        prev_error_[i] = e;
+        u[i] = Kp_[i] * e + Ki_[i] * integral_[i] + Kd_[i] * derivative;
+      }
+    }
+
+    // PD calculation on position and velocity for all axes of all drones, same as Controller2::calc
+    // The position target is the one set by set_target, y_dot_target is the feed-forward velocity
+    void calc(const double *y_actual, const double *y_dot_target, const double *y_dot_actual, double *u) const
+    {
+      const int n = size();
+      for (int i = 0; i < n; i++) {
+        u[i] = Kp_[i] * error(i, y_actual[i]) + Kd_[i] * (y_dot_target[i] - y_dot_actual[i]);
+      }
+    }
+  };
+
 } // namespace pid
 
 #endif // PID_H
\ No newline at end of file
@@ -0,0 +1,180 @@
+#ifndef PLAN_CACHE_HPP
+#define PLAN_CACHE_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "nav_msgs/msg/path.hpp"
+#include "flock2/msg/compact_plan.hpp"
+
+#include "drone_pose.hpp"
+#include "plan_codec.hpp"
+
+namespace drone_base
+{
+
+//=============================================================================
+// PlanSegment: one leg of the plan, from the previous waypoint to this waypoint
+//=============================================================================
+
+  struct PlanSegment
+  {
+    DronePose start;            // Pose at the previous waypoint
+    DronePose end;              // Pose at this waypoint
+    int64_t start_ns;           // Time we leave the previous waypoint
+    int64_t end_ns;             // Deadline to reach this waypoint
+    double vx, vy, vz, vyaw;    // Velocity required to reach this waypoint on time
+  };
+
+//=============================================================================
+// PlanCache
+//
+// The plan is converted once, when it arrives, into a contiguous array of segments.
+// Segment i ends at waypoint i. Segment 0 is the takeoff segment: it starts and ends at waypoint 0,
+// its start time is 0 (the controller decides when to leave) and its velocity is 0.
+//
+// The message is shared with the subscription, never copied.
+//
+// A streamed plan arrives as a series of CompactPlan windows. The segments go into a ring of fixed capacity,
+// indexed by their position in the whole plan, so the controller's target index stays valid as windows are
+// appended. size() is the number of segments received so far, complete() is false until the last window.
+//=============================================================================
+
+  class PlanCache
+  {
+    nav_msgs::msg::Path::ConstSharedPtr msg_;
+    std::vector<PlanSegment> segments_;
+    int64_t deadline_offset_ns_{};
+
+    // Streaming: the ring holds segments [end_ - capacity, end_)
+    bool streaming_{false};
+    int end_{};
+    bool complete_{true};
+
+    PlanSegment &at(int i)
+    { return segments_[streaming_ ? i % segments_.size() : i]; }
+
+    // Fill in the rest of the segment from the previous one, or as the takeoff segment if i is 0
+    void link(int i)
+    {
+      PlanSegment &segment = at(i);
+
+      if (i == 0) {
+        segment.start = segment.end;
+        segment.start_ns = 0;
+        segment.vx = segment.vy = segment.vz = segment.vyaw = 0;
+        return;
+      }
+
+      const PlanSegment &prev = at(i - 1);
+      segment.start = prev.end;
+      segment.start_ns = prev.end_ns + deadline_offset_ns_;
+
+      auto flight_time = static_cast<double>(segment.end_ns - segment.start_ns) / 1e9;
+      if (flight_time > 0) {
+        segment.vx = (segment.end.x - segment.start.x) / flight_time;
+        segment.vy = (segment.end.y - segment.start.y) / flight_time;
+        segment.vz = (segment.end.z - segment.start.z) / flight_time;
+        segment.vyaw = PoseUtil::norm_angle(segment.end.yaw - segment.start.yaw) / flight_time;
+      } else {
+        // The leg is shorter than the deadline offset, there's no time to fly it on schedule. The controllers
+        // track from the start at the segment velocity, so start at the end: they aim straight at the waypoint
+        segment.start = segment.end;
+        segment.vx = segment.vy = segment.vz = segment.vyaw = 0;
+      }
+    }
+
+  public:
+
+    // Deadlines are waypoint timestamps minus deadline_offset_ns
+    void build(const nav_msgs::msg::Path::ConstSharedPtr &msg, int64_t deadline_offset_ns)
+    {
+      msg_ = msg;
+      deadline_offset_ns_ = deadline_offset_ns;
+      streaming_ = false;
+      complete_ = true;
+      end_ = static_cast<int>(msg->poses.size());
+      segments_.resize(msg->poses.size());
+
+      for (int i = 0; i < end_; i++) {
+        PlanSegment &segment = segments_[i];
+        segment.end.fromMsg(msg->poses[i].pose);
+        segment.end_ns = rclcpp::Time(msg->poses[i].header.stamp).nanoseconds() - deadline_offset_ns;
+        link(i);
+      }
+    }
+
+    // Start an empty streamed plan, the ring never grows after this
+    void start_stream(int capacity, int64_t deadline_offset_ns)
+    {
+      msg_.reset();
+      deadline_offset_ns_ = deadline_offset_ns;
+      streaming_ = true;
+      complete_ = false;
+      end_ = 0;
+      segments_.resize(std::max(capacity, 1));
+    }
+
+    // Append a window, replacing any segments from first_index on. The window can't leave a gap, replace
+    // segments the controller has already started (target and before), or push segment target out of the ring
+    bool append(const flock2::msg::CompactPlan &window, int target)
+    {
+      auto first = static_cast<int>(window.first_index);
+      auto n = static_cast<int>(window.dt_ms.size());
+      auto capacity = static_cast<int>(segments_.size());
+      if (!streaming_ || first > end_ || first < target || (first == target && first < end_) ||
+          first + n > target + capacity || !valid_compact(window)) {
+        return false;
+      }
+
+      int64_t t_ns = PoseUtil::to_ns(window.header.stamp);
+      for (int i = 0; i < n; i++) {
+        t_ns += RCL_MS_TO_NS(static_cast<int64_t>(window.dt_ms[i]));
+        PlanSegment &segment = at(first + i);
+        segment.end.x = window.x[i];
+        segment.end.y = window.y[i];
+        segment.end.z = window.z[i];
+        segment.end.yaw = window.yaw[i];
+        segment.end_ns = t_ns - deadline_offset_ns_;
+        link(first + i);
+      }
+
+      end_ = first + n;
+      complete_ = window.end_of_plan;
+      return true;
+    }
+
+    void clear()
+    {
+      msg_.reset();
+      segments_.clear();
+      streaming_ = false;
+      complete_ = true;
+      end_ = 0;
+    }
+
+    bool empty() const
+    { return end_ == 0; }
+
+    // Segments received so far
+    int size() const
+    { return end_; }
+
+    // False while a streamed plan is waiting for more windows
+    bool complete() const
+    { return complete_; }
+
+    bool streaming() const
+    { return streaming_; }
+
+    const PlanSegment &operator[](int i) const
+    { return segments_[streaming_ ? i % segments_.size() : i]; }
+
+    // Null for a streamed plan
+    const nav_msgs::msg::Path::ConstSharedPtr &msg() const
+    { return msg_; }
+  };
+
+} // namespace drone_base
+
+#endif //PLAN_CACHE_HPP
@@ -0,0 +1,32 @@
+#ifndef PLAN_CODEC_H
+#define PLAN_CODEC_H
+
+#include <cstdint>
+
+#include "nav_msgs/msg/path.hpp"
+#include "flock2/msg/compact_plan.hpp"
+
+namespace drone_base
+{
+
+//=============================================================================
+// Convert between nav_msgs/Path and flock2/CompactPlan
+//
+// Timestamps are rounded to the nearest ms relative to the plan stamp before they are delta encoded,
+// so the rounding error never accumulates along the plan. Waypoints before the plan stamp are clamped to it.
+//=============================================================================
+
+  // Waypoints [first, first + count) of the path, the whole path by default
+  void to_compact(const nav_msgs::msg::Path &path, flock2::msg::CompactPlan &plan,
+                  size_t first = 0, size_t count = SIZE_MAX);
+
+  // False if the arrays aren't all the same length
+  bool valid_compact(const flock2::msg::CompactPlan &plan);
+
+  // All PoseStamped headers get the plan frame, first_index and end_of_plan are ignored
+  // Returns false, and leaves path alone, if the plan isn't valid
+  bool from_compact(const flock2::msg::CompactPlan &plan, nav_msgs::msg::Path &path);
+
+} // namespace drone_base
+
+#endif // PLAN_CODEC_H
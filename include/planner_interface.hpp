@@ -0,0 +1,98 @@
+#ifndef PLANNER_INTERFACE_H
+#define PLANNER_INTERFACE_H
+
+#include "rclcpp/rclcpp.hpp"
+#include "nav_msgs/msg/path.hpp"
+
+#include "collision_index.hpp"
+
+namespace planner_node
+{
+
+  struct PlannerParams
+  {
+    double arena_x;           // Arena extent, the arena runs from 0 to arena_x, which may be negative
+    double arena_y;
+    double arena_z;
+    double max_speed;         // Peak speed on any leg, m/s
+    double min_separation;    // Minimum distance between any 2 drones at any time, m
+    double stabilize;         // The controller's deadline offset, every leg allows this much on top of the flight, s
+  };
+
+  inline bool operator==(const PlannerParams &a, const PlannerParams &b)
+  {
+    return a.arena_x == b.arena_x && a.arena_y == b.arena_y && a.arena_z == b.arena_z &&
+           a.max_speed == b.max_speed && a.min_separation == b.min_separation && a.stabilize == b.stabilize;
+  }
+
+//=============================================================================
+// PlannerInterface
+//
+// Plans for the whole flock, and incremental replans for a single drone that falls behind.
+// A planner is created for a set of landing poses, and is reused for every mission that starts from them.
+//
+// Plans are checked for separation with a CollisionIndex. The planner describes the motion between waypoints
+// as straight line segments, the default is one segment per leg.
+//=============================================================================
+
+  class PlannerInterface
+  {
+  protected:
+    std::string error_;
+
+    // Waypoint 0 is this long after the plan is created, includes time to send the plan, takeoff and settle
+    rclcpp::Duration takeoff_{9000000000};
+
+  public:
+
+    virtual ~PlannerInterface() = default;
+
+    // One plan per drone, or an empty vector on failure, see error()
+    virtual std::vector<nav_msgs::msg::Path> plans(const rclcpp::Time &now) = 0;
+
+    // Same as plans(), but writes into plans, reusing the paths left over from the last mission
+    virtual void fill_plans(const rclcpp::Time &now, std::vector<nav_msgs::msg::Path> &plans)
+    { plans = this->plans(now); }
+
+    // How far the drone is behind its plan at time t, in meters
+    virtual double lag(const nav_msgs::msg::Path &plan, const geometry_msgs::msg::Pose &pose,
+                       const rclcpp::Time &t) const = 0;
+
+    // Recompute the rest of one drone's plan starting at its current pose
+    // The waypoints the drone should have already reached are dropped
+    // Returns false if the plan is complete or can't be recomputed, see error()
+    virtual bool replan(const nav_msgs::msg::Path &plan, const geometry_msgs::msg::Pose &pose,
+                        const rclcpp::Time &now, nav_msgs::msg::Path &result) = 0;
+
+    // The motion along a plan, as straight line segments
+    virtual void segments(int drone, const nav_msgs::msg::Path &plan,
+                          std::vector<collision_index::Segment> &segments) const;
+
+    // Add a plan to the index without checking it
+    void insert(collision_index::CollisionIndex &index, int drone, const nav_msgs::msg::Path &plan) const;
+
+    // Delay the plan until it's clear of the plans already in the index, then add it
+    // Returns false if the plan would need to be delayed by more than max_delay, see error()
+    bool insert_clear(collision_index::CollisionIndex &index, int drone, nav_msgs::msg::Path &plan,
+                      const rclcpp::Duration &max_delay, rclcpp::Duration &delay);
+
+    const std::string &error() const
+    { return error_; }
+
+    void set_takeoff(const rclcpp::Duration &takeoff)
+    { takeoff_ = takeoff; }
+
+    // Index of the first waypoint after t, or plan.poses.size() if there are none
+    static size_t next_waypoint(const nav_msgs::msg::Path &plan, const rclcpp::Time &t)
+    {
+      size_t i = 0;
+      while (i < plan.poses.size() && rclcpp::Time(plan.poses[i].header.stamp).nanoseconds() <= t.nanoseconds()) {
+        i++;
+      }
+      return i;
+    }
+  };
+
+} // namespace planner_node
+
+#endif // PLANNER_INTERFACE_H
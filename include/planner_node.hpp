@@ -5,8 +5,12 @@
 #include "nav_msgs/msg/odometry.hpp"
 #include "nav_msgs/msg/path.hpp"
 #include "std_msgs/msg/empty.hpp"
+#include "std_msgs/msg/header.hpp"
+#include "flock2/msg/compact_plan.hpp"
 
 #include "ros2_shared/context_macros.hpp"
+#include "planner_interface.hpp"
+#include "running_stats.hpp"
 
 namespace planner_node
 {
@@ -23,18 +27,33 @@ namespace planner_node
     bool valid_landing_pose_;
     geometry_msgs::msg::PoseStamped landing_pose_;
 
-    // At the moment, odometry is only used to capture the landing pad location
-    // In the future the plan might be updated based on current drone locations
+    // Odometry captures the landing pad location, and tells us if the drone is falling behind its plan
     rclcpp::Subscription<nav_msgs::msg::Odometry>::SharedPtr odom_sub_;
+    bool valid_pose_;
+    geometry_msgs::msg::Pose pose_;
 
-    // Publish a plan at 1Hz
+    // The last plan sent to the drone, published as a Path or as a CompactPlan
     rclcpp::Publisher<nav_msgs::msg::Path>::SharedPtr plan_pub_;
+    rclcpp::Publisher<flock2::msg::CompactPlan>::SharedPtr compact_plan_pub_;
+    nav_msgs::msg::Path plan_;
+
+    // Streaming: send stream_window_ waypoints at a time, keep stream_lookahead_ns_ of the plan ahead of the clock
+    rclcpp::Clock::SharedPtr clock_;
+    size_t stream_window_;
+    int64_t stream_lookahead_ns_;
+    size_t next_index_{};
+
+    // Time from the start of the mission until the drone is airborne, learned across missions
+    rclcpp::Time takeoff_start_;
+    drone_base::RunningStats takeoff_stats_;
 
     void odom_callback(const nav_msgs::msg::Odometry::SharedPtr msg);
 
   public:
 
-    explicit DroneInfo(rclcpp::Node *node, std::string ns);
+    // stream_window 0 sends each plan in one message
+    explicit DroneInfo(rclcpp::Node *node, std::string ns, const rclcpp::QoS &odom_qos, bool compact_plans,
+                       size_t stream_window, double stream_lookahead_sec);
 
     ~DroneInfo()
     {};
@@ -48,8 +67,42 @@ namespace planner_node
     const geometry_msgs::msg::PoseStamped &landing_pose() const
     { return landing_pose_; }
 
-    const rclcpp::Publisher<nav_msgs::msg::Path>::SharedPtr plan_pub() const
-    { return plan_pub_; }
+    bool valid_pose() const
+    { return valid_pose_; }
+
+    const geometry_msgs::msg::Pose &pose() const
+    { return pose_; }
+
+    const nav_msgs::msg::Path &plan() const
+    { return plan_; }
+
+    // Keep the plan for replanning, and publish it (or the compact version)
+    void publish_plan(nav_msgs::msg::Path &&plan);
+
+    // Move the plan out, so the planner can write the next plan into its storage. The drone has no plan
+    // until the next publish_plan, so only take a plan the drone is done with, see PlannerNode::plans_
+    nav_msgs::msg::Path take_plan()
+    {
+      nav_msgs::msg::Path plan = std::move(plan_);
+      clear_plan();
+      return plan;
+    }
+
+    void clear_plan()
+    {
+      plan_.poses.clear();
+      next_index_ = 0;
+    }
+
+    // Streaming: send the next windows if the drone is about to run out of waypoints
+    void stream_plan();
+
+    // Time the takeoff, odom_callback stops the clock
+    void start_takeoff_timer(const rclcpp::Time &t)
+    { takeoff_start_ = t; }
+
+    const drone_base::RunningStats &takeoff_stats() const
+    { return takeoff_stats_; }
   };
 
 //=============================================================================
@@ -69,6 +122,54 @@ namespace planner_node
   CXT_MACRO_MEMBER(               /*  */ \
   drones, \
   std::vector<std::string>, "solo") \
+  CXT_MACRO_MEMBER(               /* simple or spline */ \
+  planner, \
+  std::string, "simple") \
+  CXT_MACRO_MEMBER(               /* 1: recompute the plan for a drone that falls behind */ \
+  replan, \
+  int, 0) \
+  CXT_MACRO_MEMBER(               /* Replan if a drone is this far behind its plan, m */ \
+  replan_lag, \
+  double, 0.5) \
+  CXT_MACRO_MEMBER(               /* Spline planner: peak speed, m/s */ \
+  max_speed, \
+  double, 0.3) \
+  CXT_MACRO_MEMBER(               /* Added to every leg for the controller's deadline offset, e.g., basic's stabilize_time_sec, s */ \
+  stabilize_time_sec, \
+  double, 5.0) \
+  CXT_MACRO_MEMBER(               /* Minimum distance between drones, m */ \
+  min_separation, \
+  double, 0.4) \
+  CXT_MACRO_MEMBER(               /* Delay a plan by up to this much to keep clear of other plans, s */ \
+  max_delay_sec, \
+  double, 10.0) \
+  CXT_MACRO_MEMBER(               /* 1: plan when flock_base publishes /flock_airborne, not at /start_mission */ \
+  flock_takeoff, \
+  int, 0) \
+  CXT_MACRO_MEMBER(               /* With flock_takeoff, waypoint 0 is this long after the flock is airborne, s */ \
+  airborne_buffer_sec, \
+  double, 1.0) \
+  CXT_MACRO_MEMBER(               /* 1: size the takeoff buffer from measured takeoff times */ \
+  adaptive_timing, \
+  int, 0) \
+  CXT_MACRO_MEMBER(               /* Learned buffers are mean + timing_sigmas * stddev */ \
+  timing_sigmas, \
+  double, 3.0) \
+  CXT_MACRO_MEMBER(               /* With adaptive_timing, time from airborne to waypoint 0, covers stabilize, s */ \
+  takeoff_margin_sec, \
+  double, 5.0) \
+  CXT_MACRO_MEMBER(               /* odom subscriptions, best_effort or reliable, keep last 1 */ \
+  sensor_qos, \
+  std::string, "best_effort") \
+  CXT_MACRO_MEMBER(               /* 1: publish flock2/CompactPlan on compact_plan instead of nav_msgs/Path on plan */ \
+  compact_plans, \
+  int, 0) \
+  CXT_MACRO_MEMBER(               /* Stream plans as compact windows of this many waypoints, 0 to send whole plans */ \
+  stream_window, \
+  int, 0) \
+  CXT_MACRO_MEMBER(               /* Streaming: keep this much of the plan ahead of the clock on each drone, s */ \
+  stream_lookahead_sec, \
+  double, 10.0) \
   /* End of list */
 
   struct PlannerNodeContext
@@ -92,10 +193,31 @@ namespace planner_node
     // Global subscriptions
     rclcpp::Subscription<std_msgs::msg::Empty>::SharedPtr start_mission_sub_;
     rclcpp::Subscription<std_msgs::msg::Empty>::SharedPtr stop_mission_sub_;
+    rclcpp::Subscription<std_msgs::msg::Header>::SharedPtr flock_airborne_sub_;
+
+    // With flock_takeoff, the mission started and we're waiting for /flock_airborne
+    bool waiting_for_airborne_{false};
+
+    // Created at the start of a mission, and reused by later missions with the same inputs
+    std::unique_ptr<PlannerInterface> planner_;
+    std::string planner_name_;
+    PlannerParams planner_params_{};
+    std::vector<geometry_msgs::msg::PoseStamped> landing_poses_;
+
+    // Plans being built, the paths are taken from the drones and handed back when published, so each plan is
+    // stored once and a repeat mission doesn't allocate. Only empty paths are taken (stop_mission clears them and
+    // keeps the storage): a drone that is still flying keeps its plan until the new plans are accepted
+    std::vector<nav_msgs::msg::Path> plans_;
+
+    // Check for drones that are falling behind at 1Hz
+    rclcpp::TimerBase::SharedPtr replan_timer_;
+
+    // Send plan windows at SPIN_RATE, only if stream_window > 0
+    rclcpp::TimerBase::SharedPtr stream_timer_;
 
   public:
 
-    explicit PlannerNode();
+    explicit PlannerNode(const rclcpp::NodeOptions &options = rclcpp::NodeOptions());
 
     ~PlannerNode()
     {}
@@ -106,7 +228,21 @@ namespace planner_node
 
     void stop_mission_callback(const std_msgs::msg::Empty::SharedPtr msg);
 
-    void create_and_publish_plans();
+    void flock_airborne_callback(const std_msgs::msg::Header::SharedPtr msg);
+
+    // Waypoint 0 is at start + takeoff
+    void create_and_publish_plans(const rclcpp::Time &start, const rclcpp::Duration &takeoff);
+
+    // Create a planner, unless the one from the last mission has the same planner, params and landing poses
+    void update_planner();
+
+    void replan_timer_callback();
+
+    // Time from the start of the mission to waypoint 0
+    rclcpp::Duration takeoff_buffer() const;
+
+    rclcpp::Duration max_delay() const
+    { return rclcpp::Duration(static_cast<int64_t>(RCL_S_TO_NS(cxt_.max_delay_sec_))); }
 
     void validate_parameters();
   };
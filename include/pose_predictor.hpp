@@ -0,0 +1,119 @@
+#ifndef POSE_PREDICTOR_H
+#define POSE_PREDICTOR_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "drone_pose.hpp"
+
+namespace drone_base
+{
+
+//=============================================================================
+// Predict the pose at "now" from a late odometry message and the cmd_vel sent since
+//
+// Visual odometry arrives late and irregularly. The poses are predicted forward from the odom stamp by
+// integrating the commanded velocities over the lag. cmd_vel is in the body frame, scaled to [-1, 1],
+// so the predictor needs the speed at full stick. Fixed size history, never allocates.
+//
+// If another node sends the commands (e.g., flock_controller), the velocity measured between two odometry
+// messages stands in for the command, so the pose is predicted at the last measured velocity.
+//=============================================================================
+
+  class PosePredictor
+  {
+  public:
+
+    // About 2s of cmd_vel at 30Hz
+    static constexpr size_t HISTORY = 64;
+
+  private:
+
+    struct Command
+    {
+      int64_t t_ns;
+      double throttle, strafe, vertical, yaw;
+    };
+
+    std::array<Command, HISTORY> commands_{};
+    size_t next_{};                     // Slot for the next command
+    size_t count_{};
+
+    double xy_speed_{1.0};              // m/s at full stick
+    double z_speed_{1.0};               // m/s at full stick
+    double yaw_rate_{1.7};              // rad/s at full stick
+    int64_t max_predict_ns_{500000000};
+
+    // Oldest first
+    const Command &command(size_t i) const
+    { return commands_[(next_ + HISTORY - count_ + i) % HISTORY]; }
+
+  public:
+
+    void set_model(double xy_speed, double z_speed, double yaw_rate, double max_predict_sec)
+    {
+      xy_speed_ = xy_speed;
+      z_speed_ = z_speed;
+      yaw_rate_ = yaw_rate;
+      max_predict_ns_ = static_cast<int64_t>(RCL_S_TO_NS(max_predict_sec));
+    }
+
+    // Commands must arrive in time order
+    void add_command(int64_t t_ns, double throttle, double strafe, double vertical, double yaw)
+    {
+      commands_[next_] = Command{t_ns, throttle, strafe, vertical, yaw};
+      next_ = (next_ + 1) % HISTORY;
+      count_ = count_ < HISTORY ? count_ + 1 : HISTORY;
+    }
+
+    // The velocity from pose "from" to pose "to", as a command starting at to_ns
+    void add_measured(int64_t from_ns, const DronePose &from, int64_t to_ns, const DronePose &to)
+    {
+      if (to_ns <= from_ns) {
+        return;
+      }
+
+      // World frame to body frame, at the latest heading
+      double dt = static_cast<double>(to_ns - from_ns) / 1e9;
+      double throttle, strafe;
+      PoseUtil::rotate_frame((to.x - from.x) / dt, (to.y - from.y) / dt, to.yaw, throttle, strafe);
+      add_command(to_ns, throttle / xy_speed_, strafe / xy_speed_, (to.z - from.z) / dt / z_speed_,
+                  PoseUtil::norm_angle(to.yaw - from.yaw) / dt / yaw_rate_);
+    }
+
+    void clear()
+    { count_ = 0; }
+
+    // Pose at t_ns, given the pose at pose_ns. Predicts at most max_predict_sec ahead; before the first
+    // command, or with no commands at all, the drone is assumed to hold still
+    DronePose predict(const DronePose &pose, int64_t pose_ns, int64_t t_ns) const
+    {
+      DronePose p = pose;
+      int64_t end_ns = std::min(t_ns, pose_ns + max_predict_ns_);
+
+      for (size_t i = 0; i < count_; i++) {
+        const Command &c = command(i);
+        int64_t from_ns = std::max(c.t_ns, pose_ns);
+        int64_t to_ns = i + 1 < count_ ? std::min(command(i + 1).t_ns, end_ns) : end_ns;
+        if (to_ns <= from_ns) {
+          continue;
+        }
+
+        // Body frame to world frame, at the heading the command started with
+        double dt = static_cast<double>(to_ns - from_ns) / 1e9;
+        double vx, vy;
+        PoseUtil::rotate_frame(c.throttle, c.strafe, -p.yaw, vx, vy);
+        p.x += vx * xy_speed_ * dt;
+        p.y += vy * xy_speed_ * dt;
+        p.z += c.vertical * z_speed_ * dt;
+        p.yaw = PoseUtil::norm_angle(p.yaw + c.yaw * yaw_rate_ * dt);
+      }
+
+      return p;
+    }
+  };
+
+} // namespace drone_base
+
+#endif // POSE_PREDICTOR_H
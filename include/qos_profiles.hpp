@@ -0,0 +1,69 @@
+#ifndef QOS_PROFILES_H
+#define QOS_PROFILES_H
+
+#include "rclcpp/rclcpp.hpp"
+
+namespace drone_base
+{
+
+//=============================================================================
+// QoS profiles for each kind of stream
+//
+// Odometry, flight data and cmd_vel keep only the latest message. Over Wi-Fi a retransmitted odom or cmd_vel
+// message is stale by the time it arrives, so best effort is the right choice where the other end allows it.
+// A best effort subscription matches any publisher, but a best effort publisher only matches best effort
+// subscriptions, so cmd_vel (read by tello_driver) is reliable unless configured otherwise.
+//
+// Plans are reliable and transient local, so a node that starts late still gets the latest plan.
+// A streamed plan can send several windows at once, so the windows keep PLAN_STREAM_DEPTH messages.
+// Intra-process communication doesn't support transient local, so plans always go through the middleware.
+//=============================================================================
+
+  inline bool valid_reliability(const std::string &reliability)
+  {
+    return reliability == "best_effort" || reliability == "reliable";
+  }
+
+  // Keep last 1, reliability is "best_effort" or "reliable"
+  inline rclcpp::QoS stream_qos(const std::string &reliability)
+  {
+    rclcpp::QoS qos{rclcpp::KeepLast(1)};
+    if (reliability == "best_effort") {
+      qos.best_effort();
+    } else {
+      qos.reliable();
+    }
+    return qos;
+  }
+
+  inline rclcpp::QoS plan_qos()
+  {
+    return rclcpp::QoS{rclcpp::KeepLast(1)}.reliable().transient_local();
+  }
+
+  // The most windows a streamed plan sends at once
+  constexpr size_t PLAN_STREAM_DEPTH = 16;
+
+  // Streamed plan windows, also fine for subscribing to whole plans on the same topic
+  inline rclcpp::QoS plan_stream_qos()
+  {
+    return rclcpp::QoS{rclcpp::KeepLast(PLAN_STREAM_DEPTH)}.reliable().transient_local();
+  }
+
+  // Low rate state that a late subscriber needs (e.g., drone state), use with plan_options too
+  inline rclcpp::QoS latched_qos()
+  {
+    return plan_qos();
+  }
+
+  // Works for rclcpp::PublisherOptions and rclcpp::SubscriptionOptions
+  template<typename OptionsT>
+  OptionsT plan_options(OptionsT options = OptionsT())
+  {
+    options.use_intra_process_comm = rclcpp::IntraProcessSetting::Disable;
+    return options;
+  }
+
+} // namespace drone_base
+
+#endif // QOS_PROFILES_H
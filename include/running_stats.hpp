@@ -0,0 +1,69 @@
+#ifndef RUNNING_STATS_H
+#define RUNNING_STATS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace drone_base
+{
+
+//=============================================================================
+// Running mean and standard deviation (Welford), O(1) per sample, never allocates
+//
+// Used to replace worst-case time buffers with measured ones: bound() is mean + sigmas * stddev,
+// or the fallback until there are enough samples to trust.
+//=============================================================================
+
+  class RunningStats
+  {
+    uint64_t count_{0};
+    double mean_{0};
+    double m2_{0};
+    double max_{0};
+
+  public:
+
+    static constexpr uint64_t MIN_SAMPLES = 3;
+
+    void add(double x)
+    {
+      count_++;
+      double delta = x - mean_;
+      mean_ += delta / static_cast<double>(count_);
+      m2_ += delta * (x - mean_);
+      max_ = count_ == 1 ? x : std::max(max_, x);
+    }
+
+    void reset()
+    { *this = RunningStats{}; }
+
+    uint64_t count() const
+    { return count_; }
+
+    double mean() const
+    { return mean_; }
+
+    double stddev() const
+    { return count_ > 1 ? std::sqrt(m2_ / static_cast<double>(count_ - 1)) : 0; }
+
+    double max() const
+    { return max_; }
+
+    double bound(double sigmas, double fallback) const
+    { return count_ < MIN_SAMPLES ? fallback : mean_ + sigmas * stddev(); }
+  };
+
+//=============================================================================
+// Per-drone timing, owned by drone_base so it outlives the flight controllers, all times in seconds
+//=============================================================================
+
+  struct TimingStats
+  {
+    RunningStats settle;      // From a waypoint deadline to close_enough
+    RunningStats odom_lag;    // From the odom stamp to the odom callback
+  };
+
+} // namespace drone_base
+
+#endif // RUNNING_STATS_H
@@ -6,22 +6,57 @@
 #include "nav_msgs/msg/path.hpp"
 #include "std_msgs/msg/empty.hpp"
 
+#include "planner_interface.hpp"
+
 namespace simple_planner
 {
 
-  class SimplePlanner
+//=============================================================================
+// SimplePlanner
+//
+// Every drone flies the same ring of waypoints, starting and ending at its own. The ring and the time to
+// fly it are computed once; a drone's plan is the ring rotated to start at the drone's waypoint, so
+// plans() is a copy of the ring per drone and a few integer adds per waypoint.
+//=============================================================================
+
+  class SimplePlanner : public planner_node::PlannerInterface
   {
     int num_drones_;
     std::vector<geometry_msgs::msg::PoseStamped> waypoints_;
 
+    // ring_ns_[i] is the time from waypoint 0 to waypoint i, ring_ns_[waypoints_.size()] is one lap
+    std::vector<int64_t> ring_ns_;
+
+    // Added to every leg, the controller must reach each waypoint this long before its timestamp
+    int64_t stabilize_ns_;
+
+    // Time to fly from p1 to p2 at SPEED, plus stabilize_ns_
+    int64_t leg_ns(const geometry_msgs::msg::Point &p1, const geometry_msgs::msg::Point &p2) const;
+
   public:
 
-    explicit SimplePlanner(const std::vector<geometry_msgs::msg::PoseStamped> &landing_poses);
+    explicit SimplePlanner(const std::vector<geometry_msgs::msg::PoseStamped> &landing_poses,
+                           double stabilize_sec = 0);
 
     ~SimplePlanner()
     {}
 
-    std::vector<nav_msgs::msg::Path> plans(const rclcpp::Time &now) const;
+    std::vector<nav_msgs::msg::Path> plans(const rclcpp::Time &now) override;
+
+    void fill_plans(const rclcpp::Time &now, std::vector<nav_msgs::msg::Path> &plans) override;
+
+    // One drone's plan, waypoint 0 at waypoint0_ns. Doesn't allocate if path has room for the ring
+    void fill_plan(int drone, int64_t waypoint0_ns, nav_msgs::msg::Path &path) const;
+
+    double lag(const nav_msgs::msg::Path &plan, const geometry_msgs::msg::Pose &pose,
+               const rclcpp::Time &t) const override;
+
+    bool replan(const nav_msgs::msg::Path &plan, const geometry_msgs::msg::Pose &pose,
+                const rclcpp::Time &now, nav_msgs::msg::Path &result) override;
+
+    // The ring of waypoints, there are at least as many waypoints as drones
+    const std::vector<geometry_msgs::msg::PoseStamped> &waypoints() const
+    { return waypoints_; }
   };
 
 } // namespace simple_planner
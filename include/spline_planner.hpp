@@ -0,0 +1,51 @@
+#ifndef SPLINE_PLANNER_H
+#define SPLINE_PLANNER_H
+
+#include "rclcpp/rclcpp.hpp"
+#include "nav_msgs/msg/path.hpp"
+
+#include "planner_interface.hpp"
+
+namespace spline_planner
+{
+
+  class SplinePlanner : public planner_node::PlannerInterface
+  {
+    int num_drones_;
+    planner_node::PlannerParams params_;
+    std::vector<geometry_msgs::msg::PoseStamped> waypoints_;
+
+    // Leg j of every plan takes leg_times_[j] seconds, so all drones reach their waypoints together
+    std::vector<double> leg_times_;
+
+    // Seconds to fly from p1 to p2, starting and ending at rest, plus params_.stabilize
+    double leg_time(const geometry_msgs::msg::Point &p1, const geometry_msgs::msg::Point &p2) const;
+
+    // Return an error message if the trajectory leaves the arena
+    std::string check_bounds(const nav_msgs::msg::Path &path) const;
+
+  public:
+
+    SplinePlanner(const std::vector<geometry_msgs::msg::PoseStamped> &landing_poses,
+                  const planner_node::PlannerParams &params);
+
+    ~SplinePlanner()
+    {}
+
+    // Returns an empty vector if the trajectories leave the arena, see error()
+    std::vector<nav_msgs::msg::Path> plans(const rclcpp::Time &now) override;
+
+    double lag(const nav_msgs::msg::Path &plan, const geometry_msgs::msg::Pose &pose,
+               const rclcpp::Time &t) const override;
+
+    bool replan(const nav_msgs::msg::Path &plan, const geometry_msgs::msg::Pose &pose,
+                const rclcpp::Time &now, nav_msgs::msg::Path &result) override;
+
+    // The spline sampled every SAMPLE_DT
+    void segments(int drone, const nav_msgs::msg::Path &plan,
+                  std::vector<collision_index::Segment> &segments) const override;
+  };
+
+} // namespace spline_planner
+
+#endif // SPLINE_PLANNER_H
@@ -0,0 +1,111 @@
+#ifndef TELEMETRY_RECORDER_H
+#define TELEMETRY_RECORDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace drone_base
+{
+
+//=============================================================================
+// Telemetry file format, all values little endian
+//
+//    TelemetryHeader
+//    TelemetryRecord * n
+//
+// decode_telemetry.py reads this format, keep them in sync.
+//=============================================================================
+
+  constexpr char TELEMETRY_MAGIC[8] = {'F', 'L', 'K', 'T', 'L', 'M', '0', '1'};
+  constexpr uint32_t TELEMETRY_VERSION = 1;
+
+  struct TelemetryHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+  };
+
+  // One record per control tick
+  struct TelemetryRecord
+  {
+    int64_t t_ns;           // Odom message stamp
+    int32_t target;         // Index of the target waypoint
+    float dt;               // Seconds since the previous odom message
+    float target_pose[4];   // x, y, z, yaw
+    float actual_pose[4];   // x, y, z, yaw
+    float command[4];       // throttle, strafe, vertical, yaw
+  };
+
+  static_assert(sizeof(TelemetryHeader) == 16, "telemetry header layout changed");
+  static_assert(sizeof(TelemetryRecord) == 64, "telemetry record layout changed");
+
+//=============================================================================
+// TelemetryRecorder
+//
+// The control loop copies fixed-size records into a preallocated single-producer, single-consumer ring.
+// A background thread moves them to a memory-mapped file, growing the file in large chunks.
+// record() never blocks, never allocates and never makes a system call. If the background thread
+// falls behind the ring fills up and new records are dropped, see dropped().
+//=============================================================================
+
+  class TelemetryRecorder
+  {
+    static constexpr size_t RING_SIZE = 8192;         // Records, power of 2
+    static constexpr size_t CHUNK_SIZE = 1 << 20;     // Bytes, the file grows by this much
+
+    std::vector<TelemetryRecord> ring_;
+    std::atomic<uint64_t> head_{0};                   // Written by record()
+    std::atomic<uint64_t> tail_{0};                   // Written by the background thread
+    std::atomic<uint64_t> dropped_{0};
+
+    int fd_{-1};
+    char *map_{nullptr};
+    size_t map_size_{0};
+    size_t file_size_{0};                             // Bytes written so far
+
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+
+    bool grow(size_t min_size);
+
+    void flush();
+
+    void run();
+
+  public:
+
+    // Opens and truncates the file, check is_open()
+    explicit TelemetryRecorder(const std::string &path);
+
+    ~TelemetryRecorder();
+
+    TelemetryRecorder(const TelemetryRecorder &) = delete;
+
+    TelemetryRecorder &operator=(const TelemetryRecorder &) = delete;
+
+    bool is_open() const
+    { return map_ != nullptr; }
+
+    // Call from one thread only
+    void record(const TelemetryRecord &record)
+    {
+      uint64_t head = head_.load(std::memory_order_relaxed);
+      if (head - tail_.load(std::memory_order_acquire) >= RING_SIZE) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      ring_[head & (RING_SIZE - 1)] = record;
+      head_.store(head + 1, std::memory_order_release);
+    }
+
+    uint64_t dropped() const
+    { return dropped_.load(std::memory_order_relaxed); }
+  };
+
+} // namespace drone_base
+
+#endif // TELEMETRY_RECORDER_H
@@ -0,0 +1,88 @@
+import os
+
+from ament_index_python.packages import get_package_share_directory
+from launch import LaunchDescription
+from launch_ros.actions import ComposableNodeContainer, Node
+from launch_ros.descriptions import ComposableNode
+from launch.actions import ExecuteProcess
+
+# Launch a flock of drones, with flock_base, planner_node and all drone_base nodes loaded into a single process.
+# Messages between the composed nodes use intra-process communication and are not serialized.
+
+
+def generate_launch_description():
+    drones = ['drone1', 'drone2']
+
+    driver_params = [
+        {
+            'drone_ip': '192.168.86.206',
+            'command_port': '11001',
+            'drone_port': '12001',
+            'data_port': '13001',
+            'video_port': '14001'
+        },
+        {
+            'drone_ip': '192.168.86.212',
+            'command_port': '11002',
+            'drone_port': '12002',
+            'data_port': '13002',
+            'video_port': '14002'
+        },
+    ]
+
+    intra_process = [{'use_intra_process_comms': True}]
+
+    # Global nodes
+    composed_nodes = [
+        # Flock controller
+        ComposableNode(package='flock2', node_plugin='flock_base::FlockBase', node_name='flock_base',
+                       parameters=[{'drones': drones}], extra_arguments=intra_process),
+
+        # Planner
+        ComposableNode(package='flock2', node_plugin='planner_node::PlannerNode', node_name='planner_node',
+                       parameters=[{'drones': drones}], extra_arguments=intra_process),
+    ]
+
+    entities = [
+        # Rviz
+        ExecuteProcess(cmd=['rviz2', '-d', 'install/flock2/share/flock2/launch/two.rviz'], output='screen'),
+
+        # Joystick
+        Node(package='joy', node_executable='joy_node', output='screen'),
+
+        # Mapper
+        Node(package='fiducial_vlam', node_executable='vmap_node', output='screen'),
+    ]
+
+    # Per-drone nodes
+    for idx, namespace in enumerate(drones):
+        suffix = str(idx + 1)
+        urdf = os.path.join(get_package_share_directory('tello_description'), 'urdf', 'drone_' + suffix + '.urdf')
+
+        # Drone controller, there is no polling loop inside a container so run in event-driven mode
+        composed_nodes.append(
+            ComposableNode(package='flock2', node_plugin='drone_base::DroneBase', node_name='base' + suffix,
+                           node_namespace=namespace, parameters=[{'event_driven': 1}],
+                           extra_arguments=intra_process))
+
+        entities.extend([
+            # Publish static transforms
+            Node(package='robot_state_publisher', node_executable='robot_state_publisher', output='screen',
+                 arguments=[urdf]),
+
+            # Driver
+            Node(package='tello_driver', node_executable='tello_driver_main', output='screen',
+                 node_name='driver' + suffix, node_namespace=namespace, parameters=[driver_params[idx]]),
+
+            # Visual localizer
+            Node(package='fiducial_vlam', node_executable='vloc_node', output='screen',
+                 node_name='vloc' + suffix, node_namespace=namespace),
+        ])
+
+    # All flock2 nodes in one process
+    entities.append(
+        ComposableNodeContainer(node_name='flock_container', node_namespace='', package='rclcpp_components',
+                                node_executable='component_container', output='screen',
+                                composable_node_descriptions=composed_nodes))
+
+    return LaunchDescription(entities)
@@ -0,0 +1,43 @@
+from launch import LaunchDescription
+from launch_ros.actions import ComposableNodeContainer, Node
+from launch_ros.descriptions import ComposableNode
+
+# Launch a simulated flock: flock_sim stands in for gazebo, tello_driver and vloc_node.
+# All flock2 nodes run in one process, only the simulator runs outside the container.
+# Change num_drones to see where the flock stops scaling.
+
+
+def generate_launch_description():
+    num_drones = 10
+    drones = ['drone' + str(idx + 1) for idx in range(num_drones)]
+
+    intra_process = [{'use_intra_process_comms': True}]
+
+    composed_nodes = [
+        ComposableNode(package='flock2', node_plugin='flock_base::FlockBase', node_name='flock_base',
+                       parameters=[{'drones': drones}], extra_arguments=intra_process),
+
+        ComposableNode(package='flock2', node_plugin='planner_node::PlannerNode', node_name='planner_node',
+                       parameters=[{'drones': drones, 'arena_x': 10., 'arena_y': 10.}],
+                       extra_arguments=intra_process),
+    ]
+
+    for idx, namespace in enumerate(drones):
+        composed_nodes.append(
+            ComposableNode(package='flock2', node_plugin='drone_base::DroneBase', node_name='base' + str(idx + 1),
+                           node_namespace=namespace, parameters=[{'event_driven': 1}],
+                           extra_arguments=intra_process))
+
+    return LaunchDescription([
+        # Joystick
+        Node(package='joy', node_executable='joy_node', output='screen'),
+
+        # Simulator
+        Node(package='flock2', node_executable='flock_sim', output='screen',
+             parameters=[{'drones': drones}]),
+
+        # All flock2 nodes in one process
+        ComposableNodeContainer(node_name='flock_container', node_namespace='', package='rclcpp_components',
+                                node_executable='component_container', output='screen',
+                                composable_node_descriptions=composed_nodes),
+    ])
@@ -1,77 +1,188 @@
 #include "action_mgr.hpp"
 
-// Future: time out if tello_driver hasn't responded in ~10s, this can happen if tello_driver was restarted
-
 namespace drone_base
 {
 
-  ActionMgr::State ActionMgr::send(Action action, std::string action_str)
+  bool ActionMgr::send(Action action, std::string action_str, double timeout_sec, Callback callback, bool preempt)
   {
-    action_ = action;
-    action_str_ = action_str;
+    // Sending the same action twice is almost always a double click
+    for (auto &a : pending()) {
+      if (a == action) {
+        RCLCPP_INFO(logger_, "%s already pending, dropping", action_str.c_str());
+        return false;
+      }
+    }
+
+    Request request{action, std::move(action_str), static_cast<int64_t>(RCL_S_TO_NS(timeout_sec)),
+                    std::move(callback)};
+
+    if (preempt) {
+      // The active action can't be cancelled on a Tello, so the preempting action runs next
+      std::deque<Request> dropped;
+      dropped.swap(queue_);
+      queue_.push_front(std::move(request));
+      for (auto &r : dropped) {
+        RCLCPP_INFO(logger_, "%s preempted by %s", r.action_str.c_str(), queue_.front().action_str.c_str());
+        if (r.callback) {
+          r.callback(r.action, State::failed, "preempted");
+        }
+      }
+    } else if (queue_.size() < MAX_QUEUE) {
+      queue_.push_back(std::move(request));
+    } else {
+      RCLCPP_ERROR(logger_, "action queue is full, dropping %s", request.action_str.c_str());
+      return false;
+    }
 
-    RCLCPP_DEBUG(logger_, "send %s to tello_driver", action_str.c_str());
+    if (!busy()) {
+      send_next();
+    }
+    return true;
+  }
+
+  void ActionMgr::send_next()
+  {
+    // spin_once sends it after the guard interval
+    if (queue_.empty() || clock_->now().nanoseconds() < guard_until_ns_) {
+      return;
+    }
+
+    active_ = std::move(queue_.front());
+    queue_.pop_front();
+
+    RCLCPP_DEBUG(logger_, "send %s to tello_driver", active_.action_str.c_str());
 
     auto request = std::make_shared<tello_msgs::srv::TelloAction::Request>();
-    request->cmd = action_str;
-    future_ = client_->async_send_request(request);
+    request->cmd = active_.action_str;
+    if (trace_) {
+      trace_->record(TraceEvent::action_sent);
+    }
 
-    state_ = ActionMgr::State::waiting_for_future;
-    return state_;
+    state_ = State::waiting_for_future;
+    deadline_ns_ = clock_->now().nanoseconds() + active_.timeout_ns;
+    uint64_t sequence = ++sequence_;
+
+    // The response arrives on an executor thread
+    client_->async_send_request(request,
+                                [this, sequence](rclcpp::Client<tello_msgs::srv::TelloAction>::SharedFuture future)
+                                {
+                                  std::lock_guard<std::mutex> lock(mutex_);
+                                  response_callback(sequence, future.get());
+                                });
   }
 
-  ActionMgr::State ActionMgr::spin_once()
+  void ActionMgr::response_callback(uint64_t sequence, tello_msgs::srv::TelloAction::Response::SharedPtr response)
   {
-    if (state_ == ActionMgr::State::waiting_for_future &&
-        future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+    // Drop the response if the action already timed out, or finished (the tello_response came first)
+    if (sequence != sequence_ || state_ != State::waiting_for_future) {
+      RCLCPP_DEBUG(logger_, "ignore stale response");
+      return;
+    }
 
-      // Get the initial response
-      tello_msgs::srv::TelloAction::Response::SharedPtr response = future_.get();
+    if (trace_) {
+      trace_->record(TraceEvent::action_accepted);
+    }
 
-      if (response->rc == response->OK) {
-        RCLCPP_DEBUG(logger_, "%s accepted", action_str_.c_str());
-        state_ = ActionMgr::State::waiting_for_response;
+    if (response->rc == response->OK) {
+      RCLCPP_DEBUG(logger_, "%s accepted", active_.action_str.c_str());
+      state_ = State::waiting_for_response;
 
-      } else if (response->rc == response->ERROR_BUSY) {
-        RCLCPP_ERROR(logger_, "%s failed, drone is busy", action_str_.c_str());
-        result_str_ = "drone is busy";
-        state_ = ActionMgr::State::failed;
+    } else if (response->rc == response->ERROR_BUSY) {
+      RCLCPP_ERROR(logger_, "%s failed, drone is busy", active_.action_str.c_str());
+      finish(State::failed, "drone is busy");
 
-      } else if (response->rc == response->ERROR_NOT_CONNECTED) {
-        RCLCPP_ERROR(logger_, "%s failed, lost connection", action_str_.c_str());
-        result_str_ = "lost connection";
-        state_ = ActionMgr::State::failed_lost_connection;
-      }
+    } else if (response->rc == response->ERROR_NOT_CONNECTED) {
+      RCLCPP_ERROR(logger_, "%s failed, lost connection", active_.action_str.c_str());
+      finish(State::failed_lost_connection, "lost connection");
     }
+  }
 
-    return state_;
+  void ActionMgr::spin_once()
+  {
+    if (busy() && clock_->now().nanoseconds() > deadline_ns_) {
+      RCLCPP_ERROR(logger_, "%s failed, no response in %g seconds", active_.action_str.c_str(),
+                   static_cast<double>(active_.timeout_ns) / 1e9);
+      guard_until_ns_ = clock_->now().nanoseconds() + GUARD_NS;
+      finish(State::failed_timeout, "timed out");
+    }
+
+    if (!busy()) {
+      send_next();
+    }
   }
 
-  ActionMgr::State ActionMgr::complete(tello_msgs::msg::TelloResponse::SharedPtr msg)
+  void ActionMgr::complete(tello_msgs::msg::TelloResponse::SharedPtr msg)
   {
     // The tello_response message may arrive before the future is ready -- that's OK
     if (!busy()) {
-      RCLCPP_ERROR(logger_, "unexpected response %s", msg->str.c_str());
-      result_str_ = "unexpected response";
-      state_ = ActionMgr::State::failed;
+      if (clock_->now().nanoseconds() < guard_until_ns_) {
+        RCLCPP_INFO(logger_, "ignore late response %s", msg->str.c_str());
+      } else {
+        RCLCPP_ERROR(logger_, "unexpected response %s", msg->str.c_str());
+      }
+      return;
+    }
 
-    } else if (msg->rc == msg->OK) {
-      RCLCPP_DEBUG(logger_, "%s succeeded with %s", action_str_.c_str(), msg->str.c_str());
-      result_str_ = msg->str;
-      state_ = ActionMgr::State::succeeded;
+    if (trace_) {
+      trace_->record(TraceEvent::action_complete);
+    }
+
+    if (msg->rc == msg->OK) {
+      RCLCPP_DEBUG(logger_, "%s succeeded with %s", active_.action_str.c_str(), msg->str.c_str());
+      finish(State::succeeded, msg->str);
 
     } else if (msg->rc == msg->ERROR) {
-      RCLCPP_ERROR(logger_, "%s failed with %s", action_str_.c_str(), msg->str.c_str());
-      result_str_ = msg->str;
-      state_ = ActionMgr::State::failed;
+      RCLCPP_ERROR(logger_, "%s failed with %s", active_.action_str.c_str(), msg->str.c_str());
+      finish(State::failed, msg->str);
 
     } else if (msg->rc == msg->TIMEOUT) {
-      RCLCPP_ERROR(logger_, "%s failed, drone timed out", msg->str.c_str());
-      result_str_ = "drone timed out";
-      state_ = ActionMgr::State::failed;
+      RCLCPP_ERROR(logger_, "%s failed, drone timed out", active_.action_str.c_str());
+      finish(State::failed, "drone timed out");
+    }
+  }
+
+  void ActionMgr::clear(const std::string &reason)
+  {
+    std::deque<Request> dropped;
+    dropped.swap(queue_);
+    for (auto &r : dropped) {
+      if (r.callback) {
+        r.callback(r.action, State::failed_lost_connection, reason);
+      }
     }
 
-    return state_;
+    if (busy()) {
+      finish(State::failed_lost_connection, reason);
+    }
+  }
+
+  void ActionMgr::finish(State state, const std::string &result)
+  {
+    state_ = state;
+    result_str_ = result;
+
+    // The callback may queue another action, so it isn't sent twice
+    Callback callback;
+    callback.swap(active_.callback);
+    if (callback) {
+      callback(active_.action, state_, result_str_);
+    }
+
+    if (!busy()) {
+      send_next();
+    }
+  }
+
+  std::vector<Action> ActionMgr::pending() const
+  {
+    std::vector<Action> actions;
+    if (state_ == State::waiting_for_future || state_ == State::waiting_for_response) {
+      actions.push_back(active_.action);
+    }
+    for (auto &r : queue_) {
+      actions.push_back(r.action);
+    }
+    return actions;
   }
 
-} // namespace drone_base
\ No newline at end of file
+} // namespace drone_base
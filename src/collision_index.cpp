@@ -0,0 +1,175 @@
+#include "collision_index.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace collision_index
+{
+
+//====================
+// Utilities
+//====================
+
+  // Position at time t, t must be in [t0, t1]
+  inline void position(const Segment &s, int64_t t_ns, double p[3])
+  {
+    double f = s.t1_ns > s.t0_ns ? static_cast<double>(t_ns - s.t0_ns) / (s.t1_ns - s.t0_ns) : 0;
+    for (int i = 0; i < 3; i++) {
+      p[i] = s.p0[i] + f * (s.p1[i] - s.p0[i]);
+    }
+  }
+
+  // Hash collisions only add candidate pairs, the distance check is exact
+  inline uint64_t cell_key(int64_t x, int64_t y, int64_t z, int64_t slot)
+  {
+    return static_cast<uint64_t>(x) * 73856093 ^ static_cast<uint64_t>(y) * 19349663 ^
+           static_cast<uint64_t>(z) * 83492791 ^ static_cast<uint64_t>(slot) * 25165843;
+  }
+
+//====================
+// CollisionIndex
+//====================
+
+  CollisionIndex::CollisionIndex(double min_separation, double slot_sec) :
+    min_separation_{min_separation},
+    cell_size_{std::max(min_separation, 0.1)},
+    slot_ns_{std::max(static_cast<int64_t>(slot_sec * 1e9), static_cast<int64_t>(1))}
+  {}
+
+  void CollisionIndex::clear()
+  {
+    pieces_.clear();
+    cells_.clear();
+    visited_.clear();
+  }
+
+  template<typename F>
+  void CollisionIndex::for_each_piece(const Segment &segment, F f) const
+  {
+    // Floor division, times may be negative
+    auto slot_of = [this](int64_t t) { return t >= 0 ? t / slot_ns_ : (t - slot_ns_ + 1) / slot_ns_; };
+
+    int64_t first = slot_of(segment.t0_ns);
+    int64_t last = slot_of(segment.t1_ns);
+
+    for (int64_t slot = first; slot <= last; slot++) {
+      Segment piece = segment;
+      piece.t0_ns = std::max(segment.t0_ns, slot * slot_ns_);
+      piece.t1_ns = std::min(segment.t1_ns, (slot + 1) * slot_ns_);
+      position(segment, piece.t0_ns, piece.p0);
+      position(segment, piece.t1_ns, piece.p1);
+      f(piece, slot);
+    }
+  }
+
+  template<typename F>
+  void CollisionIndex::for_each_cell(const Segment &piece, int64_t slot, F f) const
+  {
+    double margin = min_separation_ / 2;
+    int64_t lo[3], hi[3];
+    for (int i = 0; i < 3; i++) {
+      lo[i] = static_cast<int64_t>(floor((std::min(piece.p0[i], piece.p1[i]) - margin) / cell_size_));
+      hi[i] = static_cast<int64_t>(floor((std::max(piece.p0[i], piece.p1[i]) + margin) / cell_size_));
+    }
+
+    for (int64_t x = lo[0]; x <= hi[0]; x++) {
+      for (int64_t y = lo[1]; y <= hi[1]; y++) {
+        for (int64_t z = lo[2]; z <= hi[2]; z++) {
+          f(cell_key(x, y, z, slot));
+        }
+      }
+    }
+  }
+
+  void CollisionIndex::insert(const Segment &segment)
+  {
+    for_each_piece(segment, [this](const Segment &piece, int64_t slot)
+    {
+      int index = static_cast<int>(pieces_.size());
+      pieces_.push_back(piece);
+      visited_.push_back(0);
+      for_each_cell(piece, slot, [this, index](uint64_t key) { cells_[key].push_back(index); });
+    });
+  }
+
+  bool CollisionIndex::query(const Segment &segment, Conflict &conflict) const
+  {
+    bool found = false;
+    query_++;
+
+    for_each_piece(segment, [&](const Segment &piece, int64_t slot)
+    {
+      if (found) {
+        return;
+      }
+
+      for_each_cell(piece, slot, [&](uint64_t key)
+      {
+        if (found) {
+          return;
+        }
+
+        auto cell = cells_.find(key);
+        if (cell == cells_.end()) {
+          return;
+        }
+
+        for (int index : cell->second) {
+          const Segment &other = pieces_[index];
+          if (visited_[index] == query_ || other.drone == segment.drone) {
+            continue;
+          }
+          visited_[index] = query_;
+
+          double distance;
+          int64_t t_ns;
+          if (closest_approach(piece, other, distance, t_ns) && distance < min_separation_) {
+            conflict = Conflict{segment.drone, other.drone, t_ns, distance};
+            found = true;
+            return;
+          }
+        }
+      });
+    });
+
+    return found;
+  }
+
+  bool CollisionIndex::closest_approach(const Segment &a, const Segment &b, double &distance, int64_t &t_ns)
+  {
+    int64_t t0 = std::max(a.t0_ns, b.t0_ns);
+    int64_t t1 = std::min(a.t1_ns, b.t1_ns);
+    if (t0 > t1) {
+      return false;
+    }
+
+    // Relative position r(s) = r0 + s (r1 - r0), s in [0, 1]
+    double pa[3], pb[3], r0[3], dr[3];
+    position(a, t0, pa);
+    position(b, t0, pb);
+    for (int i = 0; i < 3; i++) {
+      r0[i] = pa[i] - pb[i];
+    }
+    position(a, t1, pa);
+    position(b, t1, pb);
+    for (int i = 0; i < 3; i++) {
+      dr[i] = pa[i] - pb[i] - r0[i];
+    }
+
+    double dr2 = dr[0] * dr[0] + dr[1] * dr[1] + dr[2] * dr[2];
+    double s = dr2 > 0 ? -(r0[0] * dr[0] + r0[1] * dr[1] + r0[2] * dr[2]) / dr2 : 0;
+    s = std::min(1., std::max(0., s));
+
+    double d2 = 0;
+    for (int i = 0; i < 3; i++) {
+      double d = r0[i] + s * dr[i];
+      d2 += d * d;
+    }
+
+    distance = sqrt(d2);
+    t_ns = t0 + static_cast<int64_t>(s * (t1 - t0));
+    return true;
+  }
+
+} // namespace collision_index
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+
+#include "rclcpp/rclcpp.hpp"
+
+#include "flight_controller_registry.hpp"
+#include "latency_histogram.hpp"
+
+//=============================================================================
+// Run flight controllers against a simulated drone, without a ROS graph
+//
+// Usage: controller_bench [--controller basic|simple|trajectory|all] [--waypoints path.csv] [--repeat 1]
+//                         [--assert-zero-alloc]
+//
+// The plan is a 1m square at 1m altitude, or the waypoints in a CSV file, one "t_sec, x, y, z, yaw" per line,
+// t_sec is relative to the start of the run. Each leg of the square is LEG_SEC of flight plus the controller's
+// deadline offset (e.g., Basic's stabilize time), so every controller gets the same time to fly.
+// The drone starts at rest at the first waypoint. Odometry comes from integrating cmd_vel at ODOM_RATE.
+// cmd_vel goes out through a real publisher, the simulated drone gets a copy, nothing is ever spun.
+// Reports ns per odom callback, heap allocations per odom callback (including the publish, on this thread),
+// and tracking error. Run it before and after a change to pid.hpp, drone_pose.hpp or a controller.
+//
+// With --assert-zero-alloc the exit code is 1 if any odom callback allocated, ctest runs this.
+//=============================================================================
+
+namespace
+{
+  // Heap allocations on this thread
+  thread_local uint64_t g_allocations = 0;
+}
+
+void *operator new(std::size_t size)
+{
+  g_allocations++;
+  void *p = std::malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+namespace
+{
+  const int ODOM_RATE = 30;
+  const double MAX_SPEED = 1.0;       // m/s at full stick
+  const double MAX_YAW_RATE = 1.0;    // rad/s at full stick
+  const double TIMEOUT_SEC = 120;
+  const double LEG_SEC = 4;
+
+  struct Waypoint
+  {
+    double t_sec;
+    double x, y, z, yaw;
+  };
+
+  // The controller reaches each waypoint offset_sec before its timestamp
+  std::vector<Waypoint> square(double offset_sec)
+  {
+    double leg = LEG_SEC + offset_sec;
+    return {
+      {3, 0, 0, 1, 0},
+      {3 + leg, 1, 0, 1, 0},
+      {3 + 2 * leg, 1, 1, 1, 0},
+      {3 + 3 * leg, 0, 1, 1, 0},
+      {3 + 4 * leg, 0, 0, 1, 0},
+    };
+  }
+
+  bool read_waypoints(const std::string &path, std::vector<Waypoint> &waypoints)
+  {
+    std::ifstream f(path);
+    if (!f) {
+      return false;
+    }
+
+    std::string line;
+    while (std::getline(f, line)) {
+      std::replace(line.begin(), line.end(), ',', ' ');
+      std::istringstream s(line);
+      Waypoint w;
+      if (s >> w.t_sec >> w.x >> w.y >> w.z >> w.yaw) {
+        waypoints.push_back(w);
+      }
+    }
+    return !waypoints.empty();
+  }
+
+  nav_msgs::msg::Path::SharedPtr make_plan(const std::vector<Waypoint> &waypoints, int64_t t0_ns)
+  {
+    auto plan = std::make_shared<nav_msgs::msg::Path>();
+    plan->header.frame_id = "map";
+    plan->header.stamp = rclcpp::Time(t0_ns);
+
+    for (auto &w : waypoints) {
+      geometry_msgs::msg::PoseStamped pose;
+      pose.header.frame_id = "map";
+      pose.header.stamp = rclcpp::Time(t0_ns + static_cast<int64_t>(RCL_S_TO_NS(w.t_sec)));
+      drone_base::DronePose p;
+      p.x = w.x;
+      p.y = w.y;
+      p.z = w.z;
+      p.yaw = w.yaw;
+      p.toMsg(pose.pose);
+      plan->poses.push_back(pose);
+    }
+
+    return plan;
+  }
+
+  struct Result
+  {
+    bool complete{};
+    uint64_t ticks{};
+    uint64_t allocations{};
+    double error_sum{};
+    double error_max{};
+    drone_base::LatencyHistogram cost;
+  };
+
+  // Fly the square if waypoints is empty
+  Result run(rclcpp::Node &node, const std::string &name, std::vector<Waypoint> waypoints)
+  {
+    Result result;
+
+    // Publish like drone_base does, and fly the simulated drone with a copy, see set_cmd_vel_callback
+    auto cmd_vel_pub = node.create_publisher<geometry_msgs::msg::Twist>("cmd_vel", 1);
+    auto fc = drone_base::FlightControllerRegistry::instance().create(name, node, cmd_vel_pub);
+
+    geometry_msgs::msg::Twist cmd_vel;
+    fc->set_cmd_vel_callback([&cmd_vel](const geometry_msgs::msg::Twist &twist) { cmd_vel = twist; });
+
+    if (waypoints.empty()) {
+      waypoints = square(static_cast<double>(fc->deadline_offset_ns()) / 1e9);
+    }
+
+    // Basic uses node.now() at takeoff, so simulated time starts at the wall time
+    int64_t t_ns = node.now().nanoseconds();
+    fc->set_plan(make_plan(waypoints, t_ns));
+
+    drone_base::DronePose pose;
+    pose.x = waypoints[0].x;
+    pose.y = waypoints[0].y;
+    pose.z = waypoints[0].z;
+    pose.yaw = waypoints[0].yaw;
+
+    auto odom = std::make_shared<nav_msgs::msg::Odometry>();
+    odom->header.frame_id = "map";
+
+    const double dt = 1.0 / ODOM_RATE;
+    const auto max_ticks = static_cast<uint64_t>(TIMEOUT_SEC * ODOM_RATE);
+
+    while (!fc->is_plan_complete() && result.ticks < max_ticks) {
+      odom->header.stamp = rclcpp::Time(t_ns);
+      pose.toMsg(odom->pose.pose);
+
+      uint64_t allocations = g_allocations;
+      auto start = std::chrono::steady_clock::now();
+      bool timeout = fc->odom_callback(odom);
+      auto stop = std::chrono::steady_clock::now();
+      result.allocations += g_allocations - allocations;
+      result.cost.add(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+      result.ticks++;
+
+      result.error_sum += fc->tracking_error();
+      result.error_max = std::max(result.error_max, fc->tracking_error());
+
+      if (timeout) {
+        break;
+      }
+
+      // Body frame to world frame
+      double vx, vy;
+      drone_base::PoseUtil::rotate_frame(cmd_vel.linear.x, cmd_vel.linear.y, -pose.yaw, vx, vy);
+      pose.x += vx * MAX_SPEED * dt;
+      pose.y += vy * MAX_SPEED * dt;
+      pose.z += cmd_vel.linear.z * MAX_SPEED * dt;
+      pose.yaw = drone_base::PoseUtil::norm_angle(pose.yaw + cmd_vel.angular.z * MAX_YAW_RATE * dt);
+
+      t_ns += RCL_S_TO_NS(1) / ODOM_RATE;
+    }
+
+    result.complete = fc->is_plan_complete();
+    return result;
+  }
+
+}
+
+int main(int argc, char **argv)
+{
+  rclcpp::init(argc, argv);
+
+  std::vector<std::string> controllers{"basic", "simple", "trajectory"};
+  std::vector<Waypoint> waypoints;
+  int repeat = 1;
+  bool assert_zero_alloc = false;
+
+  auto args = rclcpp::remove_ros_arguments(argc, argv);
+  for (size_t i = 1; i < args.size(); i++) {
+    bool has_value = i + 1 < args.size();
+    if (args[i] == "--assert-zero-alloc") {
+      assert_zero_alloc = true;
+    } else if (args[i] == "--controller" && has_value) {
+      if (args[++i] != "all") {
+        controllers = {args[i]};
+      }
+    } else if (args[i] == "--waypoints" && has_value) {
+      waypoints.clear();
+      if (!read_waypoints(args[++i], waypoints)) {
+        fprintf(stderr, "can't read waypoints from %s\n", args[i].c_str());
+        return 1;
+      }
+    } else if (args[i] == "--repeat" && has_value) {
+      repeat = std::max(1, std::stoi(args[++i]));
+    }
+  }
+
+  int exit_code = 0;
+
+  // Controllers log every target, keep the output readable and the logging out of the measurements
+  rcutils_logging_set_default_logger_level(RCUTILS_LOG_SEVERITY_WARN);
+
+  // A node for parameters and logging, it's never spun
+  auto node = std::make_shared<rclcpp::Node>("controller_bench");
+
+  printf("controller  complete    ticks  ns/iter  p99_ns  allocs/iter  mean_err_m  max_err_m\n");
+  for (auto &name : controllers) {
+    if (!drone_base::FlightControllerRegistry::instance().has(name)) {
+      fprintf(stderr, "unknown controller %s, choose from %s\n", name.c_str(),
+              drone_base::FlightControllerRegistry::instance().names().c_str());
+      continue;
+    }
+
+    for (int r = 0; r < repeat; r++) {
+      auto result = run(*node, name, waypoints);
+      uint64_t ticks = std::max(result.ticks, uint64_t{1});
+      printf("%10s  %8s  %7lu  %7ld  %6ld  %11.2f  %10.3f  %9.3f\n",
+             name.c_str(), result.complete ? "yes" : "no", result.ticks,
+             result.cost.mean_ns(), result.cost.percentile_ns(0.99),
+             static_cast<double>(result.allocations) / ticks,
+             result.error_sum / ticks, result.error_max);
+
+      if (assert_zero_alloc && result.allocations > 0) {
+        fprintf(stderr, "%s: %lu allocations in %lu odom callbacks\n", name.c_str(), result.allocations,
+                result.ticks);
+        exit_code = 1;
+      }
+    }
+  }
+
+  rclcpp::shutdown();
+  return exit_code;
+}
@@ -0,0 +1,174 @@
+#include "cubic_spline.hpp"
+
+#include "drone_pose.hpp"
+
+namespace spline
+{
+
+//====================
+// CubicSpline
+//====================
+
+  bool CubicSpline::fit(const std::vector<double> &ts, const std::vector<double> &ys, double v0, double vn)
+  {
+    ts_.clear();
+    segments_.clear();
+
+    size_t n = ts.size();
+    if (n < 2 || ys.size() != n) {
+      return false;
+    }
+
+    for (size_t i = 1; i < n; i++) {
+      if (ts[i] <= ts[i - 1]) {
+        return false;
+      }
+    }
+
+    // Knot velocities, v[0] and v[n-1] are given
+    std::vector<double> v(n);
+    v[0] = v0;
+    v[n - 1] = vn;
+
+    // Acceleration continuity at interior knot i:
+    //    v[i-1] / h[i-1] + 2 (1 / h[i-1] + 1 / h[i]) v[i] + v[i+1] / h[i] =
+    //        3 ((y[i] - y[i-1]) / h[i-1]^2 + (y[i+1] - y[i]) / h[i]^2)
+    // Solve with the Thomas algorithm, c_prime holds the eliminated super-diagonal
+    if (n > 2) {
+      size_t m = n - 2;
+      std::vector<double> c_prime(m);
+
+      for (size_t k = 0; k < m; k++) {
+        size_t i = k + 1;
+        double h0 = ts[i] - ts[i - 1];
+        double h1 = ts[i + 1] - ts[i];
+
+        double lower = 1 / h0;
+        double diag = 2 * (1 / h0 + 1 / h1);
+        double upper = 1 / h1;
+        double rhs = 3 * ((ys[i] - ys[i - 1]) / (h0 * h0) + (ys[i + 1] - ys[i]) / (h1 * h1));
+
+        // Move the known end velocities to the right hand side
+        if (k == 0) {
+          rhs -= lower * v0;
+        } else {
+          diag -= lower * c_prime[k - 1];
+          rhs -= lower * v[i - 1];
+        }
+        if (k == m - 1) {
+          rhs -= upper * vn;
+          upper = 0;
+        }
+
+        c_prime[k] = upper / diag;
+        v[i] = rhs / diag;
+      }
+
+      // Back substitution
+      for (size_t k = m - 1; k-- > 0;) {
+        v[k + 1] -= c_prime[k] * v[k + 2];
+      }
+    }
+
+    // Hermite form of each segment
+    ts_ = ts;
+    segments_.resize(n - 1);
+    for (size_t i = 0; i < n - 1; i++) {
+      double h = ts[i + 1] - ts[i];
+      double slope = (ys[i + 1] - ys[i]) / h;
+      Cubic &s = segments_[i];
+      s.a = ys[i];
+      s.b = v[i];
+      s.c = (3 * slope - 2 * v[i] - v[i + 1]) / h;
+      s.d = (v[i] + v[i + 1] - 2 * slope) / (h * h);
+    }
+
+    return true;
+  }
+
+  int CubicSpline::locate(double t, int cursor) const
+  {
+    int last = num_segments() - 1;
+    if (cursor < 0 || cursor > last) {
+      cursor = 0;
+    }
+
+    while (cursor > 0 && t < ts_[cursor]) {
+      cursor--;
+    }
+    while (cursor < last && t > ts_[cursor + 1]) {
+      cursor++;
+    }
+
+    return cursor;
+  }
+
+  SplinePoint CubicSpline::eval(double t, int &cursor) const
+  {
+    if (t < ts_.front()) {
+      t = ts_.front();
+    } else if (t > ts_.back()) {
+      t = ts_.back();
+    }
+
+    cursor = locate(t, cursor);
+    const Cubic &s = segments_[cursor];
+    double tau = t - ts_[cursor];
+
+    return SplinePoint{
+      s.a + tau * (s.b + tau * (s.c + tau * s.d)),
+      s.b + tau * (2 * s.c + tau * 3 * s.d),
+      2 * s.c + tau * 6 * s.d};
+  }
+
+//====================
+// PoseSpline
+//====================
+
+  bool PoseSpline::fit(const nav_msgs::msg::Path &path)
+  {
+    if (path.poses.size() < 2) {
+      return false;
+    }
+
+    t0_ns_ = rclcpp::Time(path.poses[0].header.stamp).nanoseconds();
+
+    std::vector<double> ts, xs, ys, zs, yaws;
+    for (auto &pose_stamped : path.poses) {
+      drone_base::DronePose pose;
+      pose.fromMsg(pose_stamped.pose);
+
+      // Unwrap yaw
+      if (!yaws.empty()) {
+        pose.yaw = yaws.back() + drone_base::PoseUtil::norm_angle(pose.yaw - yaws.back());
+      }
+
+      ts.push_back(static_cast<double>(rclcpp::Time(pose_stamped.header.stamp).nanoseconds() - t0_ns_) / 1e9);
+      xs.push_back(pose.x);
+      ys.push_back(pose.y);
+      zs.push_back(pose.z);
+      yaws.push_back(pose.yaw);
+    }
+
+    return x_.fit(ts, xs) && y_.fit(ts, ys) && z_.fit(ts, zs) && yaw_.fit(ts, yaws);
+  }
+
+  PoseSplinePoint PoseSpline::eval(int64_t t_ns, int &cursor) const
+  {
+    double t = static_cast<double>(t_ns - t0_ns_) / 1e9;
+
+    // All 4 splines share the same knots, so they share the cursor
+    int c = cursor;
+    SplinePoint x = x_.eval(t, c);
+    c = cursor;
+    SplinePoint y = y_.eval(t, c);
+    c = cursor;
+    SplinePoint z = z_.eval(t, c);
+    SplinePoint yaw = yaw_.eval(t, cursor);
+
+    return PoseSplinePoint{
+      x.y, y.y, z.y, drone_base::PoseUtil::norm_angle(yaw.y),
+      x.y_dot, y.y_dot, z.y_dot, yaw.y_dot};
+  }
+
+} // namespace spline
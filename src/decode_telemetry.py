@@ -0,0 +1,90 @@
+#!/usr/bin/env python
+
+"""
+Decode a drone_base telemetry file (.tlm) to CSV, and optionally plot it.
+
+Usage:
+    decode_telemetry.py solo_drone_base_20191104_153012.tlm > run.csv
+    decode_telemetry.py --plot solo_drone_base_20191104_153012.tlm
+
+The layout must match TelemetryHeader and TelemetryRecord in telemetry_recorder.hpp.
+"""
+
+import argparse
+import struct
+import sys
+from typing import Iterator, List, Tuple
+
+MAGIC = b'FLKTLM01'
+VERSION = 1
+
+HEADER = struct.Struct('<8sII')
+RECORD = struct.Struct('<qif4f4f4f')
+
+FIELDS = ['t_ns', 'target', 'dt',
+          'target_x', 'target_y', 'target_z', 'target_yaw',
+          'actual_x', 'actual_y', 'actual_z', 'actual_yaw',
+          'throttle', 'strafe', 'vertical', 'yaw']
+
+
+def read_records(path: str) -> Iterator[Tuple]:
+    """Yield one tuple per record, in FIELDS order"""
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    if len(data) < HEADER.size:
+        raise ValueError('{} is too short'.format(path))
+
+    magic, version, record_size = HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise ValueError('{} is not a telemetry file'.format(path))
+    if version != VERSION or record_size != RECORD.size:
+        raise ValueError('{} has version {}, record size {}, expected version {}, record size {}'.format(
+            path, version, record_size, VERSION, RECORD.size))
+
+    for offset in range(HEADER.size, len(data) - RECORD.size + 1, RECORD.size):
+        record = RECORD.unpack_from(data, offset)
+        if record[0] == 0:
+            # Zero-filled tail, the recorder didn't shut down cleanly
+            break
+        yield record
+
+
+def plot(records: List[Tuple]):
+    import matplotlib.pyplot as plt
+
+    t0 = records[0][0]
+    t = [(r[0] - t0) / 1e9 for r in records]
+
+    fig, axes = plt.subplots(4, 1, sharex=True)
+    for i, (axis, name) in enumerate(zip(axes, ['x', 'y', 'z', 'yaw'])):
+        axis.plot(t, [r[3 + i] for r in records], label='target')
+        axis.plot(t, [r[7 + i] for r in records], label='actual')
+        axis.plot(t, [r[11 + i] for r in records], label='command')
+        axis.set_ylabel(name)
+        axis.legend(loc='upper right')
+    axes[-1].set_xlabel('seconds')
+    plt.show()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode a drone_base telemetry file')
+    parser.add_argument('path', help='.tlm file')
+    parser.add_argument('--plot', action='store_true', help='plot target, actual and command instead of printing')
+    args = parser.parse_args()
+
+    records = list(read_records(args.path))
+    if not records:
+        print('no records', file=sys.stderr)
+        return
+
+    if args.plot:
+        plot(records)
+    else:
+        print(','.join(FIELDS))
+        for r in records:
+            print('{},{},{:.4f},'.format(r[0], r[1], r[2]) + ','.join('{:.4f}'.format(v) for v in r[3:]))
+
+
+if __name__ == '__main__':
+    main()
@@ -1,9 +1,19 @@
 #include "drone_base.hpp"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <ctime>
+
 #include <tf2_geometry_msgs/tf2_geometry_msgs.h>
 
-#include "flight_controller_basic.hpp"
-#include "flight_controller_simple.hpp"
+#include "rclcpp/create_timer.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
+
+#include "flock2/msg/drone_status.hpp"
+
+#include "flight_controller_registry.hpp"
+#include "qos_profiles.hpp"
 
 namespace drone_base
 {
@@ -12,141 +22,171 @@ namespace drone_base
 // Constants
 //=============================================================================
 
-  const int SPIN_RATE = 20;
-
   const int MIN_BATTERY{20};  // Percent
 
 //=============================================================================
 // Utilities
 //=============================================================================
 
-  bool button_down(const sensor_msgs::msg::Joy::SharedPtr &curr, const sensor_msgs::msg::Joy &prev, int index)
-  {
-    return curr->buttons[index] && !prev.buttons[index];
-  }
-
 //=============================================================================
 // States, events and actions
+//
+// Transitions are looked up in constexpr tables indexed by enum value, so the cost of a transition
+// doesn't grow with the number of states. The tables are checked at compile time.
 //=============================================================================
 
-  std::map<State, const char *> g_states{
-    {State::unknown,     "unknown"},
-    {State::ready,       "ready"},
-    {State::flight,      "flight"},
-    {State::ready_odom,  "ready_odom"},
-    {State::flight_odom, "flight_odom"},
-    {State::low_battery, "low_battery"},
-  };
-
-  std::map<Event, const char *> g_events{
-    {Event::connected,        "connected"},
-    {Event::disconnected,     "disconnected"},
-    {Event::odometry_started, "odometry_started"},
-    {Event::odometry_stopped, "odometry_stopped"},
-    {Event::low_battery,      "low_battery"},
-  };
-
-  std::map<Action, const char *> g_actions{
-    {Action::takeoff, "takeoff"},
-    {Action::land,    "land"},
-  };
-
-  struct EventTransition
-  {
-    State curr_state_;
-    Event event_;
-    State next_state_;
-
-    EventTransition(State curr_state, Event event, State next_state) :
-      curr_state_{curr_state}, event_{event}, next_state_{next_state}
-    {}
-  };
-
-  struct ActionTransition
-  {
-    State curr_state_;
-    Action action_;
-    State next_state_;
-
-    ActionTransition(State curr_state, Action action, State next_state) :
-      curr_state_{curr_state}, action_{action}, next_state_{next_state}
-    {}
-  };
-
-  bool valid_event_transition(const State state, const Event event, State &next_state)
+  constexpr size_t NUM_STATES = 6;
+  constexpr size_t NUM_EVENTS = 5;
+  constexpr size_t NUM_ACTIONS = 2;
+
+  constexpr size_t idx(State state)
+  { return static_cast<size_t>(state); }
+
+  constexpr size_t idx(Event event)
+  { return static_cast<size_t>(event); }
+
+  constexpr size_t idx(Action action)
+  { return static_cast<size_t>(action); }
+
+  static_assert(idx(State::low_battery) + 1 == NUM_STATES, "update NUM_STATES and the tables");
+  static_assert(idx(Event::low_battery) + 1 == NUM_EVENTS, "update NUM_EVENTS and the tables");
+  static_assert(idx(Action::land) + 1 == NUM_ACTIONS, "update NUM_ACTIONS and the tables");
+
+  // ~state carries the enum value, flock_base reports it in DroneStatus
+  static_assert(idx(State::ready_odom) == flock2::msg::DroneStatus::STATE_READY_ODOM &&
+                idx(State::low_battery) == flock2::msg::DroneStatus::STATE_LOW_BATTERY,
+                "update the DroneStatus state constants");
+
+  constexpr std::array<const char *, NUM_STATES> g_states{{
+    "unknown",
+    "ready",
+    "flight",
+    "ready_odom",
+    "flight_odom",
+    "low_battery",
+  }};
+
+  constexpr std::array<const char *, NUM_EVENTS> g_events{{
+    "connected",
+    "disconnected",
+    "odometry_started",
+    "odometry_stopped",
+    "low_battery",
+  }};
+
+  constexpr std::array<const char *, NUM_ACTIONS> g_actions{{
+    "takeoff",
+    "land",
+  }};
+
+  const char *name(State state)
+  { return g_states[idx(state)]; }
+
+  const char *name(Event event)
+  { return g_events[idx(event)]; }
+
+  const char *name(Action action)
+  { return g_actions[idx(action)]; }
+
+  // Transition not allowed
+  constexpr State XX = static_cast<State>(-1);
+
+  // Rows are the current state, columns are events
+  constexpr std::array<std::array<State, NUM_EVENTS>, NUM_STATES> g_event_transitions{{
+    //  connected     disconnected    odometry_started    odometry_stopped    low_battery
+    {{State::ready, XX,             XX,                 XX,                 XX}},                   // unknown
+    {{XX,           State::unknown, State::ready_odom,  XX,                 State::low_battery}},   // ready
+    {{XX,           State::unknown, State::flight_odom, XX,                 State::low_battery}},   // flight
+    {{XX,           State::unknown, XX,                 State::ready,       State::low_battery}},   // ready_odom
+    {{XX,           State::unknown, XX,                 State::flight,      State::low_battery}},   // flight_odom
+    {{XX,           State::unknown, XX,                 XX,                 XX}},                   // low_battery
+  }};
+
+  // Rows are the current state, columns are actions
+  // Allow for emergency landing in all states
+  constexpr std::array<std::array<State, NUM_ACTIONS>, NUM_STATES> g_action_transitions{{
+    //  takeoff             land
+    {{XX,                 State::unknown}},       // unknown
+    {{State::flight,      State::ready}},         // ready
+    {{XX,                 State::ready}},         // flight
+    {{State::flight_odom, State::ready_odom}},    // ready_odom
+    {{XX,                 State::ready_odom}},    // flight_odom
+    {{XX,                 State::low_battery}},   // low_battery
+  }};
+
+  constexpr bool all_named()
   {
-    const static std::vector<EventTransition> valid_transitions{
-      EventTransition{State::unknown, Event::connected, State::ready},
-
-      EventTransition{State::ready, Event::disconnected, State::unknown},
-      EventTransition{State::ready, Event::odometry_started, State::ready_odom},
-      EventTransition{State::ready, Event::low_battery, State::low_battery},
-
-      EventTransition{State::flight, Event::disconnected, State::unknown},
-      EventTransition{State::flight, Event::odometry_started, State::flight_odom},
-      EventTransition{State::flight, Event::low_battery, State::low_battery},
-
-      EventTransition{State::ready_odom, Event::disconnected, State::unknown},
-      EventTransition{State::ready_odom, Event::odometry_stopped, State::ready},
-      EventTransition{State::ready_odom, Event::low_battery, State::low_battery},
-
-      EventTransition{State::flight_odom, Event::disconnected, State::unknown},
-      EventTransition{State::flight_odom, Event::odometry_stopped, State::flight},
-      EventTransition{State::flight_odom, Event::low_battery, State::low_battery},
-
-      EventTransition{State::low_battery, Event::disconnected, State::unknown},
-    };
-
-    for (auto i = valid_transitions.begin(); i != valid_transitions.end(); i++) {
-      if (i->curr_state_ == state && i->event_ == event) {
-        next_state = i->next_state_;
-        return true;
+    for (size_t i = 0; i < NUM_STATES; i++) {
+      if (g_states[i] == nullptr) {
+        return false;
       }
     }
-
-    return false;
+    for (size_t i = 0; i < NUM_EVENTS; i++) {
+      if (g_events[i] == nullptr) {
+        return false;
+      }
+    }
+    for (size_t i = 0; i < NUM_ACTIONS; i++) {
+      if (g_actions[i] == nullptr) {
+        return false;
+      }
+    }
+    return true;
   }
 
-  bool valid_action_transition(const State state, const Action action, State &next_state)
+  constexpr bool can_always_land()
   {
-    // Allow for emergency landing in all states
-    const static std::vector<ActionTransition> valid_transitions{
-      ActionTransition{State::unknown, Action::land, State::unknown},
-
-      ActionTransition{State::ready, Action::takeoff, State::flight},
-      ActionTransition{State::ready, Action::land, State::ready},
-
-      ActionTransition{State::flight, Action::land, State::ready},
-
-      ActionTransition{State::ready_odom, Action::takeoff, State::flight_odom},
-      ActionTransition{State::ready_odom, Action::land, State::ready_odom},
-
-      ActionTransition{State::flight_odom, Action::land, State::ready_odom},
-
-      ActionTransition{State::low_battery, Action::land, State::low_battery},
-    };
+    for (size_t i = 0; i < NUM_STATES; i++) {
+      if (g_action_transitions[i][idx(Action::land)] == XX) {
+        return false;
+      }
+    }
+    return true;
+  }
 
-    for (auto i = valid_transitions.begin(); i != valid_transitions.end(); i++) {
-      if (i->curr_state_ == state && i->action_ == action) {
-        next_state = i->next_state_;
-        return true;
+  constexpr bool disconnect_always_resets()
+  {
+    for (size_t i = 1; i < NUM_STATES; i++) {
+      if (g_event_transitions[i][idx(Event::disconnected)] != State::unknown) {
+        return false;
       }
     }
+    return true;
+  }
+
+  static_assert(all_named(), "missing name");
+  static_assert(can_always_land(), "landing must be allowed in all states");
+  static_assert(disconnect_always_resets(), "disconnect must lead to the unknown state");
+  static_assert(g_event_transitions[idx(State::unknown)][idx(Event::connected)] == State::ready, "");
+  static_assert(g_event_transitions[idx(State::flight_odom)][idx(Event::odometry_stopped)] == State::flight, "");
+  static_assert(g_action_transitions[idx(State::ready_odom)][idx(Action::takeoff)] == State::flight_odom, "");
+  static_assert(g_action_transitions[idx(State::low_battery)][idx(Action::takeoff)] == XX, "");
+
+  bool valid_event_transition(const State state, const Event event, State &next_state)
+  {
+    next_state = g_event_transitions[idx(state)][idx(event)];
+    return next_state != XX;
+  }
 
-    return false;
+  bool valid_action_transition(const State state, const Action action, State &next_state)
+  {
+    next_state = g_action_transitions[idx(state)][idx(action)];
+    return next_state != XX;
   }
 
 //=============================================================================
 // DroneBase node
 //=============================================================================
 
-  DroneBase::DroneBase() : Node{"drone_base"}
+  DroneBase::DroneBase(const rclcpp::NodeOptions &options) : Node{"drone_base", options}
   {
+    auto init_start = std::chrono::steady_clock::now();
+
     // Suppress CLion warnings
     (void) cmd_vel_pub_;
     (void) start_mission_sub_;
     (void) stop_mission_sub_;
-    (void) joy_sub_;
+    (void) manual_control_sub_;
     (void) tello_response_sub_;
     (void) flight_data_sub_;
     (void) odom_sub_;
@@ -158,67 +198,146 @@ namespace drone_base
 
 #undef CXT_MACRO_MEMBER
 #define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_PARAMETER_CHANGED(cxt_, n, t)
-    CXT_MACRO_REGISTER_PARAMETERS_CHANGED((*this), DRONE_BASE_ALL_PARAMS, validate_parameters)
+    CXT_MACRO_REGISTER_PARAMETERS_CHANGED(parameters_callback_, DRONE_BASE_ALL_PARAMS, validate_parameters)
+    set_on_parameters_set_callback(std::bind(&DroneBase::parameters_changed, this, std::placeholders::_1));
+    auto params_done = std::chrono::steady_clock::now();
+
+    // The trace is read once, turning it off leaves only a null check on the hot path
+    if (cxt_.trace_) {
+      trace_ = std::make_unique<LatencyTrace>();
+      diagnostics_pub_ = create_publisher<diagnostic_msgs::msg::DiagnosticArray>("/diagnostics", 10);
+    }
+
+    if (!cxt_.telemetry_dir_.empty()) {
+      open_telemetry();
+    }
 
-  fc_ = std::make_unique<FlightControllerBasic>(*this, cmd_vel_pub_);
-//    fc_ = std::make_unique<FlightControllerSimple>(*this, cmd_vel_pub_);
+    predicted_odom_ = std::make_shared<nav_msgs::msg::Odometry>();
 
     action_mgr_ = std::make_unique<ActionMgr>(get_logger(),
-                                              create_client<tello_msgs::srv::TelloAction>("tello_action"));
+                                              create_client<tello_msgs::srv::TelloAction>("tello_action"),
+                                              get_clock(), mutex_);
+    action_mgr_->set_trace(trace_.get());
+
+    cmd_vel_pub_ = create_publisher<geometry_msgs::msg::Twist>("cmd_vel", stream_qos(cxt_.cmd_vel_qos_));
 
-    cmd_vel_pub_ = create_publisher<geometry_msgs::msg::Twist>("cmd_vel", 1);
+    // Published on every transition, latched so a monitor that starts late gets the current state
+    state_pub_ = create_publisher<std_msgs::msg::UInt8>("state", latched_qos(),
+                                                        plan_options<rclcpp::PublisherOptions>());
+    publish_state();
 
     using std::placeholders::_1;
-    auto joy_cb = std::bind(&DroneBase::joy_callback, this, _1);
+    auto manual_control_cb = std::bind(&DroneBase::manual_control_callback, this, _1);
     auto start_mission_cb = std::bind(&DroneBase::start_mission_callback, this, _1);
     auto stop_mission_cb = std::bind(&DroneBase::stop_mission_callback, this, _1);
     auto tello_response_cb = std::bind(&DroneBase::tello_response_callback, this, _1);
     auto flight_data_cb = std::bind(&DroneBase::flight_data_callback, this, _1);
     auto odom_cb = std::bind(&DroneBase::odom_callback, this, _1);
     auto plan_cb = std::bind(&DroneBase::plan_callback, this, _1);
+    auto compact_plan_cb = std::bind(&DroneBase::compact_plan_callback, this, _1);
+
+    // Control-critical subscriptions get their own callback group, so on a MultiThreadedExecutor
+    // they can run while a plan is converted; both groups share mutex_ for the state and the controllers
+    control_group_ = create_callback_group(rclcpp::callback_group::CallbackGroupType::MutuallyExclusive);
+    rclcpp::SubscriptionOptions control_options;
+    control_options.callback_group = control_group_;
+
+    // Only the latest odometry and flight data matter
+    auto flight_data_qos = stream_qos(cxt_.sensor_qos_);
+    auto odom_qos = stream_qos(cxt_.sensor_qos_);
+    rclcpp::SubscriptionOptions flight_data_options = control_options;
+    rclcpp::SubscriptionOptions odom_options = control_options;
+    if (cxt_.qos_deadline_) {
+      // The middleware reports missed deadlines, spin_once doesn't poll for timeouts
+      flight_data_qos.deadline(cxt_.flight_data_timeout_);
+      odom_qos.deadline(cxt_.odom_timeout_);
+      flight_data_options.event_callbacks.deadline_callback = [this](rclcpp::QOSDeadlineRequestedInfo &)
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flight_data_timeout(now());
+      };
+      odom_options.event_callbacks.deadline_callback = [this](rclcpp::QOSDeadlineRequestedInfo &)
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        odom_timeout(now());
+      };
+    }
 
     start_mission_sub_ = create_subscription<std_msgs::msg::Empty>("/start_mission", 10, start_mission_cb);
     stop_mission_sub_ = create_subscription<std_msgs::msg::Empty>("/stop_mission", 10, stop_mission_cb);
-    joy_sub_ = create_subscription<sensor_msgs::msg::Joy>("joy", 10, joy_cb);
-    tello_response_sub_ = create_subscription<tello_msgs::msg::TelloResponse>("tello_response", 10, tello_response_cb);
-    flight_data_sub_ = create_subscription<tello_msgs::msg::FlightData>("flight_data", 10, flight_data_cb);
-    odom_sub_ = create_subscription<nav_msgs::msg::Odometry>("base_odom", 10, odom_cb);
-    plan_sub_ = create_subscription<nav_msgs::msg::Path>("plan", 10, plan_cb);
+    if (cxt_.flock_takeoff_) {
+      flock_airborne_sub_ = create_subscription<std_msgs::msg::Header>(
+        "/flock_airborne", 10, std::bind(&DroneBase::flock_airborne_callback, this, _1));
+    }
+    manual_control_sub_ = create_subscription<flock2::msg::ManualControl>("manual_control", 10, manual_control_cb);
+    tello_response_sub_ = create_subscription<tello_msgs::msg::TelloResponse>("tello_response", 10, tello_response_cb,
+                                                                              control_options);
+    flight_data_sub_ = create_subscription<tello_msgs::msg::FlightData>("flight_data", flight_data_qos,
+                                                                         flight_data_cb, flight_data_options);
+    odom_sub_ = create_subscription<nav_msgs::msg::Odometry>("base_odom", odom_qos, odom_cb, odom_options);
+    plan_sub_ = create_subscription<nav_msgs::msg::Path>("plan", plan_qos(), plan_cb,
+                                                         plan_options<rclcpp::SubscriptionOptions>());
+    compact_plan_sub_ = create_subscription<flock2::msg::CompactPlan>(
+      "compact_plan", plan_stream_qos(), compact_plan_cb, plan_options<rclcpp::SubscriptionOptions>());
+
+    if (cxt_.control_rate_ > 0) {
+      // Steady cmd_vel no matter how odometry arrives, in the control group so it doesn't wait behind plans
+      control_timer_ = rclcpp::create_timer(this, get_clock(),
+                                            rclcpp::Duration(static_cast<int64_t>(RCL_S_TO_NS(1) / cxt_.control_rate_)),
+                                            std::bind(&DroneBase::control_timer_callback, this), control_group_);
+    }
+
+    if (cxt_.event_driven_) {
+      // Subscriptions fire as soon as messages arrive, timeouts and actions are checked on a timer
+      // Use the node clock so that the timer honors use_sim_time
+      spin_timer_ = rclcpp::create_timer(this, get_clock(), rclcpp::Duration(RCL_S_TO_NS(1) / SPIN_RATE),
+                                         std::bind(&DroneBase::spin_once, this));
+    }
+
+    // One startup report, the controllers and their parameters come with the first plan
+    started_ = true;
+    auto ms = [](std::chrono::steady_clock::duration d)
+    { return std::chrono::duration<double, std::milli>(d).count(); };
+    RCLCPP_INFO(get_logger(), "drone initialized in %.1f ms (parameters %.1f ms, topics %.1f ms), %s",
+                ms(std::chrono::steady_clock::now() - init_start), ms(params_done - init_start),
+                ms(std::chrono::steady_clock::now() - params_done), cxt_.event_driven_ ? "event driven" : "polling");
+  }
+
+  DroneBase::~DroneBase() = default;
 
-    RCLCPP_INFO(get_logger(), "drone initialized");
+  void DroneBase::create_controllers()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    (void) controller();
   }
 
   void DroneBase::spin_once()
   {
-    rclcpp::Time ros_time = now();
+    std::lock_guard<std::mutex> lock(mutex_);
 
-    // Check for flight data timeout
-    if (PoseUtil::is_valid_time(flight_data_time_) && ros_time - flight_data_time_ > cxt_.flight_data_timeout_) {
-      RCLCPP_ERROR(get_logger(), "flight data timeout, now %ld, last %ld",
-                   RCL_NS_TO_MS(ros_time.nanoseconds()), RCL_NS_TO_MS(flight_data_time_.nanoseconds()));
-      transition_state(Event::disconnected);
-      flight_data_time_ = rclcpp::Time();  // Zero time is invalid
-      odom_time_ = rclcpp::Time();
-    }
+    rclcpp::Time ros_time = now();
 
-    // Check for odometry timeout
-    if (PoseUtil::is_valid_time(odom_time_) && ros_time - odom_time_ > cxt_.odom_timeout_) {
-      RCLCPP_ERROR(get_logger(), "odom timeout, now %ld, last %ld",
-                   RCL_NS_TO_MS(ros_time.nanoseconds()), RCL_NS_TO_MS(odom_time_.nanoseconds()));
-      transition_state(Event::odometry_stopped);
-      odom_time_ = rclcpp::Time();
+    // Check for flight data and odometry timeouts, unless the middleware does it for us
+    if (!cxt_.qos_deadline_) {
+      if (PoseUtil::is_valid_time(flight_data_time_) && ros_time - flight_data_time_ > cxt_.flight_data_timeout_) {
+        flight_data_timeout(ros_time);
+      }
+      if (PoseUtil::is_valid_time(odom_time_) && ros_time - odom_time_ > cxt_.odom_timeout_) {
+        odom_timeout(ros_time);
+      }
     }
 
-    // Process any actions
+    // Time out actions
     action_mgr_->spin_once();
 
     // Automated flight
-    if (mission_ && fc_->have_plan()) {
+    if (mission_ && fc_ && fc_->have_plan()) {
       // We have a plan
       if (!fc_->is_plan_complete()) {
         // There's more to do
         if (state_ == State::ready_odom) {
-          if (!action_mgr_->busy()) {
+          // With flock_takeoff flock_base sends the takeoff, see flock_airborne_callback
+          if (!cxt_.flock_takeoff_ && !action_mgr_->busy()) {
             RCLCPP_INFO(get_logger(), "start mission, taking off");
             start_action(Action::takeoff);
           }
@@ -235,29 +354,319 @@ namespace drone_base
         }
       }
     }
+
+    report_latency(ros_time);
+  }
+
+  void DroneBase::report_latency(const rclcpp::Time &ros_time)
+  {
+    if (cxt_.latency_report_sec_ <= 0) {
+      return;
+    }
+
+    if (!PoseUtil::is_valid_time(latency_report_time_)) {
+      latency_report_time_ = ros_time;
+      return;
+    }
+
+    if (ros_time - latency_report_time_ > cxt_.latency_report_) {
+      if (trace_) {
+        publish_diagnostics(ros_time);
+      }
+
+      if (odom_latency_.count() > 0) {
+        RCLCPP_INFO(get_logger(), "odom->cmd_vel latency: n %lu, mean %.1f ms, p50 %.1f ms, p99 %.1f ms, max %.1f ms",
+                    odom_latency_.count(),
+                    odom_latency_.mean_ns() / 1e6,
+                    odom_latency_.percentile_ns(0.5) / 1e6,
+                    odom_latency_.percentile_ns(0.99) / 1e6,
+                    odom_latency_.max_ns() / 1e6);
+        odom_latency_.reset();
+      }
+
+      if (control_period_.count() > 0) {
+        RCLCPP_INFO(get_logger(), "%s control period: n %lu, mean %.2f ms, jitter %.2f ms, p99 %.1f ms, max %.1f ms",
+                    cxt_.control_rate_ > 0 ? "timer" : "odom", control_period_.count(),
+                    control_jitter_.mean(), control_jitter_.stddev(),
+                    control_period_.percentile_ns(0.99) / 1e6, control_period_.max_ns() / 1e6);
+        control_period_.reset();
+        control_jitter_.reset();
+      }
+
+      // Active vs shadow controller
+      if (shadow_fc_ && fc_stats_.error_count > 0) {
+        RCLCPP_INFO(get_logger(), "%s: cpu mean %.1f us, p99 %.1f us, tracking error %.3f m; "
+                                  "shadow %s: cpu mean %.1f us, p99 %.1f us, tracking error %.3f m",
+                    fc_name_.c_str(), fc_stats_.cost.mean_ns() / 1e3, fc_stats_.cost.percentile_ns(0.99) / 1e3,
+                    fc_stats_.mean_error(),
+                    shadow_name_.c_str(), shadow_stats_.cost.mean_ns() / 1e3,
+                    shadow_stats_.cost.percentile_ns(0.99) / 1e3, shadow_stats_.mean_error());
+        fc_stats_.reset();
+        shadow_stats_.reset();
+      }
+
+      latency_report_time_ = ros_time;
+    }
+  }
+
+  void DroneBase::open_telemetry()
+  {
+    // One file per drone per run, e.g., solo_drone_base_20191104_153012.tlm
+    std::string name = get_fully_qualified_name();
+    std::replace(name.begin(), name.end(), '/', '_');
+
+    char stamp[32];
+    auto t = std::time(nullptr);
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", std::localtime(&t));
+
+    std::string path = cxt_.telemetry_dir_ + "/" + name.substr(1) + "_" + stamp + ".tlm";
+    telemetry_ = std::make_unique<TelemetryRecorder>(path);
+    if (telemetry_->is_open()) {
+      RCLCPP_INFO(get_logger(), "recording telemetry to %s", path.c_str());
+    } else {
+      RCLCPP_ERROR(get_logger(), "can't open %s, telemetry is off", path.c_str());
+      telemetry_.reset();
+    }
+  }
+
+  void add_summary(diagnostic_msgs::msg::DiagnosticStatus &status, const std::string &name,
+                   const LatencyHistogram &histogram)
+  {
+    auto add = [&status](const std::string &key, const std::string &value)
+    {
+      diagnostic_msgs::msg::KeyValue kv;
+      kv.key = key;
+      kv.value = value;
+      status.values.push_back(kv);
+    };
+
+    auto ms = [](int64_t ns)
+    {
+      char buffer[32];
+      snprintf(buffer, sizeof(buffer), "%.3f", ns / 1e6);
+      return std::string(buffer);
+    };
+
+    add(name + " n", std::to_string(histogram.count()));
+    add(name + " p50 ms", ms(histogram.percentile_ns(0.5)));
+    add(name + " p99 ms", ms(histogram.percentile_ns(0.99)));
+    add(name + " max ms", ms(histogram.max_ns()));
+  }
+
+  void DroneBase::publish_diagnostics(const rclcpp::Time &ros_time)
+  {
+    trace_->update();
+
+    diagnostic_msgs::msg::DiagnosticStatus status;
+    status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+    status.name = std::string(get_name()) + " latency";
+    status.hardware_id = get_namespace();
+    status.message = trace_->dropped() > 0 ? "trace records dropped" : "ok";
+
+    add_summary(status, "odom stamp to cmd_vel", odom_latency_);
+    add_summary(status, "odom callback to cmd_vel", trace_->odom_to_cmd_vel);
+    add_summary(status, "control period", control_period_);
+    add_summary(status, "plan to first cmd_vel", trace_->plan_to_cmd_vel);
+    add_summary(status, "action to accepted", trace_->action_to_accepted);
+    add_summary(status, "action to response", trace_->action_to_complete);
+
+    auto msg = std::make_unique<diagnostic_msgs::msg::DiagnosticArray>();
+    msg->header.stamp = ros_time;
+    msg->status.push_back(status);
+    diagnostics_pub_->publish(std::move(msg));
+
+    trace_->reset();
+  }
+
+  void DroneBase::select_controllers()
+  {
+    auto fc_name = cxt_.flight_controller_;
+    auto shadow_name = cxt_.shadow_controller_;
+
+    auto &registry = FlightControllerRegistry::instance();
+    if (!registry.has(fc_name)) {
+      RCLCPP_ERROR(get_logger(), "unknown flight controller '%s', choose from %s",
+                   fc_name.c_str(), registry.names().c_str());
+      fc_name = fc_ ? fc_name_ : "basic";
+    }
+    if (!shadow_name.empty() && !registry.has(shadow_name)) {
+      RCLCPP_ERROR(get_logger(), "unknown shadow controller '%s', choose from %s",
+                   shadow_name.c_str(), registry.names().c_str());
+      shadow_name.clear();
+    }
+
+    // Only rebuild the controllers that changed, the other one keeps its state and stats
+    bool new_fc = !fc_ || fc_name != fc_name_;
+    bool new_shadow = shadow_name != shadow_name_;
+    if (!new_fc && !new_shadow) {
+      return;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    // Hand the current plan to the new controllers during a mission. Between missions it's the last mission's
+    // plan, and plans are ignored until /start_mission, so the new controllers wait for the next one
+    nav_msgs::msg::Path::ConstSharedPtr plan;
+    if (fc_ && mission_) {
+      plan = fc_->plan_msg();
+    }
+
+    creating_controllers_ = true;
+
+    if (new_fc) {
+      auto fc = registry.create(fc_name, *this, cmd_vel_pub_);
+      fc->set_publish_control(!cxt_.external_control_);
+      fc->set_trace(trace_.get());
+      fc->set_telemetry(telemetry_.get());
+      fc->set_timing(&timing_);
+      fc->set_predictor(&predictor_);
+      if (plan) {
+        fc->set_plan(plan);
+      }
+
+      fc_ = std::move(fc);
+      fc_name_ = fc_name;
+      fc_stats_.reset();
+    }
+
+    if (new_shadow) {
+      std::unique_ptr<FlightControllerInterface> shadow_fc;
+      if (!shadow_name.empty()) {
+        shadow_fc = registry.create(shadow_name, *this, cmd_vel_pub_);
+        shadow_fc->set_publish_control(false);
+        if (plan) {
+          shadow_fc->set_plan(plan);
+        }
+      }
+
+      shadow_fc_ = std::move(shadow_fc);
+      shadow_name_ = shadow_name;
+      shadow_stats_.reset();
+    }
+
+    creating_controllers_ = false;
+
+    RCLCPP_INFO(get_logger(), "flight controller %s, shadow controller %s, created in %.1f ms",
+                fc_name_.c_str(), shadow_name_.empty() ? "none" : shadow_name_.c_str(),
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+  }
+
+  FlightControllerInterface &DroneBase::controller()
+  {
+    if (!fc_) {
+      select_controllers();
+    }
+    return *fc_;
+  }
+
+  void DroneBase::flight_data_timeout(const rclcpp::Time &ros_time)
+  {
+    if (!PoseUtil::is_valid_time(flight_data_time_)) {
+      return;
+    }
+
+    RCLCPP_ERROR(get_logger(), "flight data timeout, now %ld, last %ld",
+                 RCL_NS_TO_MS(ros_time.nanoseconds()), RCL_NS_TO_MS(flight_data_time_.nanoseconds()));
+    transition_state(Event::disconnected);
+    action_mgr_->clear("lost connection");
+    flight_data_time_ = rclcpp::Time();  // Zero time is invalid
+    odom_time_ = rclcpp::Time();
+  }
+
+  void DroneBase::odom_timeout(const rclcpp::Time &ros_time)
+  {
+    if (!PoseUtil::is_valid_time(odom_time_)) {
+      return;
+    }
+
+    RCLCPP_ERROR(get_logger(), "odom timeout, now %ld, last %ld",
+                 RCL_NS_TO_MS(ros_time.nanoseconds()), RCL_NS_TO_MS(odom_time_.nanoseconds()));
+    transition_state(Event::odometry_stopped);
+    odom_time_ = rclcpp::Time();
+    latest_odom_.reset();
   }
 
   void DroneBase::validate_parameters()
   {
+    if (!valid_reliability(cxt_.sensor_qos_)) {
+      RCLCPP_WARN(get_logger(), "sensor_qos must be best_effort or reliable, using best_effort");
+      cxt_.sensor_qos_ = "best_effort";
+    }
+    if (!valid_reliability(cxt_.cmd_vel_qos_)) {
+      RCLCPP_WARN(get_logger(), "cmd_vel_qos must be best_effort or reliable, using reliable");
+      cxt_.cmd_vel_qos_ = "reliable";
+    }
+
+    if (cxt_.plan_ring_size_ < 2) {
+      RCLCPP_WARN(get_logger(), "plan_ring_size must be at least 2, using 64");
+      cxt_.plan_ring_size_ = 64;
+    }
+
     cxt_.flight_data_timeout_ = rclcpp::Duration(static_cast<int64_t>(RCL_S_TO_NS(cxt_.flight_data_timeout_sec_)));
     cxt_.odom_timeout_ = rclcpp::Duration(static_cast<int64_t>(RCL_S_TO_NS(cxt_.odom_timeout_sec_)));
+    cxt_.latency_report_ = rclcpp::Duration(static_cast<int64_t>(RCL_S_TO_NS(cxt_.latency_report_sec_)));
+    if (fc_) {
+      fc_->set_publish_control(!cxt_.external_control_);
+    }
+
+    if (cxt_.max_predict_sec_ < 0) {
+      cxt_.max_predict_sec_ = 0;
+    }
+    predictor_.set_model(cxt_.predict_xy_speed_, cxt_.predict_z_speed_, cxt_.predict_yaw_rate_,
+                         cxt_.max_predict_sec_);
 
-    RCLCPP_INFO(get_logger(), "DroneBase Parameters");
+    // Keep startup quiet, drone_base --write-params lists the parameters
+    if (started_) {
+      RCLCPP_INFO(get_logger(), "DroneBase Parameters");
 
 #undef CXT_MACRO_MEMBER
 #define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOG_PARAMETER(RCLCPP_INFO, get_logger(), cxt_, n, t, d)
-    DRONE_BASE_ALL_PARAMS
+      DRONE_BASE_ALL_PARAMS
+    } else {
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOG_PARAMETER(RCLCPP_DEBUG, get_logger(), cxt_, n, t, d)
+      DRONE_BASE_ALL_PARAMS
+    }
+  }
+
+  rcl_interfaces::msg::SetParametersResult DroneBase::parameters_changed(
+    const std::vector<rclcpp::Parameter> &parameters)
+  {
+    if (creating_controllers_) {
+      rcl_interfaces::msg::SetParametersResult result;
+      result.successful = true;
+      return result;
+    }
+
+    // The control group reads cxt_, predictor_ and the controllers
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto result = parameters_callback_(parameters);
+    if (fc_) {
+      fc_->parameters_changed(parameters);
+    }
+    if (shadow_fc_) {
+      shadow_fc_->parameters_changed(parameters);
+    }
+    return result;
   }
 
   void DroneBase::start_mission_callback(std_msgs::msg::Empty::SharedPtr msg)
   {
+    std::lock_guard<std::mutex> lock(mutex_);
     (void) msg;
     RCLCPP_INFO(get_logger(), "start mission");
+
+    // Swap controllers between missions, never during a mission, the first ones are created with the first plan
+    if (!mission_ && fc_) {
+      select_controllers();
+      predictor_.clear();
+    }
+
     mission_ = true;
   }
 
   void DroneBase::stop_mission_callback(std_msgs::msg::Empty::SharedPtr msg)
   {
+    std::lock_guard<std::mutex> lock(mutex_);
     (void) msg;
     RCLCPP_INFO(get_logger(), "stop mission");
     stop_mission();
@@ -266,73 +675,68 @@ namespace drone_base
   void DroneBase::stop_mission()
   {
     mission_ = false;
+    last_control_tick_ns_ = 0;
+    last_tick_odom_ns_ = 0;
     all_stop();
     if (state_ == State::flight || state_ == State::flight_odom) {
-      // Future: queue action if busy
       start_action(Action::land);
     }
   }
 
-  void DroneBase::joy_callback(sensor_msgs::msg::Joy::SharedPtr msg)
+  void DroneBase::flock_airborne_callback(std_msgs::msg::Header::SharedPtr msg)
   {
-    static sensor_msgs::msg::Joy prev_msg;
+    std::lock_guard<std::mutex> lock(mutex_);
+    (void) msg;
+    if (mission_) {
+      RCLCPP_INFO(get_logger(), "flock is airborne");
+      transition_state(Action::takeoff);
+    }
+  }
 
+  void DroneBase::manual_control_callback(flock2::msg::ManualControl::SharedPtr msg)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
     // Ignore the joystick if we're in a mission
     if (mission_) {
-      prev_msg = *msg;
       return;
     }
 
     // Takeoff/land
-    if (button_down(msg, prev_msg, joy_button_takeoff_)) {
+    if (msg->events & flock2::msg::ManualControl::TAKEOFF) {
       start_action(Action::takeoff);
-    } else if (button_down(msg, prev_msg, joy_button_land_)) {
+    } else if (msg->events & flock2::msg::ManualControl::LAND) {
       start_action(Action::land);
     }
 
-    // Manual flight
-    if ((state_ == State::flight || state_ == State::flight_odom) && !action_mgr_->busy()) {
-      // Trim (slow, steady) mode vs. joystick mode
-      if (msg->axes[joy_axis_trim_lr_] != 0. || msg->axes[joy_axis_trim_fb_] != 0.) {
-        const static double TRIM_SPEED{0.2};
-        double throttle{0}, strafe{0}, vertical{0}, yaw{0};
-        if (msg->axes[joy_axis_trim_lr_] != 0.) {
-          if (msg->buttons[joy_button_shift_]) {
-            yaw = TRIM_SPEED * msg->axes[joy_axis_trim_lr_];
-          } else {
-            strafe = TRIM_SPEED * msg->axes[joy_axis_trim_lr_];
-          }
-        }
-        if (msg->axes[joy_axis_trim_fb_] != 0.) {
-          if (msg->buttons[joy_button_shift_]) {
-            throttle = TRIM_SPEED * msg->axes[joy_axis_trim_fb_];
-          } else {
-            vertical = TRIM_SPEED * msg->axes[joy_axis_trim_fb_];
-          }
-        }
-        fc_->publish_velocity(throttle, strafe, vertical, yaw);
-      } else {
-        fc_->publish_velocity(
-          msg->axes[joy_axis_throttle_],
-          msg->axes[joy_axis_strafe_],
-          msg->axes[joy_axis_vertical_],
-          msg->axes[joy_axis_yaw_]);
+    // Manual flight, flock_base already applied the deadband and trim mode
+    if (state_ == State::flight || state_ == State::flight_odom) {
+      manual_ = *msg;
+      manual_pending_ = action_mgr_->busy();
+      if (!manual_pending_) {
+        publish_manual();
       }
     }
+  }
 
-    prev_msg = *msg;
+  void DroneBase::publish_manual()
+  {
+    controller().publish_velocity(manual_.throttle / 100., manual_.strafe / 100., manual_.vertical / 100.,
+                                  manual_.yaw / 100.);
   }
 
   void DroneBase::tello_response_callback(tello_msgs::msg::TelloResponse::SharedPtr msg)
   {
-    ActionMgr::State result = action_mgr_->complete(std::move(msg));
-    if (result == ActionMgr::State::succeeded) {
-      transition_state(action_mgr_->action());
+    std::lock_guard<std::mutex> lock(mutex_);
+    // With flock_takeoff the mission takeoff response belongs to flock_base
+    if (cxt_.flock_takeoff_ && !action_mgr_->busy()) {
+      return;
     }
+    action_mgr_->complete(std::move(msg));
   }
 
   void DroneBase::flight_data_callback(tello_msgs::msg::FlightData::SharedPtr msg)
   {
+    std::lock_guard<std::mutex> lock(mutex_);
     if (!PoseUtil::is_valid_time(flight_data_time_)) {
       transition_state(Event::connected);
     }
@@ -350,56 +754,236 @@ namespace drone_base
 
   void DroneBase::odom_callback(nav_msgs::msg::Odometry::SharedPtr msg)
   {
+    if (trace_) {
+      trace_->record(TraceEvent::odom_received);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
     // It's possible (but unlikely) to get an odom message before flight data
     if (PoseUtil::is_valid_time(flight_data_time_)) {
       if (!PoseUtil::is_valid_time(odom_time_)) {
         transition_state(Event::odometry_started);
       } else {
+        // flock_controller's cmd_vel never reaches the predictor, feed it the measured velocity instead
+        if (cxt_.predict_odom_ && cxt_.external_control_ && mission_ && latest_odom_) {
+          DronePose from, to;
+          from.fromMsg(latest_odom_->pose.pose);
+          to.fromMsg(msg->pose.pose);
+          predictor_.add_measured(PoseUtil::to_ns(latest_odom_->header.stamp), from,
+                                  PoseUtil::to_ns(msg->header.stamp), to);
+        }
+
         // Automated flight
-        if (mission_ && fc_->have_plan() && !fc_->is_plan_complete() && !action_mgr_->busy()) {
-          if (fc_->odom_callback(msg)) {
-            RCLCPP_ERROR(get_logger(), "didn't reach target");
-            stop_mission();
+        if (controlling()) {
+          int64_t lag_ns = now().nanoseconds() - PoseUtil::to_ns(msg->header.stamp);
+          timing_.odom_lag.add(static_cast<double>(std::max(lag_ns, int64_t{0})) / 1e9);
+
+          // With control_rate the timer runs the controllers on the latest odometry
+          if (cxt_.control_rate_ <= 0) {
+            run_controllers(cxt_.predict_odom_ ? predict_odom(msg) : msg, msg);
           }
         }
       }
 
       odom_time_ = rclcpp::Time(msg->header.stamp);
+      latest_odom_ = std::move(msg);
+    }
+  }
+
+  bool DroneBase::controlling() const
+  {
+    return mission_ && fc_ && fc_->have_plan() && !fc_->is_plan_complete() && !action_mgr_->busy();
+  }
+
+  void DroneBase::control_timer_callback()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (latest_odom_ && controlling()) {
+      // Without prediction a tick with no new odometry would hold the last pose at a new stamp, which looks
+      // like the drone stopped and kicks the D term, so wait for the next message
+      int64_t odom_ns = PoseUtil::to_ns(latest_odom_->header.stamp);
+      if (!cxt_.predict_odom_ && odom_ns == last_tick_odom_ns_) {
+        return;
+      }
+      last_tick_odom_ns_ = odom_ns;
+      run_controllers(predict_odom(latest_odom_), latest_odom_);
+    }
+  }
+
+  void DroneBase::run_controllers(const nav_msgs::msg::Odometry::SharedPtr &fc_odom,
+                                  const nav_msgs::msg::Odometry::SharedPtr &msg)
+  {
+    // Time between control ticks, the same measure for odom-driven and timer-driven control
+    auto start = std::chrono::steady_clock::now();
+    int64_t tick_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+    if (last_control_tick_ns_ > 0) {
+      int64_t period_ns = tick_ns - last_control_tick_ns_;
+      control_period_.add(period_ns);
+      control_jitter_.add(static_cast<double>(period_ns) / 1e6);
+    }
+    last_control_tick_ns_ = tick_ns;
+
+    bool timeout = fc_->odom_callback(fc_odom);
+    fc_stats_.add((std::chrono::steady_clock::now() - start).count(), fc_->tracking_error());
+    odom_latency_.add(now().nanoseconds() - PoseUtil::to_ns(msg->header.stamp));
+
+    // Same odometry, nothing is published
+    if (shadow_fc_ && shadow_fc_->have_plan() && !shadow_fc_->is_plan_complete()) {
+      start = std::chrono::steady_clock::now();
+      shadow_fc_->odom_callback(fc_odom);
+      shadow_stats_.add((std::chrono::steady_clock::now() - start).count(), shadow_fc_->tracking_error());
     }
+
+    if (timeout) {
+      RCLCPP_ERROR(get_logger(), "didn't reach target");
+      stop_mission();
+    }
+  }
+
+  const nav_msgs::msg::Odometry::SharedPtr &DroneBase::predict_odom(const nav_msgs::msg::Odometry::SharedPtr &msg)
+  {
+    int64_t now_ns = now().nanoseconds();
+
+    DronePose pose;
+    pose.fromMsg(msg->pose.pose);
+    if (cxt_.predict_odom_) {
+      pose = predictor_.predict(pose, PoseUtil::to_ns(msg->header.stamp), now_ns);
+    }
+
+    // Reuse the message, nothing is allocated on the hot path
+    predicted_odom_->header.frame_id = msg->header.frame_id;
+    predicted_odom_->header.stamp = rclcpp::Time(now_ns, RCL_ROS_TIME);
+    predicted_odom_->twist = msg->twist;
+    pose.toMsg(predicted_odom_->pose.pose);
+    return predicted_odom_;
   }
 
   void DroneBase::plan_callback(nav_msgs::msg::Path::SharedPtr msg)
   {
+    if (trace_) {
+      trace_->record(TraceEvent::plan_received);
+    }
+
+    // The deadline offsets depend on the learned timing, read them under the lock
+    int64_t fc_offset_ns, shadow_offset_ns = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!mission_) {
+        return;
+      }
+      fc_offset_ns = controller().deadline_offset_ns();
+      if (shadow_fc_) {
+        shadow_offset_ns = shadow_fc_->deadline_offset_ns();
+      }
+    }
+
+    // Convert the plan without holding up the control group, fc_ and shadow_fc_ can't change in between
+    // because they are only replaced in this callback group
+    fc_plan_.build(msg, fc_offset_ns);
+    if (shadow_fc_) {
+      shadow_plan_.build(msg, shadow_offset_ns);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
     if (mission_) {
       RCLCPP_INFO(get_logger(), "Got plan with %d waypoints, plan msg time %ld, last odom time %ld, ros time %ld ",
                   msg->poses.size(), RCL_NS_TO_MS(rclcpp::Time(msg->header.stamp).nanoseconds()),
                   RCL_NS_TO_MS(odom_time_.nanoseconds()), RCL_NS_TO_MS(now().nanoseconds()));
-      fc_->set_plan(msg);
+      fc_->set_plan(fc_plan_);
+      if (shadow_fc_) {
+        shadow_fc_->set_plan(shadow_plan_);
+      }
     }
   }
 
-  void DroneBase::start_action(Action action)
+  void DroneBase::compact_plan_callback(flock2::msg::CompactPlan::SharedPtr msg)
   {
-    if (action_mgr_->busy()) {
-      RCLCPP_INFO(get_logger(), "busy, dropping %s", g_actions[action]);
+    if (!valid_compact(*msg)) {
+      RCLCPP_ERROR(get_logger(), "compact plan arrays have different lengths, ignoring it");
+      return;
+    }
+
+    if (msg->first_index == 0 && msg->end_of_plan) {
+      auto path = std::make_shared<nav_msgs::msg::Path>();
+      (void) from_compact(*msg, *path);
+      plan_callback(path);
       return;
     }
 
+    if (trace_ && msg->first_index == 0) {
+      trace_->record(TraceEvent::plan_received);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (mission_) {
+      RCLCPP_DEBUG(get_logger(), "Got plan window %u+%lu%s", msg->first_index, msg->dt_ms.size(),
+                   msg->end_of_plan ? ", end of plan" : "");
+      if (!controller().set_plan_window(*msg, cxt_.plan_ring_size_)) {
+        RCLCPP_ERROR(get_logger(), "can't use plan window %u+%lu, check %s and plan_ring_size",
+                     msg->first_index, msg->dt_ms.size(), cxt_.flight_controller_.c_str());
+      }
+      if (shadow_fc_) {
+        shadow_fc_->set_plan_window(*msg, cxt_.plan_ring_size_);
+      }
+    }
+  }
+
+  void DroneBase::start_action(Action action)
+  {
+    // Land preempts everything, the other actions wait their turn
+    bool preempt = action == Action::land;
+
+    // Check the action against the state we'll be in when it runs
+    State state = preempt ? state_ : expected_state();
     State next_state;
-    if (!valid_action_transition(state_, action, next_state)) {
-      RCLCPP_DEBUG(get_logger(), "%s not allowed in %s", g_actions[action], g_states[state_]);
+    if (!valid_action_transition(state, action, next_state) &&
+        !(preempt && action_mgr_->busy())) {
+      RCLCPP_DEBUG(get_logger(), "%s not allowed in %s", name(action), name(state));
       return;
     }
 
-    RCLCPP_INFO(get_logger(), "in state '%s', initiating action '%s'", g_states[state_], g_actions[action]);
-    action_mgr_->send(action, g_actions[action]);
+    RCLCPP_INFO(get_logger(), "in state '%s', %s action '%s'", name(state_),
+                action_mgr_->busy() ? "queueing" : "initiating", name(action));
+    action_mgr_->send(action, name(action), cxt_.action_timeout_sec_,
+                      std::bind(&DroneBase::action_callback, this, std::placeholders::_1, std::placeholders::_2,
+                                std::placeholders::_3), preempt);
+  }
+
+  void DroneBase::action_callback(Action action, ActionMgr::State state, const std::string &result)
+  {
+    if (state == ActionMgr::State::succeeded) {
+      transition_state(action);
+    } else {
+      RCLCPP_INFO(get_logger(), "action '%s' didn't succeed: %s", name(action), result.c_str());
+    }
+
+    // Send the stick that was held during the actions
+    if (manual_pending_ && action_mgr_->pending().empty()) {
+      manual_pending_ = false;
+      if (!mission_ && (state_ == State::flight || state_ == State::flight_odom)) {
+        publish_manual();
+      }
+    }
+  }
+
+  State DroneBase::expected_state()
+  {
+    // Assume the pending actions succeed
+    State state = state_;
+    for (auto action : action_mgr_->pending()) {
+      State next_state;
+      if (valid_action_transition(state, action, next_state)) {
+        state = next_state;
+      }
+    }
+    return state;
   }
 
   void DroneBase::transition_state(Action action)
   {
     State next_state;
     if (!valid_action_transition(state_, action, next_state)) {
-      RCLCPP_DEBUG(get_logger(), "%s not allowed in %s", g_actions[action], g_states[state_]);
+      RCLCPP_DEBUG(get_logger(), "%s not allowed in %s", name(action), name(state_));
       return;
     }
 
@@ -410,7 +994,7 @@ namespace drone_base
   {
     State next_state;
     if (!valid_event_transition(state_, event, next_state)) {
-      RCLCPP_DEBUG(get_logger(), "%s not allowed in %s", g_events[event], g_states[state_]);
+      RCLCPP_DEBUG(get_logger(), "%s not allowed in %s", name(event), name(state_));
       return;
     }
 
@@ -420,50 +1004,28 @@ namespace drone_base
   void DroneBase::transition_state(State next_state)
   {
     if (state_ != next_state) {
-      RCLCPP_INFO(get_logger(), "transition from '%s' to '%s'", g_states[state_], g_states[next_state]);
+      RCLCPP_INFO(get_logger(), "transition from '%s' to '%s'", name(state_), name(next_state));
       state_ = next_state;
+      publish_state();
     }
   }
 
+  void DroneBase::publish_state()
+  {
+    std_msgs::msg::UInt8 msg;
+    msg.data = static_cast<uint8_t>(idx(state_));
+    state_pub_->publish(msg);
+  }
+
   void DroneBase::all_stop()
   {
     RCLCPP_DEBUG(get_logger(), "ALL STOP");
-    fc_->publish_velocity(0, 0, 0, 0);
+    // Without a controller nothing has been sent on cmd_vel yet
+    if (fc_) {
+      fc_->publish_velocity(0, 0, 0, 0);
+    }
   }
 
 } // namespace drone_base
 
-//=============================================================================
-// main
-//=============================================================================
-
-int main(int argc, char **argv)
-{
-  // Force flush of the stdout buffer
-  setvbuf(stdout, nullptr, _IONBF, BUFSIZ);
-
-  // Init ROS
-  rclcpp::init(argc, argv);
-
-  // Create node
-  auto node = std::make_shared<drone_base::DroneBase>();
-  //auto result = rcutils_logging_set_logger_level(node->get_logger().get_name(), RCUTILS_LOG_SEVERITY_INFO);
-
-  // rclcpp::Rate uses std::chrono::system_clock, so doesn't honor use_sim_time
-  rclcpp::Rate r(drone_base::SPIN_RATE);
-  while (rclcpp::ok()) {
-    // Do our work
-    node->spin_once();
-
-    // Respond to incoming messages
-    rclcpp::spin_some(node);
-
-    // Wait
-    r.sleep();
-  }
-
-  // Shut down ROS
-  rclcpp::shutdown();
-
-  return 0;
-}
+RCLCPP_COMPONENTS_REGISTER_NODE(drone_base::DroneBase)
@@ -0,0 +1,67 @@
+#include "drone_base.hpp"
+#include "param_snapshot.hpp"
+
+//=============================================================================
+// main
+//
+// Usage: drone_base [--write-params drone_base.yaml]
+//
+// --write-params creates the controllers, writes every parameter to the file and exits.
+// Start later runs with --ros-args --params-file drone_base.yaml
+//=============================================================================
+
+int main(int argc, char **argv)
+{
+  // Force flush of the stdout buffer
+  setvbuf(stdout, nullptr, _IONBF, BUFSIZ);
+
+  // Init ROS
+  rclcpp::init(argc, argv);
+
+  std::string snapshot;
+  auto args = rclcpp::remove_ros_arguments(argc, argv);
+  for (size_t i = 1; i < args.size(); i++) {
+    if (args[i] == "--write-params" && i + 1 < args.size()) {
+      snapshot = args[++i];
+    }
+  }
+
+  // Create node
+  auto node = std::make_shared<drone_base::DroneBase>();
+  //auto result = rcutils_logging_set_logger_level(node->get_logger().get_name(), RCUTILS_LOG_SEVERITY_INFO);
+
+  if (!snapshot.empty()) {
+    node->create_controllers();
+    bool ok = drone_base::write_param_snapshot(*node, snapshot);
+    if (ok) {
+      RCLCPP_INFO(node->get_logger(), "parameters written to %s", snapshot.c_str());
+    } else {
+      RCLCPP_ERROR(node->get_logger(), "can't write %s", snapshot.c_str());
+    }
+    rclcpp::shutdown();
+    return ok ? 0 : 1;
+  }
+
+  if (node->event_driven()) {
+    // Callbacks run as messages arrive, spin_once runs on a timer
+    rclcpp::spin(node);
+  } else {
+    // rclcpp::Rate uses std::chrono::system_clock, so doesn't honor use_sim_time
+    rclcpp::Rate r(drone_base::SPIN_RATE);
+    while (rclcpp::ok()) {
+      // Do our work
+      node->spin_once();
+
+      // Respond to incoming messages
+      rclcpp::spin_some(node);
+
+      // Wait
+      r.sleep();
+    }
+  }
+
+  // Shut down ROS
+  rclcpp::shutdown();
+
+  return 0;
+}
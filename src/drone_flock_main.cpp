@@ -0,0 +1,92 @@
+#include "drone_base.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <iostream>
+#include <sstream>
+
+//=============================================================================
+// Run one DroneBase per namespace in a single process, on a MultiThreadedExecutor
+//
+// Usage: drone_flock [--threads N] [--cpus 2,3] drone1 drone2 ...
+//
+// Each DroneBase puts odom, flight_data and tello_response in its own mutually exclusive callback group,
+// so the executor threads can run the control loops of different drones in parallel.
+// If --cpus is given the executor threads are pinned to that set of CPUs.
+//=============================================================================
+
+namespace
+{
+
+  // Pin the calling thread, and all threads it creates later, to a set of CPUs
+  bool pin_to_cpus(const std::string &cpus)
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    std::stringstream ss(cpus);
+    std::string cpu;
+    while (std::getline(ss, cpu, ',')) {
+      CPU_SET(std::stoi(cpu), &set);
+    }
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+  }
+
+}
+
+int main(int argc, char **argv)
+{
+  // Force flush of the stdout buffer
+  setvbuf(stdout, nullptr, _IONBF, BUFSIZ);
+
+  // Init ROS
+  rclcpp::init(argc, argv);
+
+  // Parse the non-ROS arguments
+  size_t num_threads = 0;   // 0: one per core
+  std::string cpus;
+  std::vector<std::string> namespaces;
+  auto args = rclcpp::remove_ros_arguments(argc, argv);
+  for (size_t i = 1; i < args.size(); i++) {
+    if (args[i] == "--threads" && i + 1 < args.size()) {
+      num_threads = std::stoul(args[++i]);
+    } else if (args[i] == "--cpus" && i + 1 < args.size()) {
+      cpus = args[++i];
+    } else {
+      namespaces.push_back(args[i]);
+    }
+  }
+
+  if (namespaces.empty()) {
+    namespaces.push_back("solo");
+  }
+
+  // Threads inherit the affinity of the thread that creates them
+  if (!cpus.empty() && !pin_to_cpus(cpus)) {
+    std::cerr << "can't pin to cpus " << cpus << std::endl;
+    return 1;
+  }
+
+  // Create nodes, there's no polling loop so run them in event-driven mode
+  rclcpp::executors::MultiThreadedExecutor executor(rclcpp::executor::ExecutorArgs(), num_threads);
+  std::vector<std::shared_ptr<drone_base::DroneBase>> nodes;
+  for (auto &ns : namespaces) {
+    auto options = rclcpp::NodeOptions()
+      .use_intra_process_comms(true)
+      .arguments({"--ros-args", "-r", "__ns:=/" + ns})
+      .parameter_overrides({rclcpp::Parameter("event_driven", 1)});
+    nodes.push_back(std::make_shared<drone_base::DroneBase>(options));
+    executor.add_node(nodes.back());
+  }
+
+  std::cout << namespaces.size() << " drones, " << executor.get_number_of_threads() << " threads" << std::endl;
+
+  executor.spin();
+
+  // Shut down ROS
+  rclcpp::shutdown();
+
+  return 0;
+}
@@ -13,12 +13,18 @@ namespace drone_base
     FlightControllerInterface(node, cmd_vel_pub)
   {
 #undef CXT_MACRO_MEMBER
-#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOAD_PARAMETER(node_, (*this), n, t, d)
+#define CXT_MACRO_MEMBER(n, t, d) FC_MACRO_LOAD_PARAMETER(node_, (*this), n, t, d)
     CXT_MACRO_INIT_PARAMETERS(BASIC_CONTROLLER_ALL_PARAMS, validate_parameters)
 
 #undef CXT_MACRO_MEMBER
 #define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_PARAMETER_CHANGED((*this), n, t)
-    CXT_MACRO_REGISTER_PARAMETERS_CHANGED(node, BASIC_CONTROLLER_ALL_PARAMS, validate_parameters)
+    CXT_MACRO_REGISTER_PARAMETERS_CHANGED(parameters_callback_, BASIC_CONTROLLER_ALL_PARAMS, validate_parameters)
+    created_ = true;
+
+    controller_.set_coefficients(pid::X, 0.1, 0, 0);
+    controller_.set_coefficients(pid::Y, 0.1, 0, 0);
+    controller_.set_coefficients(pid::Z, 0.1, 0, 0);
+    controller_.set_coefficients(pid::YAW, 0.2, 0, 0);
 
     _reset();
   }
@@ -27,16 +33,35 @@ namespace drone_base
   {
     stabilize_time_ = rclcpp::Duration(static_cast<int64_t>(RCL_S_TO_NS(stabilize_time_sec_)));
 
-    RCLCPP_INFO(node_.get_logger(), "FlightControllerSimple Parameters");
+    // drone_base creates the controllers at the first plan, keep that quiet
+    if (created_) {
+      RCLCPP_INFO(node_.get_logger(), "FlightControllerSimple Parameters");
 
 #undef CXT_MACRO_MEMBER
 #define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOG_PARAMETER(RCLCPP_INFO, node_.get_logger(), (*this), n, t, d)
-    BASIC_CONTROLLER_ALL_PARAMS
+      BASIC_CONTROLLER_ALL_PARAMS
+    } else {
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOG_PARAMETER(RCLCPP_DEBUG, node_.get_logger(), (*this), n, t, d)
+      BASIC_CONTROLLER_ALL_PARAMS
+    }
+  }
+
+  // Reach each waypoint this long before its timestamp, leaving time to settle
+  int64_t FlightControllerBasic::_deadline_offset_ns() const
+  {
+    if (!adaptive_stabilize_ || !timing_) {
+      return stabilize_time_.nanoseconds();
+    }
+
+    double max_sec = stabilize_time_sec_;
+    double sec = timing_->settle.bound(timing_sigmas_, max_sec) + timing_->odom_lag.bound(timing_sigmas_, 0);
+    return static_cast<int64_t>(RCL_S_TO_NS(PoseUtil::clamp(sec, min_stabilize_time_sec_, max_sec)));
   }
 
   void FlightControllerBasic::_reset()
   {
-    last_odom_time_ = rclcpp::Time();
+    last_odom_ns_ = 0;
   }
 
   void FlightControllerBasic::_set_target(int target)
@@ -44,13 +69,34 @@ namespace drone_base
     target_ = target;
 
     // Handle "done" case
-    if (target_ < 0 || target_ >= plan_.poses.size()) {
+    if (target_ < 0 || target_ >= plan_.size()) {
       return;
     }
 
+    if (target_ == 0) {
+      // The plan was just built with this offset
+      offset_ns_ = _deadline_offset_ns();
+
+      // A replan puts the current pose at waypoint 0, timestamped now: don't stop there, keep flying the
+      // current segment
+      if (plan_.size() > 1 && plan_[0].end_ns + offset_ns_ <= node_.now().nanoseconds()) {
+        target_ = 1;
+      }
+    }
+
+    // Everything was converted when the plan arrived
+    const PlanSegment &segment = plan_[target_];
+    settled_ = false;
+
+    if (target_ == 0 && adaptive_stabilize_ && timing_) {
+      RCLCPP_INFO(node_.get_logger(), "stabilize %.2fs, settle mean %.2fs from %lu waypoint(s), odom lag mean %.3fs",
+                  static_cast<double>(offset_ns_) / 1e9, timing_->settle.mean(),
+                  timing_->settle.count(), timing_->odom_lag.mean());
+    }
+
     // Set current target
-    curr_target_.fromMsg(plan_.poses[target_].pose);
-    curr_target_time_ = rclcpp::Time(plan_.poses[target_].header.stamp) - stabilize_time_;
+    curr_target_ = segment.end;
+    curr_target_ns_ = segment.end_ns;
 
     RCLCPP_INFO(node_.get_logger(), "target %d position: (%g, %g, %g), yaw %g, time %12ld",
                 target_,
@@ -58,88 +104,88 @@ namespace drone_base
                 curr_target_.y,
                 curr_target_.z,
                 curr_target_.yaw,
-                RCL_NS_TO_MS(curr_target_time_.nanoseconds()));
+                RCL_NS_TO_MS(curr_target_ns_));
 
     // Set previous target, as well as velocity
+    prev_target_ = segment.start;
+    vx_ = segment.vx;
+    vy_ = segment.vy;
+    vz_ = segment.vz;
+    vyaw_ = segment.vyaw;
+
     if (target_ == 0) {
       // Takeoff case
-      prev_target_ = curr_target_;
-      prev_target_time_ = node_.now();
-      vx_ = vy_ = vz_ = vyaw_ = 0;
+      prev_target_ns_ = node_.now().nanoseconds();
     } else {
       // Typical case
-      prev_target_.fromMsg(plan_.poses[target_ - 1].pose);
-      prev_target_time_ = rclcpp::Time(plan_.poses[target_ - 1].header.stamp);
-
-      auto flight_time = (curr_target_time_ - prev_target_time_).seconds();
-      assert(flight_time > 0);
-
-      // Velocity vector from previous target to this target
-      vx_ = (curr_target_.x - prev_target_.x) / flight_time;
-      vy_ = (curr_target_.y - prev_target_.y) / flight_time;
-      vz_ = (curr_target_.z - prev_target_.z) / flight_time;
-      vyaw_ = PoseUtil::norm_angle(curr_target_.yaw - prev_target_.yaw) / flight_time;
+      prev_target_ns_ = segment.start_ns;
 
       RCLCPP_INFO(node_.get_logger(), "target %d velocity: (%g, %g, %g), yaw %g", target_, vx_, vy_, vz_, vyaw_);
     }
 
     // Initialize PID controllers to previous target, these will be updated in the odom callback
-    x_controller_.set_target(prev_target_.x);
-    y_controller_.set_target(prev_target_.y);
-    z_controller_.set_target(prev_target_.z);
-    yaw_controller_.set_target(prev_target_.yaw);
+    controller_.set_target(0, pid::X, prev_target_.x);
+    controller_.set_target(0, pid::Y, prev_target_.y);
+    controller_.set_target(0, pid::Z, prev_target_.z);
+    controller_.set_target(0, pid::YAW, prev_target_.yaw);
   }
 
   bool FlightControllerBasic::_odom_callback(const nav_msgs::msg::Odometry::SharedPtr &msg)
   {
     bool retVal = false;
 
-    rclcpp::Time msg_time(msg->header.stamp);
+    int64_t msg_ns = PoseUtil::to_ns(msg->header.stamp);
 
-    if (PoseUtil::is_valid_time(last_odom_time_)) {
-      if (msg_time > curr_target_time_ + stabilize_time_) {
-        if (curr_target_.close_enough(last_pose_)) {
-          // Advance to the next target
-          set_target(target_ + 1);
-        } else {
-          // Timeout
-          retVal = true;
-        }
+    if (last_odom_ns_ > 0) {
+      // Learn how long it takes to settle after the deadline
+      if (timing_ && !settled_ && msg_ns > curr_target_ns_ && curr_target_.close_enough(last_pose_)) {
+        timing_->settle.add(static_cast<double>(msg_ns - curr_target_ns_) / 1e9);
+        settled_ = true;
+      }
+
+      if (msg_ns > curr_target_ns_ + offset_ns_ && curr_target_.close_enough(last_pose_)) {
+        // Advance to the next target at the waypoint timestamp
+        set_target(target_ + 1);
+      } else if (msg_ns > curr_target_ns_ + stabilize_time_.nanoseconds()) {
+        // Timeout
+        retVal = true;
       } else {
         // Compute expected position and set PID targets
-        // The odom pipeline has a lag, so ignore messages that are older than prev_target_time_
-        if (msg_time < curr_target_time_ && msg_time > prev_target_time_) {
-          auto elapsed_time = (msg_time - prev_target_time_).seconds();
-          x_controller_.set_target(prev_target_.x + vx_ * elapsed_time);
-          y_controller_.set_target(prev_target_.y + vy_ * elapsed_time);
-          z_controller_.set_target(prev_target_.z + vz_ * elapsed_time);
-          yaw_controller_.set_target(PoseUtil::norm_angle(prev_target_.yaw + vyaw_ * elapsed_time));
+        // The odom pipeline has a lag (unless drone_base predicts odometry), so ignore messages that are
+        // older than prev_target_ns_
+        if (msg_ns < curr_target_ns_ && msg_ns > prev_target_ns_) {
+          auto elapsed_time = static_cast<double>(msg_ns - prev_target_ns_) / 1e9;
+          controller_.set_target(0, pid::X, prev_target_.x + vx_ * elapsed_time);
+          controller_.set_target(0, pid::Y, prev_target_.y + vy_ * elapsed_time);
+          controller_.set_target(0, pid::Z, prev_target_.z + vz_ * elapsed_time);
+          controller_.set_target(0, pid::YAW, PoseUtil::norm_angle(prev_target_.yaw + vyaw_ * elapsed_time));
         }
 
+        DronePose reference;
+        reference.x = controller_.target(0, pid::X);
+        reference.y = controller_.target(0, pid::Y);
+        reference.z = controller_.target(0, pid::Z);
+        reference.yaw = controller_.target(0, pid::YAW);
+        set_tracking_error(reference, last_pose_);
+
         // Compute velocity
-        auto dt = (msg_time - last_odom_time_).seconds();
-        double ubar_x = x_controller_.calc(last_pose_.x, dt, 0);
-        double ubar_y = y_controller_.calc(last_pose_.y, dt, 0);
-        double ubar_z = z_controller_.calc(last_pose_.z, dt, 0);
-        double ubar_yaw = yaw_controller_.calc(last_pose_.yaw, dt, 0);
+        auto dt = static_cast<double>(msg_ns - last_odom_ns_) / 1e9;
+        double state[pid::NUM_AXES] = {last_pose_.x, last_pose_.y, last_pose_.z, last_pose_.yaw};
+        double ubar[pid::NUM_AXES];
+        controller_.calc(state, dt, ubar);
 
         // Rotate ubar_x and ubar_y into the body frame
         double throttle, strafe;
-        PoseUtil::rotate_frame(ubar_x, ubar_y, last_pose_.yaw, throttle, strafe);
+        PoseUtil::rotate_frame(ubar[pid::X], ubar[pid::Y], last_pose_.yaw, throttle, strafe);
 
-//      RCLCPP_INFO(node_.get_logger(), "%12ld "
-//                  "x controller: target %7.3f, curr %7.3f, throttle %7.3f "
-//                  "y controller: target %7.3f, curr %7.3f, strafe %7.3f",
-//                  RCL_NS_TO_MS(msg_time.nanoseconds()),
-//                  x_controller_.target(), last_pose_.x, throttle,
-//                  y_controller_.target(), last_pose_.y, strafe);
+        record_telemetry(msg_ns, dt, reference, last_pose_, throttle, strafe, ubar[pid::Z], ubar[pid::YAW]);
 
         // Publish velocity
-        publish_velocity(throttle, strafe, ubar_z, ubar_yaw);
+        publish_control(throttle, strafe, ubar[pid::Z], ubar[pid::YAW]);
       }
     }
 
-    last_odom_time_ = msg_time;
+    last_odom_ns_ = msg_ns;
     last_pose_.fromMsg(msg->pose.pose);
     return retVal;
   }
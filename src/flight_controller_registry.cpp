@@ -0,0 +1,63 @@
+#include "flight_controller_registry.hpp"
+
+#include "flight_controller_basic.hpp"
+#include "flight_controller_simple.hpp"
+#include "flight_controller_trajectory.hpp"
+
+namespace drone_base
+{
+
+  template<typename T>
+  FlightControllerFactory factory()
+  {
+    return [](rclcpp::Node &node, rclcpp::Publisher<geometry_msgs::msg::Twist>::SharedPtr &cmd_vel_pub)
+    {
+      return std::unique_ptr<FlightControllerInterface>(std::make_unique<T>(node, cmd_vel_pub));
+    };
+  }
+
+  FlightControllerRegistry::FlightControllerRegistry()
+  {
+    add("basic", factory<FlightControllerBasic>());
+    add("simple", factory<FlightControllerSimple>());
+    add("trajectory", factory<FlightControllerTrajectory>());
+  }
+
+  FlightControllerRegistry &FlightControllerRegistry::instance()
+  {
+    static FlightControllerRegistry registry;
+    return registry;
+  }
+
+  void FlightControllerRegistry::add(const std::string &name, FlightControllerFactory factory)
+  {
+    factories_[name] = std::move(factory);
+  }
+
+  bool FlightControllerRegistry::has(const std::string &name) const
+  {
+    return factories_.find(name) != factories_.end();
+  }
+
+  std::unique_ptr<FlightControllerInterface> FlightControllerRegistry::create(
+    const std::string &name, rclcpp::Node &node, rclcpp::Publisher<geometry_msgs::msg::Twist>::SharedPtr &cmd_vel_pub) const
+  {
+    auto i = factories_.find(name);
+    if (i == factories_.end()) {
+      return nullptr;
+    }
+    return i->second(node, cmd_vel_pub);
+  }
+
+  std::string FlightControllerRegistry::names() const
+  {
+    std::string result;
+    for (auto &i : factories_) {
+      if (!result.empty()) {
+        result += ", ";
+      }
+      result += i.first;
+    }
+    return result;
+  }
+}
@@ -8,12 +8,13 @@ namespace drone_base
     FlightControllerInterface(node, cmd_vel_pub)
   {
 #undef CXT_MACRO_MEMBER
-#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOAD_PARAMETER(node_, (*this), n, t, d)
+#define CXT_MACRO_MEMBER(n, t, d) FC_MACRO_LOAD_PARAMETER(node_, (*this), n, t, d)
     CXT_MACRO_INIT_PARAMETERS(SIMPLE_CONTROLLER_ALL_PARAMS, validate_parameters)
 
 #undef CXT_MACRO_MEMBER
 #define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_PARAMETER_CHANGED((*this), n, t)
-    CXT_MACRO_REGISTER_PARAMETERS_CHANGED(node, SIMPLE_CONTROLLER_ALL_PARAMS, validate_parameters)
+    CXT_MACRO_REGISTER_PARAMETERS_CHANGED(parameters_callback_, SIMPLE_CONTROLLER_ALL_PARAMS, validate_parameters)
+    created_ = true;
 
     _reset();
   }
@@ -21,21 +22,28 @@ namespace drone_base
   void FlightControllerSimple::validate_parameters()
   {
     stabilize_time_ = rclcpp::Duration(static_cast<int64_t>(RCL_S_TO_NS(stabilize_time_sec_)));
-    x_controller_.set_coefficients(pid_x_kp_, pid_x_kd_);
-    y_controller_.set_coefficients(pid_y_kp_, pid_y_kd_);
-    z_controller_.set_coefficients(pid_z_kp_, pid_z_kd_);
-    yaw_controller_.set_coefficients(pid_yaw_kp_, pid_yaw_kd_);
+    controller_.set_coefficients(pid::X, pid_x_kp_, 0, pid_x_kd_);
+    controller_.set_coefficients(pid::Y, pid_y_kp_, 0, pid_y_kd_);
+    controller_.set_coefficients(pid::Z, pid_z_kp_, 0, pid_z_kd_);
+    controller_.set_coefficients(pid::YAW, pid_yaw_kp_, 0, pid_yaw_kd_);
 
-    RCLCPP_INFO(node_.get_logger(), "FlightControllerSimple Parameters");
+    // drone_base creates the controllers at the first plan, keep that quiet
+    if (created_) {
+      RCLCPP_INFO(node_.get_logger(), "FlightControllerSimple Parameters");
 
 #undef CXT_MACRO_MEMBER
 #define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOG_PARAMETER(RCLCPP_INFO, node_.get_logger(), (*this), n, t, d)
-    SIMPLE_CONTROLLER_ALL_PARAMS
+      SIMPLE_CONTROLLER_ALL_PARAMS
+    } else {
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOG_PARAMETER(RCLCPP_DEBUG, node_.get_logger(), (*this), n, t, d)
+      SIMPLE_CONTROLLER_ALL_PARAMS
+    }
   }
 
   void FlightControllerSimple::_reset()
   {
-    last_odom_time_ = rclcpp::Time();
+    last_odom_ns_ = 0;
   }
 
   void FlightControllerSimple::_set_target(int target)
@@ -43,13 +51,18 @@ namespace drone_base
     target_ = target;
 
     // Handle "done" case
-    if (target_ < 0 || target_ >= plan_.poses.size()) {
+    if (target_ < 0 || target_ >= plan_.size()) {
       return;
     }
 
-    // Set current target
-    curr_target_.fromMsg(plan_.poses[target_].pose);
-    curr_target_time_ = rclcpp::Time(plan_.poses[target_].header.stamp);
+    // Set current target, converted when the plan arrived
+    curr_target_ = plan_[target_].end;
+    curr_target_ns_ = plan_[target_].end_ns;
+
+    controller_.set_target(0, pid::X, curr_target_.x);
+    controller_.set_target(0, pid::Y, curr_target_.y);
+    controller_.set_target(0, pid::Z, curr_target_.z);
+    controller_.set_target(0, pid::YAW, curr_target_.yaw);
 
     RCLCPP_INFO(node_.get_logger(), "target %d position: (%g, %g, %g), yaw %g, time %12ld",
                 target_,
@@ -57,21 +70,21 @@ namespace drone_base
                 curr_target_.y,
                 curr_target_.z,
                 curr_target_.yaw,
-                RCL_NS_TO_MS(curr_target_time_.nanoseconds()));
+                RCL_NS_TO_MS(curr_target_ns_));
   }
 
   bool FlightControllerSimple::_odom_callback(const nav_msgs::msg::Odometry::SharedPtr &msg)
   {
     bool retVal = false;
 
-    rclcpp::Time msg_time(msg->header.stamp);
+    int64_t msg_ns = PoseUtil::to_ns(msg->header.stamp);
     DronePose pose;
     pose.fromMsg(msg->pose.pose);
 
-    if (PoseUtil::is_valid_time(last_odom_time_) && msg_time > last_odom_time_) {
+    if (last_odom_ns_ > 0 && msg_ns > last_odom_ns_) {
 
       // Check if we have reached the target or exceeded the stabilize time.
-      if (msg_time > curr_target_time_) {
+      if (msg_ns > curr_target_ns_) {
 
         // For now ignore yaw and z.
         DronePose test_pose{pose};
@@ -81,7 +94,7 @@ namespace drone_base
         if (curr_target_.close_enough(test_pose, close_enough_xyz_, close_enough_yaw_)) {
           // Advance to the next target
           set_target(target_ + 1);
-        } else if (msg_time > curr_target_time_ + stabilize_time_) {
+        } else if (msg_ns > curr_target_ns_ + stabilize_time_.nanoseconds()) {
           // Timeout
           retVal = true;
         }
@@ -89,33 +102,32 @@ namespace drone_base
 
       // Send move command as generated by the controller.
       if (!retVal) {
-        auto dt = (msg_time - last_odom_time_).seconds();
+        set_tracking_error(curr_target_, pose);
+
+        auto dt = static_cast<double>(msg_ns - last_odom_ns_) / 1e9;
         auto x_dot_actual = (pose.x - last_pose_.x) / dt;
         auto y_dot_actual = (pose.y - last_pose_.y) / dt;
         auto z_dot_actual = (pose.z - last_pose_.z) / dt;
         auto yaw_dot_actual = (pose.yaw - last_pose_.yaw) / dt;
-        double ubar_x = x_controller_.calc(curr_target_.x, pose.x, 0., x_dot_actual);
-        double ubar_y = y_controller_.calc(curr_target_.y, pose.y, 0., y_dot_actual);
-        double ubar_z = z_controller_.calc(curr_target_.z, pose.z, 0., z_dot_actual);
-        double ubar_yaw = yaw_controller_.calc(curr_target_.yaw, pose.yaw, 0., yaw_dot_actual);
+        double actual[pid::NUM_AXES] = {pose.x, pose.y, pose.z, pose.yaw};
+        double dot_target[pid::NUM_AXES] = {0., 0., 0., 0.};
+        double dot_actual[pid::NUM_AXES] = {x_dot_actual, y_dot_actual, z_dot_actual, yaw_dot_actual};
+        double ubar[pid::NUM_AXES];
+        controller_.calc(actual, dot_target, dot_actual, ubar);
 
         // Rotate ubar_x and ubar_y into the body frame
         double throttle, strafe;
-        PoseUtil::rotate_frame(ubar_x, ubar_y, pose.yaw, throttle, strafe);
+        PoseUtil::rotate_frame(ubar[pid::X], ubar[pid::Y], pose.yaw, throttle, strafe);
 
-        RCLCPP_INFO(node_.get_logger(), "%12ld "
-                                        "x: targ %7.3f, curr %7.3f, throttle %7.3f "
-                                        "y: targ %7.3f, curr %7.3f, strafe %7.3f",
-                    RCL_NS_TO_MS(msg_time.nanoseconds()),
-                    curr_target_.x, pose.x, throttle,
-                    curr_target_.y, pose.y, strafe);
+        record_telemetry(msg_ns, dt, curr_target_, pose,
+                         throttle, strafe, ubar[pid::Z], ubar[pid::YAW]);
 
         // Publish velocity
-        publish_velocity(throttle, strafe, ubar_z, ubar_yaw);
+        publish_control(throttle, strafe, ubar[pid::Z], ubar[pid::YAW]);
       }
     }
 
-    last_odom_time_ = msg_time;
+    last_odom_ns_ = msg_ns;
     last_pose_ = pose;
 
     return retVal;
@@ -0,0 +1,149 @@
+#include "flight_controller_trajectory.hpp"
+
+namespace drone_base
+{
+
+//=============================================================================
+// FlightControllerTrajectory
+//=============================================================================
+
+  FlightControllerTrajectory::FlightControllerTrajectory(
+    rclcpp::Node &node, rclcpp::Publisher<geometry_msgs::msg::Twist>::SharedPtr &cmd_vel_pub) :
+    FlightControllerInterface(node, cmd_vel_pub)
+  {
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) FC_MACRO_LOAD_PARAMETER(node_, (*this), n, t, d)
+    CXT_MACRO_INIT_PARAMETERS(TRAJECTORY_CONTROLLER_ALL_PARAMS, validate_parameters)
+
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_PARAMETER_CHANGED((*this), n, t)
+    CXT_MACRO_REGISTER_PARAMETERS_CHANGED(parameters_callback_, TRAJECTORY_CONTROLLER_ALL_PARAMS, validate_parameters)
+    created_ = true;
+
+    _reset();
+  }
+
+  void FlightControllerTrajectory::validate_parameters()
+  {
+    stabilize_time_ = rclcpp::Duration(static_cast<int64_t>(RCL_S_TO_NS(stabilize_time_sec_)));
+    controller_.set_coefficients(pid::X, traj_xy_kp_, 0, traj_xy_kd_);
+    controller_.set_coefficients(pid::Y, traj_xy_kp_, 0, traj_xy_kd_);
+    controller_.set_coefficients(pid::Z, traj_z_kp_, 0, traj_z_kd_);
+    controller_.set_coefficients(pid::YAW, traj_yaw_kp_, 0, traj_yaw_kd_);
+
+    // drone_base creates the controllers at the first plan, keep that quiet
+    if (created_) {
+      RCLCPP_INFO(node_.get_logger(), "FlightControllerTrajectory Parameters");
+
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOG_PARAMETER(RCLCPP_INFO, node_.get_logger(), (*this), n, t, d)
+      TRAJECTORY_CONTROLLER_ALL_PARAMS
+    } else {
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOG_PARAMETER(RCLCPP_DEBUG, node_.get_logger(), (*this), n, t, d)
+      TRAJECTORY_CONTROLLER_ALL_PARAMS
+    }
+  }
+
+  void FlightControllerTrajectory::_reset()
+  {
+    last_odom_ns_ = 0;
+    cursor_ = 0;
+  }
+
+  void FlightControllerTrajectory::_set_target(int target)
+  {
+    target_ = target;
+
+    // A new plan: fit the spline once, every odom tick only evaluates it
+    if (target_ == 0 && plan_.msg()) {
+      if (!trajectory_.fit(*plan_.msg())) {
+        RCLCPP_ERROR(node_.get_logger(), "can't fit a trajectory to the plan");
+        target_ = plan_.size();
+        return;
+      }
+      cursor_ = 0;
+      end_ns_ = plan_[plan_.size() - 1].end_ns;
+
+      RCLCPP_INFO(node_.get_logger(), "trajectory with %d waypoints, %.1f seconds",
+                  plan_.size(), trajectory_.duration());
+    }
+  }
+
+  bool FlightControllerTrajectory::_odom_callback(const nav_msgs::msg::Odometry::SharedPtr &msg)
+  {
+    bool retVal = false;
+
+    int64_t msg_ns = PoseUtil::to_ns(msg->header.stamp);
+    DronePose pose;
+    pose.fromMsg(msg->pose.pose);
+
+    if (last_odom_ns_ > 0 && msg_ns > last_odom_ns_ && target_ < plan_.size()) {
+      // Track the waypoints passed, so is_plan_complete() works
+      while (target_ < plan_.size() - 1 && msg_ns > plan_[target_].end_ns) {
+        target_++;
+      }
+
+      if (msg_ns > end_ns_) {
+        if (plan_[target_].end.close_enough(pose)) {
+          // Done
+          target_ = plan_.size();
+          RCLCPP_INFO(node_.get_logger(), "trajectory complete");
+          last_odom_ns_ = msg_ns;
+          last_pose_ = pose;
+          return false;
+        } else if (msg_ns > end_ns_ + stabilize_time_.nanoseconds()) {
+          // Timeout
+          retVal = true;
+        }
+      }
+
+      if (!retVal) {
+        // O(1): the cursor starts at the segment used by the previous message
+        auto p = trajectory_.eval(msg_ns, cursor_);
+
+        controller_.set_target(0, pid::X, p.x);
+        controller_.set_target(0, pid::Y, p.y);
+        controller_.set_target(0, pid::Z, p.z);
+        controller_.set_target(0, pid::YAW, p.yaw);
+
+        DronePose reference;
+        reference.x = p.x;
+        reference.y = p.y;
+        reference.z = p.z;
+        reference.yaw = p.yaw;
+        set_tracking_error(reference, pose);
+
+        auto dt = static_cast<double>(msg_ns - last_odom_ns_) / 1e9;
+        double actual[pid::NUM_AXES] = {pose.x, pose.y, pose.z, pose.yaw};
+        double dot_target[pid::NUM_AXES] = {p.vx, p.vy, p.vz, p.vyaw};
+        double dot_actual[pid::NUM_AXES] = {
+          (pose.x - last_pose_.x) / dt,
+          (pose.y - last_pose_.y) / dt,
+          (pose.z - last_pose_.z) / dt,
+          PoseUtil::norm_angle(pose.yaw - last_pose_.yaw) / dt};
+        double ubar[pid::NUM_AXES];
+        controller_.calc(actual, dot_target, dot_actual, ubar);
+
+        // Feed forward the planned velocity
+        for (int i = 0; i < pid::NUM_AXES; i++) {
+          ubar[i] += traj_ff_ * dot_target[i];
+        }
+
+        // Rotate ubar_x and ubar_y into the body frame
+        double throttle, strafe;
+        PoseUtil::rotate_frame(ubar[pid::X], ubar[pid::Y], pose.yaw, throttle, strafe);
+
+        record_telemetry(msg_ns, dt, reference, pose, throttle, strafe, ubar[pid::Z], ubar[pid::YAW]);
+
+        // Publish velocity
+        publish_control(throttle, strafe, ubar[pid::Z], ubar[pid::YAW]);
+      }
+    }
+
+    last_odom_ns_ = msg_ns;
+    last_pose_ = pose;
+
+    return retVal;
+  }
+}
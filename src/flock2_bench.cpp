@@ -0,0 +1,745 @@
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+
+#include "rclcpp/rclcpp.hpp"
+#include "std_msgs/msg/u_int8.hpp"
+#include "flock2/msg/compact_plan.hpp"
+#include "flock2/msg/drone_status.hpp"
+
+#include "drone_base.hpp"
+#include "flock_sim.hpp"
+#include "plan_codec.hpp"
+#include "planner_node.hpp"
+#include "qos_profiles.hpp"
+
+//=============================================================================
+// Fly scripted missions end to end and report the numbers we want to track across releases
+//
+// Usage: flock2_bench [--drones 1,4,16,64] [--time-scale 4] [--timeout 1800] [--output flock2_bench.json]
+//                     [--baseline old.json] [--tolerance 0.2]
+//
+// Each flock size runs in a fresh child process, so its memory and CPU numbers don't include the earlier ones:
+//    flock_sim owns the clock, and runs time_scale times faster than the wall clock; lower it if the
+//    latencies grow with time_scale, the flock isn't keeping up
+//    planner_node and one drone_base per drone run with use_sim_time
+//    A monitor node waits for every drone to have odometry, sends /start_mission, and watches the mission
+//    The child sends its Result to the parent over a pipe
+//
+// drone_base runs event driven, so spin_once runs on a timer that honors use_sim_time; drone_base's own main()
+// polls with rclcpp::Rate, which doesn't.
+//
+// Reported per flock size, as JSON:
+//    plan_latency_ms         /start_mission to each drone's first plan, Path or CompactPlan, wall clock;
+//                            replans aren't counted
+//    takeoff_skew_sec        first to last drone airborne, sim time
+//    odom_to_cmd_vel_ms      base_odom to the next cmd_vel, wall clock, as seen by the monitor
+//    cpu_pct_per_drone       process CPU over the mission, divided by the number of drones, includes the
+//                            simulator and the planner
+//    peak_rss_kb             process VmHWM at the end of the mission, includes the simulator and the planner
+//    rss_kb_per_drone        VmHWM minus VmRSS before the nodes were created, divided by the number of drones
+//    reached                 drones that came within CLOSE_ENOUGH_XYZ of their final waypoint while flying
+//    completion_sec          /start_mission until every drone has flown and landed, sim time
+//
+// A mission is completed if every drone reached its final waypoint and landed, and nobody sent /stop_mission.
+// A drone that lands early, e.g., it lost odometry or didn't reach a target in time, fails the mission.
+// Latency percentiles are log2 histogram bucket bounds, see LatencyHistogram.
+//
+// With --baseline, each mission is compared to the mission with the same number of drones in an earlier run's
+// output. A metric that grew by more than the tolerance, plus a small absolute allowance, is a regression.
+// Set ROS_DOMAIN_ID to keep the benchmark away from a live flock, it publishes /start_mission.
+//=============================================================================
+
+namespace
+{
+  using flock2::msg::DroneStatus;
+  using Clock = std::chrono::steady_clock;
+
+  int64_t steady_ns()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+  }
+
+  int64_t cpu_ns()
+  {
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
+  // The final waypoint is reached if the drone comes this close, m
+  const double CLOSE_ENOUGH_XYZ = 0.3;
+
+  // Resident memory from /proc/self/status, e.g., VmRSS or VmHWM, kB
+  int64_t vm_kb(const std::string &field)
+  {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+      if (line.compare(0, field.size() + 1, field + ":") == 0) {
+        return std::stoll(line.substr(field.size() + 1));
+      }
+    }
+    return 0;
+  }
+
+  // Sent from the child to the parent as bytes
+  struct Result
+  {
+    int drones{};
+    bool completed{};
+    bool landed{};                    // Every drone flew and landed, completed or not
+    int reached{};
+    drone_base::LatencyHistogram plan_latency;
+    double takeoff_skew_sec{};
+    drone_base::LatencyHistogram odom_to_cmd_vel;
+    double cpu_pct_per_drone{};
+    int64_t peak_rss_kb{};
+    double rss_kb_per_drone{};
+    double completion_sec{};
+  };
+
+  static_assert(std::is_trivially_copyable<Result>::value, "Result goes through a pipe");
+
+//=============================================================================
+// Monitor: starts the mission and watches every drone
+//=============================================================================
+
+  class Monitor : public rclcpp::Node
+  {
+    struct Drone
+    {
+      rclcpp::Subscription<std_msgs::msg::UInt8>::SharedPtr state_sub_;
+      rclcpp::Subscription<nav_msgs::msg::Path>::SharedPtr plan_sub_;
+      rclcpp::Subscription<flock2::msg::CompactPlan>::SharedPtr compact_plan_sub_;
+      rclcpp::Subscription<nav_msgs::msg::Odometry>::SharedPtr odom_sub_;
+      rclcpp::Subscription<geometry_msgs::msg::Twist>::SharedPtr cmd_vel_sub_;
+
+      uint8_t state_{DroneStatus::STATE_UNKNOWN};
+      bool planned_{false};
+      bool flown_{false};
+      bool landed_{false};
+      bool have_final_{false};
+      bool reached_{false};
+      double final_x_{}, final_y_{}, final_z_{};  // Last waypoint of the latest plan, replans keep it
+      int64_t airborne_ns_{};         // Sim time
+      int64_t odom_ns_{};             // Wall clock, 0 once a cmd_vel has been matched to it
+    };
+
+    std::vector<Drone> drones_;
+    rclcpp::Publisher<std_msgs::msg::Empty>::SharedPtr start_mission_pub_;
+    rclcpp::Subscription<std_msgs::msg::Empty>::SharedPtr stop_mission_sub_;
+    rclcpp::TimerBase::SharedPtr start_timer_;
+
+    std::mutex mutex_;
+    int64_t ready_ns_{};               // Sim time when every drone first had odometry
+    int64_t start_ns_{};               // Sim time of /start_mission, 0 until it's sent
+    int64_t start_wall_ns_{};
+    int64_t done_ns_{};                // Sim time when the last drone landed, 0 until then
+    bool stopped_{false};              // Someone sent /stop_mission during the mission
+    drone_base::LatencyHistogram plan_latency_;
+    drone_base::LatencyHistogram odom_to_cmd_vel_;
+
+    static bool flying(uint8_t state)
+    { return state == DroneStatus::STATE_FLIGHT || state == DroneStatus::STATE_FLIGHT_ODOM; }
+
+    // Time only the first plan of the mission, a replan would be timed from /start_mission too
+    void plan_callback(Drone &drone)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (start_wall_ns_ > 0 && !drone.planned_) {
+        drone.planned_ = true;
+        plan_latency_.add(steady_ns() - start_wall_ns_);
+      }
+    }
+
+    void final_waypoint(Drone &drone, double x, double y, double z)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      drone.have_final_ = true;
+      drone.final_x_ = x;
+      drone.final_y_ = y;
+      drone.final_z_ = z;
+    }
+
+    void odom_callback(Drone &drone, const nav_msgs::msg::Odometry::SharedPtr &msg)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      drone.odom_ns_ = steady_ns();
+
+      if (drone.flown_ && !drone.landed_ && drone.have_final_ && flying(drone.state_)) {
+        auto &p = msg->pose.pose.position;
+        double dx = p.x - drone.final_x_, dy = p.y - drone.final_y_, dz = p.z - drone.final_z_;
+        if (std::sqrt(dx * dx + dy * dy + dz * dz) < CLOSE_ENOUGH_XYZ) {
+          drone.reached_ = true;
+        }
+      }
+    }
+
+    void state_callback(Drone &drone, const std_msgs::msg::UInt8::SharedPtr &msg)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      drone.state_ = msg->data;
+      if (start_ns_ == 0) {
+        return;
+      }
+
+      if (flying(drone.state_) && !drone.flown_) {
+        drone.flown_ = true;
+        drone.airborne_ns_ = now().nanoseconds();
+      } else if (drone.flown_ && !flying(drone.state_) && !drone.landed_) {
+        drone.landed_ = true;
+        if (std::all_of(drones_.begin(), drones_.end(), [](const Drone &d) { return d.landed_; })) {
+          done_ns_ = now().nanoseconds();
+        }
+      }
+    }
+
+    // Give the planner a second of sim time to see the landing poses, then start
+    void start_timer_callback()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (start_ns_ != 0) {
+        return;
+      }
+
+      if (!std::all_of(drones_.begin(), drones_.end(),
+                       [](const Drone &d) { return d.state_ == DroneStatus::STATE_READY_ODOM; })) {
+        return;
+      }
+
+      int64_t t = now().nanoseconds();
+      if (ready_ns_ == 0) {
+        ready_ns_ = t;
+      } else if (t - ready_ns_ > RCL_S_TO_NS(1)) {
+        start_ns_ = t;
+        start_wall_ns_ = steady_ns();
+        start_mission_pub_->publish(std_msgs::msg::Empty());
+      }
+    }
+
+  public:
+
+    explicit Monitor(const std::vector<std::string> &namespaces) :
+      Node{"flock2_bench", rclcpp::NodeOptions().parameter_overrides({rclcpp::Parameter("use_sim_time", true)})}
+    {
+      start_mission_pub_ = create_publisher<std_msgs::msg::Empty>("/start_mission", 1);
+
+      // flock_base or an operator aborted the mission
+      stop_mission_sub_ = create_subscription<std_msgs::msg::Empty>(
+        "/stop_mission", 10,
+        [this](const std_msgs::msg::Empty::SharedPtr msg)
+        {
+          (void) msg;
+          std::lock_guard<std::mutex> lock(mutex_);
+          if (start_ns_ != 0) {
+            stopped_ = true;
+          }
+        });
+
+      // Callbacks find their drone by reference, don't resize drones_ after this
+      drones_.resize(namespaces.size());
+      for (size_t i = 0; i < namespaces.size(); i++) {
+        Drone &drone = drones_[i];
+        const std::string &ns = namespaces[i];
+
+        drone.state_sub_ = create_subscription<std_msgs::msg::UInt8>(
+          ns + "/state", drone_base::latched_qos(),
+          [this, &drone](const std_msgs::msg::UInt8::SharedPtr msg) { state_callback(drone, msg); },
+          drone_base::plan_options<rclcpp::SubscriptionOptions>());
+
+        drone.plan_sub_ = create_subscription<nav_msgs::msg::Path>(
+          ns + "/plan", drone_base::plan_qos(),
+          [this, &drone](const nav_msgs::msg::Path::SharedPtr msg)
+          {
+            plan_callback(drone);
+            if (!msg->poses.empty()) {
+              auto &p = msg->poses.back().pose.position;
+              final_waypoint(drone, p.x, p.y, p.z);
+            }
+          },
+          drone_base::plan_options<rclcpp::SubscriptionOptions>());
+
+        // Same QoS as drone_base, it matches both whole and streamed plans; a plan starts at first_index 0
+        drone.compact_plan_sub_ = create_subscription<flock2::msg::CompactPlan>(
+          ns + "/compact_plan", drone_base::plan_stream_qos(),
+          [this, &drone](const flock2::msg::CompactPlan::SharedPtr msg)
+          {
+            if (msg->first_index == 0) {
+              plan_callback(drone);
+            }
+            if (msg->end_of_plan && !msg->x.empty() && drone_base::valid_compact(*msg)) {
+              final_waypoint(drone, msg->x.back(), msg->y.back(), msg->z.back());
+            }
+          },
+          drone_base::plan_options<rclcpp::SubscriptionOptions>());
+
+        drone.odom_sub_ = create_subscription<nav_msgs::msg::Odometry>(
+          ns + "/base_odom", drone_base::stream_qos("best_effort"),
+          [this, &drone](const nav_msgs::msg::Odometry::SharedPtr msg) { odom_callback(drone, msg); });
+
+        // The first cmd_vel after each odom message
+        drone.cmd_vel_sub_ = create_subscription<geometry_msgs::msg::Twist>(
+          ns + "/cmd_vel", drone_base::stream_qos("best_effort"),
+          [this, &drone](const geometry_msgs::msg::Twist::SharedPtr msg)
+          {
+            (void) msg;
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (start_ns_ != 0 && drone.odom_ns_ > 0) {
+              odom_to_cmd_vel_.add(steady_ns() - drone.odom_ns_);
+              drone.odom_ns_ = 0;
+            }
+          });
+      }
+
+      start_timer_ = create_wall_timer(std::chrono::milliseconds(10), std::bind(&Monitor::start_timer_callback, this));
+    }
+
+    // Sim time since /start_mission, 0 if the mission hasn't started
+    int64_t mission_ns()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return start_ns_ == 0 ? 0 : now().nanoseconds() - start_ns_;
+    }
+
+    bool done()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return done_ns_ != 0;
+    }
+
+    bool started()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return start_ns_ != 0;
+    }
+
+    void fill(Result &result)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      result.landed = done_ns_ != 0;
+      result.reached = static_cast<int>(std::count_if(drones_.begin(), drones_.end(),
+                                                      [](const Drone &d) { return d.reached_; }));
+      result.completed = result.landed && !stopped_ && result.reached == static_cast<int>(drones_.size());
+      result.completion_sec = done_ns_ != 0 ? static_cast<double>(done_ns_ - start_ns_) / 1e9 : 0;
+      result.plan_latency = plan_latency_;
+      result.odom_to_cmd_vel = odom_to_cmd_vel_;
+
+      int64_t first = 0, last = 0;
+      for (auto &drone : drones_) {
+        if (drone.flown_) {
+          first = first == 0 ? drone.airborne_ns_ : std::min(first, drone.airborne_ns_);
+          last = std::max(last, drone.airborne_ns_);
+        }
+      }
+      result.takeoff_skew_sec = static_cast<double>(last - first) / 1e9;
+    }
+  };
+
+//=============================================================================
+// One mission
+//=============================================================================
+
+  Result run(int num_drones, double time_scale, double timeout_sec)
+  {
+    Result result;
+    result.drones = num_drones;
+
+    std::vector<std::string> namespaces;
+    for (int i = 0; i < num_drones; i++) {
+      namespaces.push_back("bench" + std::to_string(i + 1));
+    }
+
+    // The sim lays the drones out on a square grid 1m apart, the arena must hold it
+    auto columns = static_cast<double>(std::ceil(std::sqrt(static_cast<double>(num_drones))));
+    double arena = std::max(4.0, columns + 2);
+
+    int64_t rss_start_kb = vm_kb("VmRSS");
+
+    auto sim = std::make_shared<flock_sim::FlockSim>(rclcpp::NodeOptions().parameter_overrides({
+      rclcpp::Parameter("drones", namespaces),
+      rclcpp::Parameter("publish_clock", 1),
+      rclcpp::Parameter("time_scale", time_scale)}));
+
+    auto planner = std::make_shared<planner_node::PlannerNode>(rclcpp::NodeOptions().parameter_overrides({
+      rclcpp::Parameter("use_sim_time", true),
+      rclcpp::Parameter("drones", namespaces),
+      rclcpp::Parameter("arena_x", arena),
+      rclcpp::Parameter("arena_y", arena)}));
+
+    std::vector<std::shared_ptr<drone_base::DroneBase>> drones;
+    for (auto &ns : namespaces) {
+      auto options = rclcpp::NodeOptions()
+        .arguments({"--ros-args", "-r", "__ns:=/" + ns})
+        .parameter_overrides({
+          rclcpp::Parameter("use_sim_time", true),
+          rclcpp::Parameter("event_driven", 1),
+          rclcpp::Parameter("latency_report_sec", 0.)});
+      drones.push_back(std::make_shared<drone_base::DroneBase>(options));
+    }
+
+    auto monitor = std::make_shared<Monitor>(namespaces);
+
+    // The sim gets its own executor so the clock keeps time no matter how busy the drones are
+    rclcpp::executors::SingleThreadedExecutor sim_executor;
+    sim_executor.add_node(sim);
+    rclcpp::executors::MultiThreadedExecutor flock_executor;
+    flock_executor.add_node(planner);
+    flock_executor.add_node(monitor);
+    for (auto &drone : drones) {
+      flock_executor.add_node(drone);
+    }
+
+    std::thread sim_thread([&sim_executor]() { sim_executor.spin(); });
+    std::thread flock_thread([&flock_executor]() { flock_executor.spin(); });
+
+    // Wait for the start, then for the mission
+    auto timeout_ns = static_cast<int64_t>(RCL_S_TO_NS(timeout_sec));
+    auto wall_limit = Clock::now() + std::chrono::nanoseconds(static_cast<int64_t>(timeout_ns / time_scale)) +
+                      std::chrono::seconds(30);
+    while (!monitor->started() && Clock::now() < wall_limit && rclcpp::ok()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    int64_t cpu_start_ns = cpu_ns();
+    int64_t wall_start_ns = steady_ns();
+    while (monitor->started() && !monitor->done() && monitor->mission_ns() < timeout_ns &&
+           Clock::now() < wall_limit && rclcpp::ok()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    double cpu_sec = static_cast<double>(cpu_ns() - cpu_start_ns) / 1e9;
+    double wall_sec = static_cast<double>(steady_ns() - wall_start_ns) / 1e9;
+
+    monitor->fill(result);
+    result.cpu_pct_per_drone = wall_sec > 0 ? 100 * cpu_sec / wall_sec / num_drones : 0;
+    result.peak_rss_kb = vm_kb("VmHWM");
+    result.rss_kb_per_drone = static_cast<double>(result.peak_rss_kb - rss_start_kb) / num_drones;
+
+    flock_executor.cancel();
+    sim_executor.cancel();
+    flock_thread.join();
+    sim_thread.join();
+
+    return result;
+  }
+
+  volatile sig_atomic_t g_interrupted = 0;
+
+  void sigint_handler(int sig)
+  {
+    (void) sig;
+    g_interrupted = 1;
+  }
+
+  // Run one mission in a child process, false if the child died without a result
+  bool run_child(int argc, char **argv, int num_drones, double time_scale, double timeout_sec, Result &result)
+  {
+    int fds[2];
+    if (pipe(fds) != 0) {
+      return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+      close(fds[0]);
+      close(fds[1]);
+      return false;
+    }
+
+    if (pid == 0) {
+      // Child: rclcpp stops the mission on ^C, the parent reports what it got
+      close(fds[0]);
+      signal(SIGINT, SIG_DFL);
+      rclcpp::init(argc, argv);
+      rcutils_logging_set_default_logger_level(RCUTILS_LOG_SEVERITY_WARN);
+      Result child_result = run(num_drones, time_scale, timeout_sec);
+      rclcpp::shutdown();
+      bool sent = write(fds[1], &child_result, sizeof(child_result)) == static_cast<ssize_t>(sizeof(child_result));
+      close(fds[1]);
+      _exit(sent ? 0 : 1);
+    }
+
+    close(fds[1]);
+    size_t received = 0;
+    auto buffer = reinterpret_cast<char *>(&result);
+    while (received < sizeof(result)) {
+      ssize_t n = read(fds[0], buffer + received, sizeof(result) - received);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        break;
+      }
+      received += static_cast<size_t>(n);
+    }
+    close(fds[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    return received == sizeof(result);
+  }
+
+  // ms, with the bucket bound percentiles
+  void write_histogram(std::ostream &out, const char *name, const drone_base::LatencyHistogram &h)
+  {
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+             "      \"%s\": {\"n\": %lu, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+             name, h.count(), h.mean_ns() / 1e6, h.percentile_ns(0.5) / 1e6, h.percentile_ns(0.9) / 1e6,
+             h.percentile_ns(0.99) / 1e6, h.max_ns() / 1e6);
+    out << buffer;
+  }
+
+  // One key per line, in a fixed order, so two runs diff cleanly
+  void write_json(std::ostream &out, const std::vector<Result> &results, double time_scale)
+  {
+    char buffer[256];
+    out << "{\n";
+    snprintf(buffer, sizeof(buffer), "  \"time_scale\": %g,\n", time_scale);
+    out << buffer;
+    out << "  \"missions\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result &r = results[i];
+      out << "    {\n";
+      snprintf(buffer, sizeof(buffer), "      \"drones\": %d,\n      \"completed\": %s,\n      \"reached\": %d,\n",
+               r.drones, r.completed ? "true" : "false", r.reached);
+      out << buffer;
+      write_histogram(out, "plan_latency_ms", r.plan_latency);
+      snprintf(buffer, sizeof(buffer), "      \"takeoff_skew_sec\": %.3f,\n", r.takeoff_skew_sec);
+      out << buffer;
+      write_histogram(out, "odom_to_cmd_vel_ms", r.odom_to_cmd_vel);
+      snprintf(buffer, sizeof(buffer),
+               "      \"cpu_pct_per_drone\": %.2f,\n      \"peak_rss_kb\": %ld,\n      \"rss_kb_per_drone\": %.1f,\n"
+               "      \"completion_sec\": %.3f\n",
+               r.cpu_pct_per_drone, static_cast<long>(r.peak_rss_kb), r.rss_kb_per_drone, r.completion_sec);
+      out << buffer;
+      out << (i + 1 < results.size() ? "    },\n" : "    }\n");
+    }
+    out << "  ]\n";
+    out << "}\n";
+  }
+
+//=============================================================================
+// Baseline comparison
+//=============================================================================
+
+  // Compared with the baseline, histograms by their mean. A metric regressed if it's more than
+  // baseline * (1 + tolerance) + allowance; the allowance keeps small values from failing on noise
+  struct Metric
+  {
+    const char *name;
+    double allowance;
+  };
+
+  const Metric METRICS[] = {
+    {"plan_latency_ms",    1.0},
+    {"takeoff_skew_sec",   0.5},
+    {"odom_to_cmd_vel_ms", 0.1},
+    {"cpu_pct_per_drone",  1.0},
+    {"rss_kb_per_drone",   256},
+    {"completion_sec",     1.0},
+  };
+
+  using Metrics = std::map<std::string, double>;
+
+  Metrics metrics(const Result &r)
+  {
+    return Metrics{
+      {"plan_latency_ms",    r.plan_latency.mean_ns() / 1e6},
+      {"takeoff_skew_sec",   r.takeoff_skew_sec},
+      {"odom_to_cmd_vel_ms", r.odom_to_cmd_vel.mean_ns() / 1e6},
+      {"cpu_pct_per_drone",  r.cpu_pct_per_drone},
+      {"rss_kb_per_drone",   r.rss_kb_per_drone},
+      {"completion_sec",     r.completion_sec}};
+  }
+
+  // The number after "key": on a line of write_json output, the mean for a histogram
+  bool find_number(const std::string &line, const std::string &key, double &value)
+  {
+    auto pos = line.find("\"" + key + "\": ");
+    if (pos == std::string::npos) {
+      return false;
+    }
+    pos += key.size() + 4;
+
+    if (pos < line.size() && line[pos] == '{') {
+      return find_number(line.substr(pos), "mean", value);
+    }
+
+    const char *start = line.c_str() + pos;
+    char *end;
+    value = strtod(start, &end);
+    return end != start;
+  }
+
+  // Completed missions from an earlier run, by number of drones
+  bool read_baseline(const std::string &path, std::map<int, Metrics> &baseline)
+  {
+    std::ifstream in(path);
+    if (!in) {
+      return false;
+    }
+
+    std::map<int, Metrics> missions;
+    std::map<int, bool> completed;
+    int drones = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+      double value;
+      if (find_number(line, "drones", value)) {
+        drones = static_cast<int>(value);
+      } else if (drones > 0 && line.find("\"completed\": true") != std::string::npos) {
+        completed[drones] = true;
+      } else if (drones > 0) {
+        for (auto &metric : METRICS) {
+          if (find_number(line, metric.name, value)) {
+            missions[drones][metric.name] = value;
+          }
+        }
+      }
+    }
+
+    for (auto &mission : missions) {
+      if (completed[mission.first]) {
+        baseline.insert(mission);
+      }
+    }
+    return true;
+  }
+
+  // Print every metric that regressed, false if any did
+  bool compare(const std::vector<Result> &results, const std::map<int, Metrics> &baseline, double tolerance)
+  {
+    bool ok = true;
+    for (auto &r : results) {
+      auto mission = baseline.find(r.drones);
+      if (!r.completed || mission == baseline.end()) {
+        continue;
+      }
+
+      Metrics current = metrics(r);
+      for (auto &metric : METRICS) {
+        auto old_value = mission->second.find(metric.name);
+        if (old_value == mission->second.end()) {
+          continue;
+        }
+
+        double limit = old_value->second * (1 + tolerance) + metric.allowance;
+        if (current[metric.name] > limit) {
+          fprintf(stderr, "%d drone(s): %s regressed, %.3f vs %.3f in the baseline\n", r.drones, metric.name,
+                  current[metric.name], old_value->second);
+          ok = false;
+        }
+      }
+    }
+    return ok;
+  }
+
+  std::vector<int> parse_list(const std::string &s)
+  {
+    std::vector<int> values;
+    std::stringstream ss(s);
+    std::string value;
+    while (std::getline(ss, value, ',')) {
+      values.push_back(std::stoi(value));
+    }
+    return values;
+  }
+
+}
+
+int main(int argc, char **argv)
+{
+  // Each mission calls rclcpp::init in its own process, see run_child
+  std::vector<int> flock_sizes{1, 4, 16, 64};
+  double time_scale = 4;
+  double timeout_sec = 1800;
+  std::string output;
+  std::string baseline_path;
+  double tolerance = 0.2;
+
+  auto args = rclcpp::remove_ros_arguments(argc, argv);
+  for (size_t i = 1; i + 1 < args.size(); i += 2) {
+    if (args[i] == "--drones") {
+      flock_sizes = parse_list(args[i + 1]);
+    } else if (args[i] == "--time-scale") {
+      time_scale = std::max(0.1, std::stod(args[i + 1]));
+    } else if (args[i] == "--timeout") {
+      timeout_sec = std::stod(args[i + 1]);
+    } else if (args[i] == "--output") {
+      output = args[i + 1];
+    } else if (args[i] == "--baseline") {
+      baseline_path = args[i + 1];
+    } else if (args[i] == "--tolerance") {
+      tolerance = std::max(0.0, std::stod(args[i + 1]));
+    }
+  }
+
+  // Read the baseline first, don't fly for half an hour to find it's missing
+  std::map<int, Metrics> baseline;
+  if (!baseline_path.empty() && !read_baseline(baseline_path, baseline)) {
+    fprintf(stderr, "can't read %s\n", baseline_path.c_str());
+    return 1;
+  }
+
+  // ^C stops the current mission, and the results so far are written
+  signal(SIGINT, sigint_handler);
+
+  std::vector<Result> results;
+  for (int num_drones : flock_sizes) {
+    if (num_drones < 1 || g_interrupted) {
+      continue;
+    }
+
+    Result result;
+    result.drones = num_drones;
+    if (!run_child(argc, argv, num_drones, time_scale, timeout_sec, result)) {
+      fprintf(stderr, "%d drone(s): mission process failed\n", num_drones);
+      result = Result();
+      result.drones = num_drones;
+    }
+    results.push_back(result);
+
+    const char *outcome = result.completed ? "completed" :
+                          result.landed ? "aborted" : "timed out";
+    fprintf(stderr, "%d drone(s): %s, %d reached the final waypoint, %.1fs sim time\n", num_drones, outcome,
+            result.reached, result.completion_sec);
+  }
+
+  int exit_code = 0;
+  if (output.empty()) {
+    write_json(std::cout, results, time_scale);
+  } else {
+    std::ofstream out(output);
+    write_json(out, results, time_scale);
+    if (!out.good()) {
+      fprintf(stderr, "can't write %s\n", output.c_str());
+      exit_code = 1;
+    }
+  }
+
+  // A mission that doesn't finish is a regression
+  if (std::any_of(results.begin(), results.end(), [](const Result &r) { return !r.completed; })) {
+    exit_code = 1;
+  }
+
+  if (!baseline.empty() && !compare(results, baseline, tolerance)) {
+    exit_code = 1;
+  }
+
+  return exit_code;
+}
@@ -0,0 +1,166 @@
+#include "flock_action_mgr.hpp"
+
+#include <algorithm>
+
+namespace flock_base
+{
+
+  FlockActionMgr::FlockActionMgr(rclcpp::Node &node, const std::vector<std::string> &drones) :
+    node_{node}, drones_(drones.size())
+  {
+    // Callbacks find their drone by index
+    for (size_t i = 0; i < drones.size(); i++) {
+      drones_[i].ns_ = drones[i];
+      drones_[i].client_ = node_.create_client<tello_msgs::srv::TelloAction>(drones[i] + "/tello_action");
+      drones_[i].tello_response_sub_ = node_.create_subscription<tello_msgs::msg::TelloResponse>(
+        drones[i] + "/tello_response", 10,
+        [this, i](tello_msgs::msg::TelloResponse::SharedPtr msg) { tello_response_callback(i, msg); });
+    }
+  }
+
+  bool FlockActionMgr::send_all(const std::string &action_str, double timeout_sec, Callback callback)
+  {
+    std::vector<size_t> drones(drones_.size());
+    for (size_t i = 0; i < drones.size(); i++) {
+      drones[i] = i;
+    }
+    return send(drones, action_str, timeout_sec, std::move(callback));
+  }
+
+  bool FlockActionMgr::send(const std::vector<size_t> &drones, const std::string &action_str, double timeout_sec,
+                            Callback callback)
+  {
+    if (busy()) {
+      RCLCPP_ERROR(node_.get_logger(), "%s still running, dropping %s", action_str_.c_str(), action_str.c_str());
+      return false;
+    }
+
+    action_str_ = action_str;
+    callback_ = std::move(callback);
+    start_ns_ = node_.now().nanoseconds();
+    deadline_ns_ = start_ns_ + static_cast<int64_t>(RCL_S_TO_NS(timeout_sec));
+    uint64_t sequence = ++sequence_;
+
+    // Send all requests before waiting for any response
+    for (size_t i : drones) {
+      auto request = std::make_shared<tello_msgs::srv::TelloAction::Request>();
+      request->cmd = action_str;
+      drones_[i].state_ = State::waiting_for_future;
+      drones_[i].rejected_ = false;
+      drones_[i].client_->async_send_request(
+        request,
+        [this, i, sequence](rclcpp::Client<tello_msgs::srv::TelloAction>::SharedFuture future)
+        { response_callback(i, sequence, future.get()); });
+    }
+
+    RCLCPP_INFO(node_.get_logger(), "sent %s to %zu drone(s)", action_str.c_str(), drones.size());
+    return true;
+  }
+
+  void FlockActionMgr::response_callback(size_t drone, uint64_t sequence,
+                                         tello_msgs::srv::TelloAction::Response::SharedPtr response)
+  {
+    Drone &d = drones_[drone];
+
+    // The tello_response message may arrive before the future is ready -- that's OK
+    if (sequence != sequence_ || !busy() || d.state_ != State::waiting_for_future) {
+      return;
+    }
+
+    if (response->rc == response->OK) {
+      set_state(drone, State::waiting_for_response);
+    } else {
+      RCLCPP_ERROR(node_.get_logger(), "%s: %s failed, rc %d", d.ns_.c_str(), action_str_.c_str(), response->rc);
+      d.rejected_ = true;
+      set_state(drone, State::failed);
+    }
+  }
+
+  void FlockActionMgr::tello_response_callback(size_t drone, tello_msgs::msg::TelloResponse::SharedPtr msg)
+  {
+    Drone &d = drones_[drone];
+
+    // Responses to actions sent by drone_base are none of our business
+    if (!busy() || (d.state_ != State::waiting_for_future && d.state_ != State::waiting_for_response)) {
+      return;
+    }
+
+    if (msg->rc == msg->OK) {
+      set_state(drone, State::succeeded);
+    } else {
+      RCLCPP_ERROR(node_.get_logger(), "%s: %s failed with %s", d.ns_.c_str(), action_str_.c_str(),
+                   msg->str.c_str());
+      set_state(drone, State::failed);
+    }
+  }
+
+  void FlockActionMgr::set_state(size_t drone, State state)
+  {
+    Drone &d = drones_[drone];
+    d.state_ = state;
+    d.done_ns_ = node_.now().nanoseconds();
+
+    if (state == State::failed) {
+      finish(false, 0, d.ns_ + " failed");
+      return;
+    }
+
+    // The barrier: wait for the last drone, idle drones aren't taking part
+    int64_t first_ns = d.done_ns_;
+    int64_t last_ns = 0;
+    for (auto &other : drones_) {
+      if (other.state_ == State::idle) {
+        continue;
+      }
+      if (other.state_ != State::succeeded) {
+        return;
+      }
+      first_ns = std::min(first_ns, other.done_ns_);
+      last_ns = std::max(last_ns, other.done_ns_);
+    }
+
+    RCLCPP_INFO(node_.get_logger(), "%s complete on all drones in %.2fs, spread %.2fs", action_str_.c_str(),
+                static_cast<double>(last_ns - start_ns_) / 1e9, static_cast<double>(last_ns - first_ns) / 1e9);
+    finish(true, last_ns, "ok");
+  }
+
+  void FlockActionMgr::spin_once()
+  {
+    if (busy() && node_.now().nanoseconds() > deadline_ns_) {
+      for (auto &d : drones_) {
+        if (d.state_ != State::succeeded && d.state_ != State::idle) {
+          RCLCPP_ERROR(node_.get_logger(), "%s: %s timed out", d.ns_.c_str(), action_str_.c_str());
+        }
+      }
+      finish(false, 0, "timed out");
+    }
+  }
+
+  void FlockActionMgr::cancel()
+  {
+    callback_ = nullptr;
+    end_action();
+  }
+
+  void FlockActionMgr::finish(bool succeeded, int64_t barrier_ns, const std::string &result)
+  {
+    // The callback may start the next action
+    Callback callback;
+    callback.swap(callback_);
+    end_action();
+    callback(succeeded, barrier_ns, result);
+  }
+
+  void FlockActionMgr::end_action()
+  {
+    // A drone that hasn't answered, or failed after accepting, may be partway through the action
+    started_.clear();
+    for (size_t i = 0; i < drones_.size(); i++) {
+      if (drones_[i].state_ != State::idle && !drones_[i].rejected_) {
+        started_.push_back(i);
+      }
+      drones_[i].state_ = State::idle;
+    }
+  }
+
+} // namespace flock_base
@@ -1,9 +1,15 @@
 #include "flock_base.hpp"
 
+#include <algorithm>
+#include <cmath>
+
+#include "rclcpp/create_timer.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
+
 namespace flock_base
 {
 
-  FlockBase::FlockBase() : Node{"flock_base"}
+  FlockBase::FlockBase(const rclcpp::NodeOptions &options) : Node{"flock_base", options}
   {
 #undef CXT_MACRO_MEMBER
 #define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOAD_PARAMETER((*this), (*this), n, t, d)
@@ -27,41 +33,70 @@ namespace flock_base
     start_mission_pub_ = create_publisher<std_msgs::msg::Empty>("/start_mission", 1);
     stop_mission_pub_ = create_publisher<std_msgs::msg::Empty>("/stop_mission", 1);
 
-    // Create N joy publishers
+    // Create N manual control publishers
     for (auto i = drones_.begin(); i != drones_.end(); i++) {
-      joy_pubs_.push_back(create_publisher<sensor_msgs::msg::Joy>((*i) + "/joy", 1));
+      manual_pubs_.push_back(create_publisher<flock2::msg::ManualControl>((*i) + "/manual_control", 1));
+    }
+
+    // The joystick can burst, send the latest command at a steady rate
+    manual_timer_ = create_wall_timer(
+      std::chrono::nanoseconds(static_cast<int64_t>(RCL_S_TO_NS(1) / manual_control_rate_)),
+      std::bind(&FlockBase::manual_timer_callback, this));
+
+    if (flock_takeoff_) {
+      // drone_base waits for /flock_airborne instead of sending its own takeoff
+      action_mgr_ = std::make_unique<FlockActionMgr>(*this, drones_);
+      airborne_pub_ = create_publisher<std_msgs::msg::Header>("/flock_airborne", 1);
+      spin_timer_ = rclcpp::create_timer(this, get_clock(), rclcpp::Duration(RCL_S_TO_NS(1) / 20),
+                                         [this]() { action_mgr_->spin_once(); });
+    }
+
+    if (status_rate_ > 0) {
+      monitor_ = std::make_unique<FlockMonitor>(*this, drones_, min_battery_, battery_warn_sec_, battery_trend_sec_);
+      status_timer_ = rclcpp::create_timer(this, get_clock(),
+                                           rclcpp::Duration(static_cast<int64_t>(RCL_S_TO_NS(1) / status_rate_)),
+                                           [this]() { monitor_->publish(); });
     }
   }
 
-  inline bool button_down(const sensor_msgs::msg::Joy::SharedPtr curr, const sensor_msgs::msg::Joy &prev, int index)
+  inline bool button_down(const sensor_msgs::msg::Joy &curr, const std::vector<int32_t> &prev_buttons, int index)
   {
-    return curr->buttons[index] && !prev.buttons[index];
+    return curr.buttons[index] && !(index < prev_buttons.size() && prev_buttons[index]);
   }
 
-  void FlockBase::joy_callback(const sensor_msgs::msg::Joy::SharedPtr msg)
+  // Fraction of full stick to [-100, 100]
+  inline int8_t quantize(double v, double deadband)
   {
-    static sensor_msgs::msg::Joy prev_msg;
+    if (std::abs(v) < deadband) {
+      return 0;
+    }
+    return static_cast<int8_t>(std::lround(std::max(-1., std::min(1., v)) * 100));
+  }
 
+  void FlockBase::joy_callback(sensor_msgs::msg::Joy::SharedPtr msg)
+  {
     // Stop/start a mission
-    if (mission_ && button_down(msg, prev_msg, joy_button_stop_mission_)) {
-      stop_mission_pub_->publish(std_msgs::msg::Empty());
-      mission_ = false;
-    } else if (!mission_ && button_down(msg, prev_msg, joy_button_start_mission_)) {
-      start_mission_pub_->publish(std_msgs::msg::Empty());
-      mission_ = true;
+    if (mission_ && button_down(*msg, prev_buttons_, joy_button_stop_mission_)) {
+      stop_mission();
+    } else if (!mission_ && button_down(*msg, prev_buttons_, joy_button_start_mission_)) {
+      start_mission();
     }
 
     // Ignore further input if we're in a mission
     if (mission_) {
-      prev_msg = *msg;
+      prev_buttons_ = msg->buttons;
       return;
     }
 
     // Toggle between drones
-    if (button_down(msg, prev_msg, joy_button_next_drone_)) {
+    if (button_down(*msg, prev_buttons_, joy_button_next_drone_)) {
       if (drones_.size() < 2) {
         RCLCPP_WARN(get_logger(), "there's only 1 drone");
       } else {
+        // Stop the drone we're leaving
+        manual_pubs_[manual_control_]->publish(flock2::msg::ManualControl());
+        manual_ = sent_ = flock2::msg::ManualControl();
+
         if (++manual_control_ >= drones_.size()) {
           manual_control_ = 0;
         }
@@ -69,45 +104,140 @@ namespace flock_base
       }
     }
 
-    // Send joy message to the drone
-    joy_pubs_[manual_control_]->publish(*msg);
+    update_manual(*msg);
+    prev_buttons_ = msg->buttons;
+  }
 
-    prev_msg = *msg;
+  void FlockBase::update_manual(const sensor_msgs::msg::Joy &msg)
+  {
+    // Presses accumulate until the next message goes out
+    if (button_down(msg, prev_buttons_, joy_button_takeoff_)) {
+      manual_.events |= flock2::msg::ManualControl::TAKEOFF;
+    } else if (button_down(msg, prev_buttons_, joy_button_land_)) {
+      manual_.events |= flock2::msg::ManualControl::LAND;
+    }
+
+    // Trim (slow, steady) mode vs. joystick mode
+    double throttle{0}, strafe{0}, vertical{0}, yaw{0};
+    if (msg.axes[joy_axis_trim_lr_] != 0. || msg.axes[joy_axis_trim_fb_] != 0.) {
+      const static double TRIM_SPEED{0.2};
+      if (msg.axes[joy_axis_trim_lr_] != 0.) {
+        if (msg.buttons[joy_button_shift_]) {
+          yaw = TRIM_SPEED * msg.axes[joy_axis_trim_lr_];
+        } else {
+          strafe = TRIM_SPEED * msg.axes[joy_axis_trim_lr_];
+        }
+      }
+      if (msg.axes[joy_axis_trim_fb_] != 0.) {
+        if (msg.buttons[joy_button_shift_]) {
+          throttle = TRIM_SPEED * msg.axes[joy_axis_trim_fb_];
+        } else {
+          vertical = TRIM_SPEED * msg.axes[joy_axis_trim_fb_];
+        }
+      }
+    } else {
+      throttle = msg.axes[joy_axis_throttle_];
+      strafe = msg.axes[joy_axis_strafe_];
+      vertical = msg.axes[joy_axis_vertical_];
+      yaw = msg.axes[joy_axis_yaw_];
+    }
+
+    manual_.throttle = quantize(throttle, deadband_);
+    manual_.strafe = quantize(strafe, deadband_);
+    manual_.vertical = quantize(vertical, deadband_);
+    manual_.yaw = quantize(yaw, deadband_);
   }
 
-  void FlockBase::validate_parameters()
+  void FlockBase::manual_timer_callback()
   {
-    RCLCPP_INFO(get_logger(), "FlockBase Parameters");
+    // Nothing new, nothing to send
+    if (manual_ == sent_) {
+      return;
+    }
 
-#undef CXT_MACRO_MEMBER
-#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOG_PARAMETER(RCLCPP_INFO, get_logger(), (*this), n, t, d)
-    FLOCK_BASE_ALL_PARAMS
+    // The intra-process subscriber takes ownership without a copy
+    manual_pubs_[manual_control_]->publish(std::make_unique<flock2::msg::ManualControl>(manual_));
+    sent_ = manual_;
+    manual_.events = sent_.events = 0;
   }
-} // namespace flock_base
 
-int main(int argc, char **argv)
-{
-  // Force flush of the stdout buffer
-  setvbuf(stdout, NULL, _IONBF, BUFSIZ);
+  void FlockBase::start_mission()
+  {
+    start_mission_pub_->publish(std_msgs::msg::Empty());
+    mission_ = true;
 
-  // Init ROS
-  rclcpp::init(argc, argv);
+    if (action_mgr_) {
+      action_mgr_->send_all("takeoff", takeoff_timeout_sec_,
+                            std::bind(&FlockBase::takeoff_callback, this, std::placeholders::_1,
+                                      std::placeholders::_2, std::placeholders::_3));
+    }
+  }
 
-  // Create node
-  auto node = std::make_shared<flock_base::FlockBase>();
-  auto result = rcutils_logging_set_logger_level(node->get_logger().get_name(), RCUTILS_LOG_SEVERITY_INFO);
+  void FlockBase::stop_mission()
+  {
+    // Each drone_base lands its own drone
+    stop_mission_pub_->publish(std_msgs::msg::Empty());
+    mission_ = false;
+
+    // drone_base is still waiting for the barrier and won't land, so land every drone that may have taken off
+    if (action_mgr_ && action_mgr_->busy()) {
+      action_mgr_->cancel();
+      RCLCPP_INFO(get_logger(), "flock action cancelled, land %zu drone(s)", action_mgr_->started().size());
+      land(action_mgr_->started());
+    }
+  }
 
-  rclcpp::Rate r(20);
-  while (rclcpp::ok()) {
-    // Respond to incoming messages
-    rclcpp::spin_some(node);
+  void FlockBase::takeoff_callback(bool succeeded, int64_t barrier_ns, const std::string &result)
+  {
+    if (!succeeded) {
+      // Includes the drones that hadn't answered, or failed partway through the takeoff
+      std::vector<size_t> started = action_mgr_->started();
+      RCLCPP_ERROR(get_logger(), "flock takeoff failed (%s), stop mission, land %zu drone(s)", result.c_str(),
+                   started.size());
+      stop_mission();
+      land(started);
+      return;
+    }
 
-    // Wait
-    r.sleep();
+    // The barrier: every drone is in the air, the plans can start now
+    std_msgs::msg::Header msg;
+    msg.stamp = rclcpp::Time(barrier_ns, get_clock()->get_clock_type());
+    airborne_pub_->publish(msg);
   }
 
-  // Shut down ROS
-  rclcpp::shutdown();
+  void FlockBase::land(const std::vector<size_t> &drones)
+  {
+    if (drones.empty()) {
+      return;
+    }
+
+    action_mgr_->send(drones, "land", takeoff_timeout_sec_,
+                      [this](bool succeeded, int64_t, const std::string &result)
+                      {
+                        if (!succeeded) {
+                          RCLCPP_ERROR(get_logger(), "flock land failed (%s)", result.c_str());
+                        }
+                      });
+  }
+
+  void FlockBase::validate_parameters()
+  {
+    if (manual_control_rate_ <= 0) {
+      RCLCPP_WARN(get_logger(), "manual_control_rate must be > 0, using 20");
+      manual_control_rate_ = 20;
+    }
+
+    if (battery_trend_sec_ <= 0) {
+      RCLCPP_WARN(get_logger(), "battery_trend_sec must be > 0, using 60");
+      battery_trend_sec_ = 60;
+    }
+
+    RCLCPP_INFO(get_logger(), "FlockBase Parameters");
+
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOG_PARAMETER(RCLCPP_INFO, get_logger(), (*this), n, t, d)
+    FLOCK_BASE_ALL_PARAMS
+  }
+} // namespace flock_base
 
-  return 0;
-}
\ No newline at end of file
+RCLCPP_COMPONENTS_REGISTER_NODE(flock_base::FlockBase)
@@ -0,0 +1,28 @@
+#include "flock_base.hpp"
+
+int main(int argc, char **argv)
+{
+  // Force flush of the stdout buffer
+  setvbuf(stdout, NULL, _IONBF, BUFSIZ);
+
+  // Init ROS
+  rclcpp::init(argc, argv);
+
+  // Create node
+  auto node = std::make_shared<flock_base::FlockBase>();
+  auto result = rcutils_logging_set_logger_level(node->get_logger().get_name(), RCUTILS_LOG_SEVERITY_INFO);
+
+  rclcpp::Rate r(20);
+  while (rclcpp::ok()) {
+    // Respond to incoming messages
+    rclcpp::spin_some(node);
+
+    // Wait
+    r.sleep();
+  }
+
+  // Shut down ROS
+  rclcpp::shutdown();
+
+  return 0;
+}
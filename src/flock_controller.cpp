@@ -0,0 +1,285 @@
+#include "flock_controller.hpp"
+
+#include "rclcpp/create_timer.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
+
+#include "qos_profiles.hpp"
+
+namespace flock_controller
+{
+
+  using drone_base::DronePose;
+  using drone_base::PoseUtil;
+
+//====================
+// FlockController
+//====================
+
+  FlockController::FlockController(const rclcpp::NodeOptions &options) : Node{"flock_controller", options}
+  {
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOAD_PARAMETER((*this), cxt_, n, t, d)
+    CXT_MACRO_INIT_PARAMETERS(FLOCK_CONTROLLER_ALL_PARAMS, validate_parameters)
+
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_PARAMETER_CHANGED(cxt_, n, t)
+    CXT_MACRO_REGISTER_PARAMETERS_CHANGED((*this), FLOCK_CONTROLLER_ALL_PARAMS, validate_parameters)
+
+    int num_drones = static_cast<int>(cxt_.drones_.size());
+    RCLCPP_INFO(get_logger(), "controlling %d drone(s) at %g Hz", num_drones, cxt_.control_rate_);
+
+    // Same gains as FlightControllerBasic
+    controller_ = pid::BatchController(num_drones);
+    controller_.set_coefficients(pid::X, 0.1, 0, 0);
+    controller_.set_coefficients(pid::Y, 0.1, 0, 0);
+    controller_.set_coefficients(pid::Z, 0.1, 0, 0);
+    controller_.set_coefficients(pid::YAW, 0.2, 0, 0);
+
+    state_.resize(controller_.size(), 0.);
+    ubar_.resize(controller_.size(), 0.);
+    active_.resize(num_drones, false);
+
+    // Callbacks find their drone by index
+    drones_.resize(num_drones);
+    for (int i = 0; i < num_drones; i++) {
+      ControlledDrone &drone = drones_[i];
+      drone.ns_ = cxt_.drones_[i];
+
+      drone.odom_sub_ = create_subscription<nav_msgs::msg::Odometry>(
+        drone.ns_ + "/base_odom", drone_base::stream_qos(cxt_.sensor_qos_),
+        [this, i](const nav_msgs::msg::Odometry::SharedPtr msg) { odom_callback(i, msg); });
+      drone.plan_sub_ = create_subscription<nav_msgs::msg::Path>(
+        drone.ns_ + "/plan", drone_base::plan_qos(),
+        [this, i](const nav_msgs::msg::Path::SharedPtr msg) { plan_callback(i, msg); },
+        drone_base::plan_options<rclcpp::SubscriptionOptions>());
+      drone.state_sub_ = create_subscription<std_msgs::msg::UInt8>(
+        drone.ns_ + "/state", drone_base::latched_qos(),
+        [this, i](const std_msgs::msg::UInt8::SharedPtr msg) { drones_[i].state_ = msg->data; },
+        drone_base::plan_options<rclcpp::SubscriptionOptions>());
+      drone.cmd_vel_pub_ = create_publisher<geometry_msgs::msg::Twist>(drone.ns_ + "/cmd_vel",
+                                                                       drone_base::stream_qos(cxt_.cmd_vel_qos_));
+    }
+
+    start_mission_sub_ = create_subscription<std_msgs::msg::Empty>(
+      "/start_mission", 10, std::bind(&FlockController::start_mission_callback, this, std::placeholders::_1));
+    stop_mission_sub_ = create_subscription<std_msgs::msg::Empty>(
+      "/stop_mission", 10, std::bind(&FlockController::stop_mission_callback, this, std::placeholders::_1));
+
+    // Plan and odom stamps are ROS time, use the node clock so the timer honors use_sim_time
+    timer_ = rclcpp::create_timer(this, get_clock(),
+                                  rclcpp::Duration(static_cast<int64_t>(RCL_S_TO_NS(1) / cxt_.control_rate_)),
+                                  std::bind(&FlockController::timer_callback, this));
+  }
+
+  void FlockController::odom_callback(int drone, const nav_msgs::msg::Odometry::SharedPtr &msg)
+  {
+    DronePose pose;
+    pose.fromMsg(msg->pose.pose);
+
+    state_[pid::BatchController::index(drone, pid::X)] = pose.x;
+    state_[pid::BatchController::index(drone, pid::Y)] = pose.y;
+    state_[pid::BatchController::index(drone, pid::Z)] = pose.z;
+    state_[pid::BatchController::index(drone, pid::YAW)] = pose.yaw;
+
+    drones_[drone].odom_ns_ = rclcpp::Time(msg->header.stamp).nanoseconds();
+  }
+
+  void FlockController::plan_callback(int drone, const nav_msgs::msg::Path::SharedPtr &msg)
+  {
+    RCLCPP_INFO(get_logger(), "%s: got plan with %zu waypoints", drones_[drone].ns_.c_str(), msg->poses.size());
+    drones_[drone].plan_.build(msg, static_cast<int64_t>(RCL_S_TO_NS(cxt_.stabilize_time_sec_)));
+    set_target(drone, 0, now().nanoseconds());
+  }
+
+  void FlockController::set_target(int drone, int target, int64_t now_ns)
+  {
+    ControlledDrone &d = drones_[drone];
+    d.target_ = target;
+
+    // Handle "done" case
+    if (d.target_ < 0 || d.target_ >= d.plan_.size()) {
+      return;
+    }
+
+    d.segment_ = d.plan_[d.target_];
+
+    // Takeoff case: leave now
+    d.prev_target_ns_ = d.target_ == 0 ? now_ns : d.segment_.start_ns;
+
+    // Initialize PID controllers to previous target, these will be updated each tick
+    controller_.set_target(drone, pid::X, d.segment_.start.x);
+    controller_.set_target(drone, pid::Y, d.segment_.start.y);
+    controller_.set_target(drone, pid::Z, d.segment_.start.z);
+    controller_.set_target(drone, pid::YAW, d.segment_.start.yaw);
+  }
+
+  // Advance the target and set the PID targets for one drone, return false if the drone isn't under control
+  bool FlockController::update_target(int drone, int64_t now_ns)
+  {
+    ControlledDrone &d = drones_[drone];
+
+    if (d.plan_.empty() || d.target_ >= d.plan_.size()) {
+      return false;
+    }
+
+    // Not in a mission, or drone_base is still taking off (or lost odometry, or landed)
+    if (!mission_ || d.state_ != flock2::msg::DroneStatus::STATE_FLIGHT_ODOM) {
+      return false;
+    }
+
+    if (d.odom_ns_ <= 0 || now_ns - d.odom_ns_ > static_cast<int64_t>(RCL_S_TO_NS(cxt_.odom_timeout_sec_))) {
+      return false;
+    }
+
+    DronePose pose;
+    pose.x = state_[pid::BatchController::index(drone, pid::X)];
+    pose.y = state_[pid::BatchController::index(drone, pid::Y)];
+    pose.z = state_[pid::BatchController::index(drone, pid::Z)];
+    pose.yaw = state_[pid::BatchController::index(drone, pid::YAW)];
+
+    // On the ground, or still taking off
+    if (pose.z < cxt_.min_control_z_) {
+      return false;
+    }
+
+    int64_t stabilize_ns = static_cast<int64_t>(RCL_S_TO_NS(cxt_.stabilize_time_sec_));
+
+    if (now_ns > d.segment_.end_ns + stabilize_ns) {
+      if (d.segment_.end.close_enough(pose)) {
+        // Advance to the next target
+        set_target(drone, d.target_ + 1, now_ns);
+        return d.target_ < d.plan_.size();
+      } else {
+        // Timeout, drone_base sees the same timeout and takes over
+        RCLCPP_ERROR(get_logger(), "%s: didn't reach target %d, stop controlling", d.ns_.c_str(), d.target_);
+        d.plan_.clear();
+        return false;
+      }
+    }
+
+    // Compute expected position and set PID targets
+    if (now_ns < d.segment_.end_ns && now_ns > d.prev_target_ns_) {
+      auto elapsed_time = static_cast<double>(now_ns - d.prev_target_ns_) / 1e9;
+      controller_.set_target(drone, pid::X, d.segment_.start.x + d.segment_.vx * elapsed_time);
+      controller_.set_target(drone, pid::Y, d.segment_.start.y + d.segment_.vy * elapsed_time);
+      controller_.set_target(drone, pid::Z, d.segment_.start.z + d.segment_.vz * elapsed_time);
+      controller_.set_target(drone, pid::YAW, PoseUtil::norm_angle(d.segment_.start.yaw + d.segment_.vyaw * elapsed_time));
+    }
+
+    return true;
+  }
+
+  // Tell drones that are too close to each other to hover
+  void FlockController::check_separation()
+  {
+    double min_d2 = cxt_.min_separation_ * cxt_.min_separation_;
+
+    for (size_t i = 0; i < drones_.size(); i++) {
+      if (!active_[i]) {
+        continue;
+      }
+
+      for (size_t j = i + 1; j < drones_.size(); j++) {
+        if (!active_[j]) {
+          continue;
+        }
+
+        double dx = state_[pid::BatchController::index(i, pid::X)] - state_[pid::BatchController::index(j, pid::X)];
+        double dy = state_[pid::BatchController::index(i, pid::Y)] - state_[pid::BatchController::index(j, pid::Y)];
+        double dz = state_[pid::BatchController::index(i, pid::Z)] - state_[pid::BatchController::index(j, pid::Z)];
+
+        if (dx * dx + dy * dy + dz * dz < min_d2) {
+          RCLCPP_WARN(get_logger(), "%s and %s are too close, hover", drones_[i].ns_.c_str(), drones_[j].ns_.c_str());
+          for (int axis = 0; axis < pid::NUM_AXES; axis++) {
+            ubar_[pid::BatchController::index(i, axis)] = 0;
+            ubar_[pid::BatchController::index(j, axis)] = 0;
+          }
+        }
+      }
+    }
+  }
+
+  void FlockController::timer_callback()
+  {
+    int64_t now_ns = now().nanoseconds();
+
+    bool any_active = false;
+    for (size_t i = 0; i < drones_.size(); i++) {
+      active_[i] = update_target(i, now_ns);
+      any_active = any_active || active_[i];
+    }
+
+    if (!any_active) {
+      prev_tick_ns_ = now_ns;
+      return;
+    }
+
+    // One pass for all drones
+    double dt = prev_tick_ns_ > 0 ? static_cast<double>(now_ns - prev_tick_ns_) / 1e9 : 1. / cxt_.control_rate_;
+    prev_tick_ns_ = now_ns;
+    controller_.calc(state_.data(), dt, ubar_.data());
+
+    check_separation();
+
+    for (size_t i = 0; i < drones_.size(); i++) {
+      if (!active_[i]) {
+        continue;
+      }
+
+      // Rotate ubar_x and ubar_y into the body frame
+      double throttle, strafe;
+      PoseUtil::rotate_frame(ubar_[pid::BatchController::index(i, pid::X)],
+                             ubar_[pid::BatchController::index(i, pid::Y)],
+                             state_[pid::BatchController::index(i, pid::YAW)], throttle, strafe);
+
+      // Publish a unique_ptr so intra-process subscribers can take ownership without a copy
+      auto twist = std::make_unique<geometry_msgs::msg::Twist>();
+      twist->linear.x = PoseUtil::clamp(throttle, -1.0, 1.0);
+      twist->linear.y = PoseUtil::clamp(strafe, -1.0, 1.0);
+      twist->linear.z = PoseUtil::clamp(ubar_[pid::BatchController::index(i, pid::Z)], -1.0, 1.0);
+      twist->angular.z = PoseUtil::clamp(ubar_[pid::BatchController::index(i, pid::YAW)], -1.0, 1.0);
+      drones_[i].cmd_vel_pub_->publish(std::move(twist));
+    }
+  }
+
+  void FlockController::start_mission_callback(const std_msgs::msg::Empty::SharedPtr msg)
+  {
+    (void) msg;
+    mission_ = true;
+  }
+
+  void FlockController::stop_mission_callback(const std_msgs::msg::Empty::SharedPtr msg)
+  {
+    (void) msg;
+    mission_ = false;
+    for (auto &drone : drones_) {
+      drone.plan_.clear();
+    }
+  }
+
+  void FlockController::validate_parameters()
+  {
+    if (cxt_.control_rate_ <= 0) {
+      RCLCPP_WARN(get_logger(), "control_rate must be > 0, using 20 Hz");
+      cxt_.control_rate_ = 20;
+    }
+
+    if (!drone_base::valid_reliability(cxt_.sensor_qos_)) {
+      RCLCPP_WARN(get_logger(), "sensor_qos must be best_effort or reliable, using best_effort");
+      cxt_.sensor_qos_ = "best_effort";
+    }
+    if (!drone_base::valid_reliability(cxt_.cmd_vel_qos_)) {
+      RCLCPP_WARN(get_logger(), "cmd_vel_qos must be best_effort or reliable, using reliable");
+      cxt_.cmd_vel_qos_ = "reliable";
+    }
+
+    RCLCPP_INFO(get_logger(), "FlockController Parameters");
+
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOG_PARAMETER(RCLCPP_INFO, get_logger(), cxt_, n, t, d)
+    FLOCK_CONTROLLER_ALL_PARAMS
+  }
+
+} // namespace flock_controller
+
+RCLCPP_COMPONENTS_REGISTER_NODE(flock_controller::FlockController)
@@ -0,0 +1,21 @@
+#include "flock_controller.hpp"
+
+int main(int argc, char **argv)
+{
+  // Force flush of the stdout buffer
+  setvbuf(stdout, NULL, _IONBF, BUFSIZ);
+
+  // Init ROS
+  rclcpp::init(argc, argv);
+
+  // Create node, the control loop runs on a timer
+  auto node = std::make_shared<flock_controller::FlockController>();
+  auto result = rcutils_logging_set_logger_level(node->get_logger().get_name(), RCUTILS_LOG_SEVERITY_INFO);
+
+  rclcpp::spin(node);
+
+  // Shut down ROS
+  rclcpp::shutdown();
+
+  return 0;
+}
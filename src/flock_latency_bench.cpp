@@ -0,0 +1,218 @@
+#include "drone_base.hpp"
+#include "qos_profiles.hpp"
+
+#include <iostream>
+#include <thread>
+
+#include "tello_msgs/msg/flight_data.hpp"
+#include "tello_msgs/msg/tello_response.hpp"
+#include "tello_msgs/srv/tello_action.hpp"
+
+//=============================================================================
+// Measure odom->cmd_vel latency as the number of drones in a process grows
+//
+// Usage: flock_latency_bench [--seconds 10] [--plan-size 2000]
+//
+// For 2, 4, 8 and 16 drones, and for a single-threaded and a multi-threaded executor:
+//    Run N DroneBase nodes in one process
+//    A fake driver node stands in for tello_driver and vloc_node: it publishes odometry at 30Hz,
+//    accepts takeoff, and sends every drone a large plan once a second to load the plan callbacks
+//    Report percentiles of the odom->cmd_vel latency recorded by the DroneBase nodes
+//
+// Set ROS_DOMAIN_ID to keep the benchmark away from a live flock, it publishes /start_mission.
+//=============================================================================
+
+namespace
+{
+
+  const int ODOM_RATE = 30;
+
+  // Stands in for tello_driver and vloc_node for one drone
+  class FakeDriver
+  {
+    rclcpp::Publisher<tello_msgs::msg::FlightData>::SharedPtr flight_data_pub_;
+    rclcpp::Publisher<tello_msgs::msg::TelloResponse>::SharedPtr tello_response_pub_;
+    rclcpp::Publisher<nav_msgs::msg::Odometry>::SharedPtr odom_pub_;
+    rclcpp::Publisher<nav_msgs::msg::Path>::SharedPtr plan_pub_;
+    rclcpp::Service<tello_msgs::srv::TelloAction>::SharedPtr tello_action_srv_;
+
+  public:
+
+    FakeDriver(rclcpp::Node &node, const std::string &ns)
+    {
+      flight_data_pub_ = node.create_publisher<tello_msgs::msg::FlightData>(ns + "/flight_data", 1);
+      tello_response_pub_ = node.create_publisher<tello_msgs::msg::TelloResponse>(ns + "/tello_response", 1);
+      odom_pub_ = node.create_publisher<nav_msgs::msg::Odometry>(ns + "/base_odom", 1);
+      plan_pub_ = node.create_publisher<nav_msgs::msg::Path>(ns + "/plan", drone_base::plan_qos(),
+                                                             drone_base::plan_options<rclcpp::PublisherOptions>());
+
+      // Accept every action, and report success right away
+      tello_action_srv_ = node.create_service<tello_msgs::srv::TelloAction>(
+        ns + "/tello_action",
+        [this](const std::shared_ptr<tello_msgs::srv::TelloAction::Request> request,
+               std::shared_ptr<tello_msgs::srv::TelloAction::Response> response)
+        {
+          (void) request;
+          response->rc = response->OK;
+
+          auto msg = std::make_unique<tello_msgs::msg::TelloResponse>();
+          msg->rc = msg->OK;
+          msg->str = "ok";
+          tello_response_pub_->publish(std::move(msg));
+        });
+    }
+
+    void publish_odom(const rclcpp::Time &now)
+    {
+      auto flight_data = std::make_unique<tello_msgs::msg::FlightData>();
+      flight_data->header.stamp = now;
+      flight_data->bat = 100;
+      flight_data_pub_->publish(std::move(flight_data));
+
+      auto odom = std::make_unique<nav_msgs::msg::Odometry>();
+      odom->header.stamp = now;
+      odom->header.frame_id = "map";
+      odom->pose.pose.position.z = 1;
+      odom->pose.pose.orientation.w = 1;
+      odom_pub_->publish(std::move(odom));
+    }
+
+    void publish_plan(const nav_msgs::msg::Path &plan)
+    {
+      plan_pub_->publish(plan);
+    }
+  };
+
+  class FakeDriverNode : public rclcpp::Node
+  {
+    std::vector<std::unique_ptr<FakeDriver>> drivers_;
+    rclcpp::Publisher<std_msgs::msg::Empty>::SharedPtr start_mission_pub_;
+    rclcpp::TimerBase::SharedPtr odom_timer_;
+    rclcpp::TimerBase::SharedPtr plan_timer_;
+    nav_msgs::msg::Path plan_;
+
+  public:
+
+    FakeDriverNode(const std::vector<std::string> &namespaces, int plan_size) :
+      Node{"fake_driver", rclcpp::NodeOptions().use_intra_process_comms(true)}
+    {
+      for (auto &ns : namespaces) {
+        drivers_.push_back(std::make_unique<FakeDriver>(*this, ns));
+      }
+
+      start_mission_pub_ = create_publisher<std_msgs::msg::Empty>("/start_mission", 1);
+
+      // Hover in place, the deadlines are far enough out that the plan never completes
+      plan_.header.frame_id = "map";
+      plan_.poses.resize(plan_size);
+      for (auto &pose : plan_.poses) {
+        pose.header.frame_id = "map";
+        pose.pose.position.z = 1;
+        pose.pose.orientation.w = 1;
+      }
+
+      odom_timer_ = create_wall_timer(std::chrono::milliseconds(1000 / ODOM_RATE), [this]()
+      {
+        auto stamp = now();
+        for (auto &driver : drivers_) {
+          driver->publish_odom(stamp);
+        }
+      });
+
+      plan_timer_ = create_wall_timer(std::chrono::seconds(1), [this]()
+      {
+        start_mission_pub_->publish(std_msgs::msg::Empty());
+
+        auto stamp = now();
+        plan_.header.stamp = stamp;
+        for (size_t i = 0; i < plan_.poses.size(); i++) {
+          plan_.poses[i].header.stamp = stamp + rclcpp::Duration(static_cast<int64_t>(RCL_S_TO_NS(1000 + i)));
+        }
+        for (auto &driver : drivers_) {
+          driver->publish_plan(plan_);
+        }
+      });
+    }
+  };
+
+  drone_base::LatencyHistogram run(int num_drones, bool multi_threaded, int seconds, int plan_size)
+  {
+    std::vector<std::string> namespaces;
+    for (int i = 0; i < num_drones; i++) {
+      namespaces.push_back("bench" + std::to_string(i + 1));
+    }
+
+    std::vector<std::shared_ptr<drone_base::DroneBase>> drones;
+    for (auto &ns : namespaces) {
+      auto options = rclcpp::NodeOptions()
+        .use_intra_process_comms(true)
+        .arguments({"--ros-args", "-r", "__ns:=/" + ns})
+        .parameter_overrides({rclcpp::Parameter("event_driven", 1), rclcpp::Parameter("latency_report_sec", 0.)});
+      drones.push_back(std::make_shared<drone_base::DroneBase>(options));
+    }
+
+    // The drivers get their own executor so they publish on time no matter how busy the drones are
+    auto driver = std::make_shared<FakeDriverNode>(namespaces, plan_size);
+    rclcpp::executors::SingleThreadedExecutor driver_executor;
+    driver_executor.add_node(driver);
+
+    std::unique_ptr<rclcpp::executor::Executor> drone_executor;
+    if (multi_threaded) {
+      drone_executor = std::make_unique<rclcpp::executors::MultiThreadedExecutor>();
+    } else {
+      drone_executor = std::make_unique<rclcpp::executors::SingleThreadedExecutor>();
+    }
+    for (auto &drone : drones) {
+      drone_executor->add_node(drone);
+    }
+
+    std::thread driver_thread([&driver_executor]() { driver_executor.spin(); });
+    std::thread drone_thread([&drone_executor]() { drone_executor->spin(); });
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+
+    drone_executor->cancel();
+    driver_executor.cancel();
+    drone_thread.join();
+    driver_thread.join();
+
+    drone_base::LatencyHistogram result;
+    for (auto &drone : drones) {
+      result.merge(drone->odom_latency());
+    }
+    return result;
+  }
+
+}
+
+int main(int argc, char **argv)
+{
+  rclcpp::init(argc, argv);
+
+  int seconds = 10;
+  int plan_size = 2000;
+  auto args = rclcpp::remove_ros_arguments(argc, argv);
+  for (size_t i = 1; i + 1 < args.size(); i += 2) {
+    if (args[i] == "--seconds") {
+      seconds = std::stoi(args[i + 1]);
+    } else if (args[i] == "--plan-size") {
+      plan_size = std::stoi(args[i + 1]);
+    }
+  }
+
+  // Keep the benchmark output readable
+  rcutils_logging_set_default_logger_level(RCUTILS_LOG_SEVERITY_WARN);
+
+  printf("drones  executor  samples   p50_ms   p99_ms   max_ms\n");
+  for (int num_drones : {2, 4, 8, 16}) {
+    for (bool multi_threaded : {false, true}) {
+      auto h = run(num_drones, multi_threaded, seconds, plan_size);
+      printf("%6d  %8s  %7lu  %7.2f  %7.2f  %7.2f\n",
+             num_drones, multi_threaded ? "multi" : "single", h.count(),
+             h.percentile_ns(0.5) / 1e6, h.percentile_ns(0.99) / 1e6, h.max_ns() / 1e6);
+    }
+  }
+
+  rclcpp::shutdown();
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include "flock_monitor.hpp"
+
+#include "qos_profiles.hpp"
+
+namespace flock_base
+{
+
+  // A battery that jumps up this much was swapped or charged, start a new trend
+  const int BATTERY_SWAP = 5;   // Percent
+
+  FlockMonitor::FlockMonitor(rclcpp::Node &node, const std::vector<std::string> &drones, int min_battery,
+                             double warn_sec, double trend_sec) :
+    node_{node}, min_battery_{min_battery}, warn_sec_{warn_sec}, drones_(drones.size(), Drone{trend_sec}),
+    start_ns_{node.now().nanoseconds()}
+  {
+    status_.drones.resize(drones.size());
+
+    // Callbacks find their drone by index
+    for (size_t i = 0; i < drones.size(); i++) {
+      status_.drones[i].ns = drones[i];
+
+      drones_[i].flight_data_sub_ = node_.create_subscription<tello_msgs::msg::FlightData>(
+        drones[i] + "/flight_data", drone_base::stream_qos("best_effort"),
+        [this, i](tello_msgs::msg::FlightData::SharedPtr msg)
+        {
+          Drone &d = drones_[i];
+          d.battery_ = msg->bat;
+          d.flight_data_count_++;
+          d.flight_data_ns_ = node_.now().nanoseconds();
+        });
+
+      drones_[i].odom_sub_ = node_.create_subscription<nav_msgs::msg::Odometry>(
+        drones[i] + "/base_odom", drone_base::stream_qos("best_effort"),
+        [this, i](nav_msgs::msg::Odometry::SharedPtr) { drones_[i].odom_count_++; });
+
+      drones_[i].state_sub_ = node_.create_subscription<std_msgs::msg::UInt8>(
+        drones[i] + "/state", drone_base::latched_qos(),
+        [this, i](std_msgs::msg::UInt8::SharedPtr msg) { drones_[i].state_ = msg->data; },
+        drone_base::plan_options<rclcpp::SubscriptionOptions>());
+    }
+
+    status_pub_ = node_.create_publisher<flock2::msg::FlockStatus>("/flock_status", 1);
+  }
+
+  void FlockMonitor::publish()
+  {
+    int64_t now_ns = node_.now().nanoseconds();
+    double elapsed = last_publish_ns_ > 0 ? static_cast<double>(now_ns - last_publish_ns_) / 1e9 : 0;
+    last_publish_ns_ = now_ns;
+
+    for (size_t i = 0; i < drones_.size(); i++) {
+      Drone &d = drones_[i];
+      flock2::msg::DroneStatus &s = status_.drones[i];
+
+      s.state = d.state_;
+      s.flight_data_rate = elapsed > 0 ? static_cast<float>(d.flight_data_count_ / elapsed) : 0;
+      s.odom_rate = elapsed > 0 ? static_cast<float>(d.odom_count_ / elapsed) : 0;
+      s.flight_data_age = d.flight_data_ns_ > 0 ? static_cast<float>(now_ns - d.flight_data_ns_) / 1e9f : -1;
+      d.flight_data_count_ = d.odom_count_ = 0;
+
+      if (d.battery_ < 0) {
+        continue;
+      }
+
+      if (d.battery_ > s.battery + BATTERY_SWAP) {
+        d.discharge_.reset();
+        d.warned_ = false;
+      }
+      s.battery = static_cast<uint8_t>(d.battery_);
+      d.discharge_.add(static_cast<double>(now_ns - start_ns_) / 1e9, d.battery_);
+
+      // Percent per second, positive while discharging
+      double rate = -d.discharge_.slope();
+      s.discharge_per_min = static_cast<float>(rate * 60);
+      double sec_left = rate > 0 ? (d.battery_ - min_battery_) / rate : -1;
+      s.minutes_left = sec_left >= 0 ? static_cast<float>(sec_left / 60) : -1;
+
+      // Warn once per discharge, well before drone_base lands at min_battery
+      s.battery_warning = sec_left >= 0 && sec_left < warn_sec_;
+      if (s.battery_warning && !d.warned_) {
+        RCLCPP_WARN(node_.get_logger(), "%s: battery %d%%, discharging %.1f%%/min, %.1f min to %d%%",
+                    s.ns.c_str(), d.battery_, s.discharge_per_min, s.minutes_left, min_battery_);
+      }
+      d.warned_ = d.warned_ || s.battery_warning;
+    }
+
+    status_.header.stamp = rclcpp::Time(now_ns, RCL_ROS_TIME);
+    status_pub_->publish(status_);
+  }
+
+} // namespace flock_base
@@ -0,0 +1,236 @@
+#include "flock_sim.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "rclcpp_components/register_node_macro.hpp"
+
+#include "drone_pose.hpp"
+
+namespace flock_sim
+{
+
+  using drone_base::DronePose;
+
+  // Odometry and flight data are published at least this often, must not exceed the deadlines drone_base asks for
+  const rclcpp::Duration OFFERED_DEADLINE{RCL_MS_TO_NS(1000)};
+
+//====================
+// FlockSim
+//====================
+
+  FlockSim::FlockSim(const rclcpp::NodeOptions &options) : Node{"flock_sim", options}
+  {
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOAD_PARAMETER((*this), cxt_, n, t, d)
+    CXT_MACRO_INIT_PARAMETERS(FLOCK_SIM_ALL_PARAMS, validate_parameters)
+
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_PARAMETER_CHANGED(cxt_, n, t)
+    CXT_MACRO_REGISTER_PARAMETERS_CHANGED((*this), FLOCK_SIM_ALL_PARAMS, validate_parameters)
+
+    size_t num_drones = cxt_.drones_.size();
+    for (auto v : {&x_, &y_, &z_, &yaw_, &vx_, &vy_, &vz_, &vyaw_, &cmd_x_, &cmd_y_, &cmd_z_, &cmd_yaw_}) {
+      v->resize(num_drones, 0.);
+    }
+
+    // Start on the ground in a square grid
+    auto columns = static_cast<size_t>(ceil(sqrt(static_cast<double>(num_drones))));
+    for (size_t i = 0; i < num_drones; i++) {
+      x_[i] = static_cast<double>(i % columns) * cxt_.spacing_;
+      y_[i] = static_cast<double>(i / columns) * cxt_.spacing_;
+    }
+
+    // Callbacks find their drone by index
+    drones_.resize(num_drones);
+    for (size_t i = 0; i < num_drones; i++) {
+      SimDrone &drone = drones_[i];
+      drone.ns_ = cxt_.drones_[i];
+      int d = static_cast<int>(i);
+
+      drone.cmd_vel_sub_ = create_subscription<geometry_msgs::msg::Twist>(
+        drone.ns_ + "/cmd_vel", rclcpp::QoS{rclcpp::KeepLast(1)}.best_effort(),
+        [this, d](const geometry_msgs::msg::Twist::SharedPtr msg) { cmd_vel_callback(d, msg); });
+      // Offer a deadline, so drone_base can use qos_deadline
+      drone.odom_pub_ = create_publisher<nav_msgs::msg::Odometry>(
+        drone.ns_ + "/base_odom", rclcpp::QoS{rclcpp::KeepLast(1)}.deadline(OFFERED_DEADLINE));
+      drone.flight_data_pub_ = create_publisher<tello_msgs::msg::FlightData>(
+        drone.ns_ + "/flight_data", rclcpp::QoS{rclcpp::KeepLast(1)}.deadline(OFFERED_DEADLINE));
+      drone.tello_response_pub_ = create_publisher<tello_msgs::msg::TelloResponse>(drone.ns_ + "/tello_response", 1);
+      drone.tello_action_srv_ = create_service<tello_msgs::srv::TelloAction>(
+        drone.ns_ + "/tello_action",
+        [this, d](const std::shared_ptr<tello_msgs::srv::TelloAction::Request> request,
+                  std::shared_ptr<tello_msgs::srv::TelloAction::Response> response)
+        { tello_action_callback(d, request, response); });
+    }
+
+    auto period = std::chrono::nanoseconds(static_cast<int64_t>(RCL_S_TO_NS(1) / cxt_.sim_rate_));
+    if (cxt_.publish_clock_) {
+      // Simulated time runs time_scale times faster than the wall clock, start at 1s, 0 is not a valid time
+      clock_pub_ = create_publisher<rosgraph_msgs::msg::Clock>("/clock", 10);
+      sim_ns_ = RCL_S_TO_NS(1);
+      period = std::chrono::nanoseconds(static_cast<int64_t>(period.count() / std::max(cxt_.time_scale_, 0.01)));
+    }
+    sim_timer_ = create_wall_timer(period, std::bind(&FlockSim::sim_callback, this));
+
+    RCLCPP_INFO(get_logger(), "simulating %zu drone(s) at %g Hz%s", num_drones, cxt_.sim_rate_,
+                cxt_.publish_clock_ ? ", publishing /clock" : "");
+  }
+
+  void FlockSim::validate_parameters()
+  {
+    RCLCPP_INFO(get_logger(), "FlockSim Parameters");
+
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOG_PARAMETER(RCLCPP_INFO, get_logger(), cxt_, n, t, d)
+    FLOCK_SIM_ALL_PARAMS
+  }
+
+  int64_t FlockSim::now_ns()
+  {
+    return cxt_.publish_clock_ ? sim_ns_ : now().nanoseconds();
+  }
+
+  void FlockSim::cmd_vel_callback(int drone, const geometry_msgs::msg::Twist::SharedPtr &msg)
+  {
+    cmd_x_[drone] = drone_base::PoseUtil::clamp(msg->linear.x, -1, 1);
+    cmd_y_[drone] = drone_base::PoseUtil::clamp(msg->linear.y, -1, 1);
+    cmd_z_[drone] = drone_base::PoseUtil::clamp(msg->linear.z, -1, 1);
+    cmd_yaw_[drone] = drone_base::PoseUtil::clamp(msg->angular.z, -1, 1);
+  }
+
+  void FlockSim::tello_action_callback(int drone,
+                                       const std::shared_ptr<tello_msgs::srv::TelloAction::Request> &request,
+                                       std::shared_ptr<tello_msgs::srv::TelloAction::Response> &response)
+  {
+    SimDrone &d = drones_[drone];
+
+    // Accept a maneuver that makes sense in the current phase, the result arrives on tello_response
+    Phase next;
+    if (request->cmd == "takeoff" && d.phase_ == Phase::landed) {
+      next = Phase::taking_off;
+    } else if (request->cmd == "land" && (d.phase_ == Phase::flying || d.phase_ == Phase::taking_off)) {
+      next = Phase::landing;
+    } else {
+      RCLCPP_WARN(get_logger(), "%s: reject %s", d.ns_.c_str(), request->cmd.c_str());
+      response->rc = response->ERROR_BUSY;
+      return;
+    }
+
+    d.phase_ = next;
+    d.action_end_ns_ = now_ns() + static_cast<int64_t>(RCL_S_TO_NS(cxt_.action_sec_));
+    response->rc = response->OK;
+  }
+
+  void FlockSim::integrate(double dt, int64_t t_ns)
+  {
+    // Velocities follow cmd_vel with a first order lag
+    double alpha = std::min(1., dt / std::max(cxt_.tau_, 1e-3));
+
+    for (size_t i = 0; i < drones_.size(); i++) {
+      SimDrone &d = drones_[i];
+
+      if (d.phase_ == Phase::flying) {
+        // Body frame to world frame
+        double c = cos(yaw_[i]);
+        double s = sin(yaw_[i]);
+        double target_vx = (cmd_x_[i] * c - cmd_y_[i] * s) * cxt_.max_xy_speed_;
+        double target_vy = (cmd_x_[i] * s + cmd_y_[i] * c) * cxt_.max_xy_speed_;
+
+        vx_[i] += alpha * (target_vx - vx_[i]);
+        vy_[i] += alpha * (target_vy - vy_[i]);
+        vz_[i] += alpha * (cmd_z_[i] * cxt_.max_z_speed_ - vz_[i]);
+        vyaw_[i] += alpha * (cmd_yaw_[i] * cxt_.max_yaw_rate_ - vyaw_[i]);
+
+        x_[i] += vx_[i] * dt;
+        y_[i] += vy_[i] * dt;
+        z_[i] = std::max(0.1, z_[i] + vz_[i] * dt);
+        yaw_[i] = drone_base::PoseUtil::norm_angle(yaw_[i] + vyaw_[i] * dt);
+
+      } else if (d.phase_ == Phase::taking_off || d.phase_ == Phase::landing) {
+        // Straight up or down, ignore cmd_vel
+        double target_z = d.phase_ == Phase::taking_off ? cxt_.takeoff_z_ : 0.;
+        double remaining = static_cast<double>(d.action_end_ns_ - t_ns) / 1e9;
+        vx_[i] = vy_[i] = vyaw_[i] = 0;
+
+        if (remaining <= 0) {
+          z_[i] = target_z;
+          vz_[i] = 0;
+          d.phase_ = d.phase_ == Phase::taking_off ? Phase::flying : Phase::landed;
+
+          auto msg = std::make_unique<tello_msgs::msg::TelloResponse>();
+          msg->rc = msg->OK;
+          msg->str = "ok";
+          d.tello_response_pub_->publish(std::move(msg));
+        } else {
+          vz_[i] = (target_z - z_[i]) / remaining;
+          z_[i] += vz_[i] * dt;
+        }
+      }
+
+      // Reset cmd_vel once landed, the next flight starts from a hover
+      if (d.phase_ == Phase::landed) {
+        cmd_x_[i] = cmd_y_[i] = cmd_z_[i] = cmd_yaw_[i] = 0;
+      }
+    }
+  }
+
+  void FlockSim::publish(int64_t t_ns)
+  {
+    rclcpp::Time stamp(t_ns, RCL_ROS_TIME);
+
+    for (size_t i = 0; i < drones_.size(); i++) {
+      auto odom = std::make_unique<nav_msgs::msg::Odometry>();
+      odom->header.stamp = stamp;
+      odom->header.frame_id = "map";
+      odom->child_frame_id = "base_link";
+
+      DronePose pose;
+      pose.x = x_[i];
+      pose.y = y_[i];
+      pose.z = z_[i];
+      pose.yaw = yaw_[i];
+      pose.toMsg(odom->pose.pose);
+
+      // The twist is in child_frame_id, rotate the world frame velocity into the body frame
+      drone_base::PoseUtil::rotate_frame(vx_[i], vy_[i], yaw_[i],
+                                         odom->twist.twist.linear.x, odom->twist.twist.linear.y);
+      odom->twist.twist.linear.z = vz_[i];
+      odom->twist.twist.angular.z = vyaw_[i];
+
+      drones_[i].odom_pub_->publish(std::move(odom));
+    }
+
+    if (t_ns >= next_flight_data_ns_) {
+      next_flight_data_ns_ = t_ns + static_cast<int64_t>(RCL_S_TO_NS(1) / cxt_.flight_data_rate_);
+
+      for (auto &drone : drones_) {
+        auto flight_data = std::make_unique<tello_msgs::msg::FlightData>();
+        flight_data->header.stamp = stamp;
+        flight_data->bat = 100;
+        drone.flight_data_pub_->publish(std::move(flight_data));
+      }
+    }
+  }
+
+  void FlockSim::sim_callback()
+  {
+    int64_t dt_ns = static_cast<int64_t>(RCL_S_TO_NS(1) / cxt_.sim_rate_);
+
+    if (cxt_.publish_clock_) {
+      sim_ns_ += dt_ns;
+
+      auto clock = std::make_unique<rosgraph_msgs::msg::Clock>();
+      clock->clock = rclcpp::Time(sim_ns_, RCL_ROS_TIME);
+      clock_pub_->publish(std::move(clock));
+    }
+
+    int64_t t_ns = now_ns();
+    integrate(static_cast<double>(dt_ns) / 1e9, t_ns);
+    publish(t_ns);
+  }
+
+} // namespace flock_sim
+
+RCLCPP_COMPONENTS_REGISTER_NODE(flock_sim::FlockSim)
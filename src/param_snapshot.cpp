@@ -0,0 +1,97 @@
+#include "param_snapshot.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace
+{
+  std::string quote(const std::string &s)
+  {
+    // YAML single quotes, a quote is written twice
+    std::string result = "'";
+    for (char c : s) {
+      result += c;
+      if (c == '\'') {
+        result += c;
+      }
+    }
+    return result + "'";
+  }
+
+  // Always has a '.' or an exponent, so it reads back as a double
+  std::string yaml_double(double d)
+  {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.17g", d);
+    std::string result = buffer;
+    if (result.find_first_of(".en") == std::string::npos) {
+      result += ".0";
+    }
+    return result;
+  }
+
+  // Empty for an empty array, the parameter file can't say what type it is
+  template<typename T, typename F>
+  std::string yaml_array(const std::vector<T> &values, F f)
+  {
+    if (values.empty()) {
+      return "";
+    }
+
+    std::string result = "[";
+    for (size_t i = 0; i < values.size(); i++) {
+      result += (i > 0 ? ", " : "") + f(values[i]);
+    }
+    return result + "]";
+  }
+
+  // Empty if the type can't go in a parameter file
+  std::string yaml_value(const rclcpp::ParameterValue &value)
+  {
+    switch (value.get_type()) {
+      case rclcpp::ParameterType::PARAMETER_BOOL:
+      case rclcpp::ParameterType::PARAMETER_INTEGER:
+        return rclcpp::to_string(value);
+      case rclcpp::ParameterType::PARAMETER_BOOL_ARRAY:
+        return yaml_array(value.get<std::vector<bool>>(), [](bool b) { return std::string(b ? "true" : "false"); });
+      case rclcpp::ParameterType::PARAMETER_INTEGER_ARRAY:
+        return yaml_array(value.get<std::vector<int64_t>>(), [](int64_t i) { return std::to_string(i); });
+      case rclcpp::ParameterType::PARAMETER_DOUBLE:
+        return yaml_double(value.get<double>());
+      case rclcpp::ParameterType::PARAMETER_STRING:
+        return quote(value.get<std::string>());
+      case rclcpp::ParameterType::PARAMETER_DOUBLE_ARRAY:
+        return yaml_array(value.get<std::vector<double>>(), yaml_double);
+      case rclcpp::ParameterType::PARAMETER_STRING_ARRAY:
+        return yaml_array(value.get<std::vector<std::string>>(), quote);
+      default:
+        return "";
+    }
+  }
+}
+
+namespace drone_base
+{
+
+  bool write_param_snapshot(rclcpp::Node &node, const std::string &path)
+  {
+    auto names = node.list_parameters({}, rcl_interfaces::srv::ListParameters::Request::DEPTH_RECURSIVE).names;
+    names.erase(std::remove(names.begin(), names.end(), "use_sim_time"), names.end());
+    std::sort(names.begin(), names.end());
+
+    std::ofstream out(path);
+    out << "# Parameter snapshot of " << node.get_fully_qualified_name() << "\n";
+    out << node.get_fully_qualified_name() << ":\n";
+    out << "  ros__parameters:\n";
+    for (const auto &parameter : node.get_parameters(names)) {
+      auto value = yaml_value(parameter.get_parameter_value());
+      if (!value.empty()) {
+        out << "    " << parameter.get_name() << ": " << value << "\n";
+      }
+    }
+
+    return out.good();
+  }
+
+} // namespace drone_base
@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "rclcpp/rclcpp.hpp"
+#include "rmw/rmw.h"
+#include "rosidl_typesupport_cpp/message_type_support.hpp"
+
+#include "plan_cache.hpp"
+#include "plan_codec.hpp"
+
+//=============================================================================
+// Compare nav_msgs/Path and flock2/CompactPlan: serialized size, serialize and deserialize time,
+// time to convert between the two, and time to build the PlanCache that the flight controllers use.
+// The compact row's cache is built from the decoded plan, as drone_base does.
+//
+// Usage: plan_bench [--repeat 100]
+//
+// Plans are 10, 100, 1000 and 10000 waypoints along a 1m circle, 1 waypoint per second.
+// Serialization goes through the rmw layer, so the numbers include the middleware's CDR encoding.
+//=============================================================================
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  nav_msgs::msg::Path make_path(size_t waypoints, int64_t t0_ns)
+  {
+    nav_msgs::msg::Path path;
+    path.header.frame_id = "map";
+    path.header.stamp = rclcpp::Time(t0_ns);
+
+    for (size_t i = 0; i < waypoints; i++) {
+      geometry_msgs::msg::PoseStamped pose;
+      pose.header.frame_id = "map";
+      pose.header.stamp = rclcpp::Time(t0_ns + static_cast<int64_t>(i) * RCL_S_TO_NS(1));
+      drone_base::DronePose p;
+      double a = static_cast<double>(i) * 0.1;
+      p.x = std::cos(a);
+      p.y = std::sin(a);
+      p.z = 1;
+      p.yaw = drone_base::PoseUtil::norm_angle(a);
+      p.toMsg(pose.pose);
+      path.poses.push_back(pose);
+    }
+
+    return path;
+  }
+
+  // Average ns per call
+  template<typename F>
+  double time_ns(int repeat, F f)
+  {
+    auto start = Clock::now();
+    for (int r = 0; r < repeat; r++) {
+      f();
+    }
+    auto stop = Clock::now();
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count()) / repeat;
+  }
+
+  struct Result
+  {
+    size_t bytes{};
+    double serialize_ns{};
+    double deserialize_ns{};
+  };
+
+  template<typename MsgT>
+  bool measure(const MsgT &msg, int repeat, Result &result)
+  {
+    auto type_support = rosidl_typesupport_cpp::get_message_type_support_handle<MsgT>();
+    auto allocator = rcutils_get_default_allocator();
+    rmw_serialized_message_t serialized = rmw_get_zero_initialized_serialized_message();
+    if (rmw_serialized_message_init(&serialized, 0, &allocator) != RMW_RET_OK) {
+      return false;
+    }
+
+    // The buffer grows on the first call, and is reused after that
+    bool ok = rmw_serialize(&msg, type_support, &serialized) == RMW_RET_OK;
+    if (ok) {
+      result.bytes = serialized.buffer_length;
+      result.serialize_ns = time_ns(repeat, [&]() { rmw_serialize(&msg, type_support, &serialized); });
+
+      MsgT out;
+      result.deserialize_ns = time_ns(repeat, [&]() { rmw_deserialize(&serialized, type_support, &out); });
+    }
+
+    (void) rmw_serialized_message_fini(&serialized);
+    return ok;
+  }
+
+}
+
+int main(int argc, char **argv)
+{
+  rclcpp::init(argc, argv);
+
+  int repeat = 100;
+
+  auto args = rclcpp::remove_ros_arguments(argc, argv);
+  for (size_t i = 1; i < args.size(); i++) {
+    bool has_value = i + 1 < args.size();
+    if (args[i] == "--repeat" && has_value) {
+      repeat = std::max(1, std::stoi(args[++i]));
+    }
+  }
+
+  int exit_code = 0;
+  int64_t t0_ns = rclcpp::Clock().now().nanoseconds();
+
+  printf("waypoints  format    bytes  serialize_us  deserialize_us  convert_us  cache_us\n");
+  for (size_t n : {10, 100, 1000, 10000}) {
+    auto path = std::make_shared<nav_msgs::msg::Path>(make_path(n, t0_ns));
+    flock2::msg::CompactPlan compact;
+    drone_base::to_compact(*path, compact);
+
+    Result path_result, compact_result;
+    if (!measure(*path, repeat, path_result) || !measure(compact, repeat, compact_result)) {
+      fprintf(stderr, "rmw_serialize failed\n");
+      exit_code = 1;
+      break;
+    }
+
+    // What the drone does with each format before the controller can use it
+    drone_base::PlanCache cache;
+    double path_cache_ns = time_ns(repeat, [&]() { cache.build(path, 0); });
+    auto expanded = std::make_shared<nav_msgs::msg::Path>();
+    double convert_ns = time_ns(repeat, [&]() { (void) drone_base::from_compact(compact, *expanded); });
+    double compact_cache_ns = time_ns(repeat, [&]() { cache.build(expanded, 0); });
+
+    printf("%9lu  %-7s  %7lu  %12.1f  %14.1f  %10s  %8.1f\n", n, "path", path_result.bytes,
+           path_result.serialize_ns / 1e3, path_result.deserialize_ns / 1e3, "-", path_cache_ns / 1e3);
+    printf("%9lu  %-7s  %7lu  %12.1f  %14.1f  %10.1f  %8.1f\n", n, "compact", compact_result.bytes,
+           compact_result.serialize_ns / 1e3, compact_result.deserialize_ns / 1e3, convert_ns / 1e3,
+           compact_cache_ns / 1e3);
+  }
+
+  rclcpp::shutdown();
+  return exit_code;
+}
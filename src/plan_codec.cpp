@@ -0,0 +1,78 @@
+#include "plan_codec.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "drone_pose.hpp"
+
+namespace drone_base
+{
+
+  void to_compact(const nav_msgs::msg::Path &path, flock2::msg::CompactPlan &plan, size_t first, size_t count)
+  {
+    plan.header = path.header;
+
+    first = std::min(first, path.poses.size());
+    size_t n = std::min(count, path.poses.size() - first);
+    plan.first_index = static_cast<uint32_t>(first);
+    plan.end_of_plan = first + n == path.poses.size();
+    for (auto v : {&plan.x, &plan.y, &plan.z, &plan.yaw}) {
+      v->resize(n);
+    }
+    plan.dt_ms.resize(n);
+
+    int64_t base_ns = PoseUtil::to_ns(path.header.stamp);
+    int64_t prev_ms = 0;
+    for (size_t i = 0; i < n; i++) {
+      DronePose pose;
+      pose.fromMsg(path.poses[first + i].pose);
+      plan.x[i] = static_cast<float>(pose.x);
+      plan.y[i] = static_cast<float>(pose.y);
+      plan.z[i] = static_cast<float>(pose.z);
+      plan.yaw[i] = static_cast<float>(pose.yaw);
+
+      int64_t t_ms = std::llround(
+        static_cast<double>(PoseUtil::to_ns(path.poses[first + i].header.stamp) - base_ns) / 1e6);
+      t_ms = std::max(t_ms, prev_ms);
+      plan.dt_ms[i] = static_cast<uint32_t>(t_ms - prev_ms);
+      prev_ms = t_ms;
+    }
+  }
+
+  bool valid_compact(const flock2::msg::CompactPlan &plan)
+  {
+    size_t n = plan.dt_ms.size();
+    return plan.x.size() == n && plan.y.size() == n && plan.z.size() == n && plan.yaw.size() == n;
+  }
+
+  bool from_compact(const flock2::msg::CompactPlan &plan, nav_msgs::msg::Path &path)
+  {
+    if (!valid_compact(plan)) {
+      return false;
+    }
+
+    path.header = plan.header;
+
+    size_t n = plan.dt_ms.size();
+    path.poses.resize(n);
+
+    int64_t t_ns = PoseUtil::to_ns(plan.header.stamp);
+    for (size_t i = 0; i < n; i++) {
+      t_ns += RCL_MS_TO_NS(static_cast<int64_t>(plan.dt_ms[i]));
+
+      auto &pose = path.poses[i];
+      pose.header.frame_id = plan.header.frame_id;
+      pose.header.stamp = rclcpp::Time(t_ns, RCL_ROS_TIME);
+
+      DronePose p;
+      p.x = plan.x[i];
+      p.y = plan.y[i];
+      p.z = plan.z[i];
+      p.yaw = plan.yaw[i];
+      p.toMsg(pose.pose);
+    }
+
+    return true;
+  }
+
+} // namespace drone_base
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "rclcpp/rclcpp.hpp"
+#include "rmw/rmw.h"
+#include "rosidl_typesupport_cpp/message_type_support.hpp"
+
+#include "plan_codec.hpp"
+#include "simple_planner.hpp"
+
+//=============================================================================
+// Time to create the simple planner and its plans for 4 to 64 drones, and the bytes sent per mission
+//
+// Usage: planner_bench [--repeat 100]
+//
+// The landing poses are on a square grid, 1m apart. "fresh" builds new paths every mission, "reused" writes
+// into the paths left over from the last mission, which is what planner_node does. Bytes are the serialized
+// size of all plans, as nav_msgs/Path and as flock2/CompactPlan.
+//=============================================================================
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  std::vector<geometry_msgs::msg::PoseStamped> make_landing_poses(size_t drones)
+  {
+    auto side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(drones))));
+    std::vector<geometry_msgs::msg::PoseStamped> poses;
+    for (size_t i = 0; i < drones; i++) {
+      geometry_msgs::msg::PoseStamped pose;
+      pose.header.frame_id = "map";
+      pose.pose.position.x = static_cast<double>(i % side);
+      pose.pose.position.y = static_cast<double>(i / side);
+      pose.pose.orientation.w = 1;
+      poses.push_back(pose);
+    }
+    return poses;
+  }
+
+  // Average ns per call
+  template<typename F>
+  double time_ns(int repeat, F f)
+  {
+    auto start = Clock::now();
+    for (int r = 0; r < repeat; r++) {
+      f();
+    }
+    auto stop = Clock::now();
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count()) / repeat;
+  }
+
+  // Serialized size, 0 on failure
+  template<typename MsgT>
+  size_t serialized_bytes(const MsgT &msg, rmw_serialized_message_t &serialized)
+  {
+    auto type_support = rosidl_typesupport_cpp::get_message_type_support_handle<MsgT>();
+    return rmw_serialize(&msg, type_support, &serialized) == RMW_RET_OK ? serialized.buffer_length : 0;
+  }
+
+}
+
+int main(int argc, char **argv)
+{
+  rclcpp::init(argc, argv);
+
+  int repeat = 100;
+
+  auto args = rclcpp::remove_ros_arguments(argc, argv);
+  for (size_t i = 1; i < args.size(); i++) {
+    bool has_value = i + 1 < args.size();
+    if (args[i] == "--repeat" && has_value) {
+      repeat = std::max(1, std::stoi(args[++i]));
+    }
+  }
+
+  auto allocator = rcutils_get_default_allocator();
+  rmw_serialized_message_t serialized = rmw_get_zero_initialized_serialized_message();
+  if (rmw_serialized_message_init(&serialized, 0, &allocator) != RMW_RET_OK) {
+    fprintf(stderr, "rmw_serialized_message_init failed\n");
+    rclcpp::shutdown();
+    return 1;
+  }
+
+  int exit_code = 0;
+  rclcpp::Time now = rclcpp::Clock().now();
+
+  printf("drones  waypoints  create_us  fresh_us  reused_us  path_bytes  compact_bytes\n");
+  for (size_t n : {4, 8, 16, 32, 64}) {
+    auto landing_poses = make_landing_poses(n);
+
+    double create_ns = time_ns(repeat, [&]() { simple_planner::SimplePlanner planner(landing_poses); });
+
+    simple_planner::SimplePlanner planner(landing_poses);
+    double fresh_ns = time_ns(repeat, [&]() { (void) planner.plans(now); });
+
+    std::vector<nav_msgs::msg::Path> plans;
+    planner.fill_plans(now, plans);
+    double reused_ns = time_ns(repeat, [&]() { planner.fill_plans(now, plans); });
+
+    size_t waypoints = 0, path_bytes = 0, compact_bytes = 0;
+    flock2::msg::CompactPlan compact;
+    for (const auto &plan : plans) {
+      waypoints += plan.poses.size();
+      drone_base::to_compact(plan, compact);
+      size_t p = serialized_bytes(plan, serialized);
+      size_t c = serialized_bytes(compact, serialized);
+      if (p == 0 || c == 0) {
+        exit_code = 1;
+      }
+      path_bytes += p;
+      compact_bytes += c;
+    }
+
+    if (exit_code != 0) {
+      fprintf(stderr, "rmw_serialize failed\n");
+      break;
+    }
+
+    printf("%6lu  %9lu  %9.1f  %8.1f  %9.1f  %10lu  %13lu\n", n, waypoints, create_ns / 1e3, fresh_ns / 1e3,
+           reused_ns / 1e3, path_bytes, compact_bytes);
+  }
+
+  (void) rmw_serialized_message_fini(&serialized);
+  rclcpp::shutdown();
+  return exit_code;
+}
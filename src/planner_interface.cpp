@@ -0,0 +1,119 @@
+#include "planner_interface.hpp"
+
+namespace planner_node
+{
+
+  const rclcpp::Duration DELAY_STEP{1000000000};
+
+  // The drone waits at waypoint 0 from the time the plan is sent until the (possibly delayed) first timestamp
+  collision_index::Segment hold(int drone, const nav_msgs::msg::Path &plan, const rclcpp::Duration &delay)
+  {
+    const auto &p0 = plan.poses[0].pose.position;
+    return collision_index::Segment{
+      drone,
+      rclcpp::Time(plan.header.stamp).nanoseconds(),
+      rclcpp::Time(plan.poses[0].header.stamp).nanoseconds() + delay.nanoseconds(),
+      {p0.x, p0.y, p0.z},
+      {p0.x, p0.y, p0.z}};
+  }
+
+  void PlannerInterface::segments(int drone, const nav_msgs::msg::Path &plan,
+                                  std::vector<collision_index::Segment> &segments) const
+  {
+    segments.clear();
+    for (size_t i = 1; i < plan.poses.size(); i++) {
+      const auto &p0 = plan.poses[i - 1];
+      const auto &p1 = plan.poses[i];
+      segments.push_back(collision_index::Segment{
+        drone,
+        rclcpp::Time(p0.header.stamp).nanoseconds(),
+        rclcpp::Time(p1.header.stamp).nanoseconds(),
+        {p0.pose.position.x, p0.pose.position.y, p0.pose.position.z},
+        {p1.pose.position.x, p1.pose.position.y, p1.pose.position.z}});
+    }
+  }
+
+  void PlannerInterface::insert(collision_index::CollisionIndex &index, int drone,
+                                const nav_msgs::msg::Path &plan) const
+  {
+    if (plan.poses.empty()) {
+      return;
+    }
+
+    std::vector<collision_index::Segment> plan_segments;
+    segments(drone, plan, plan_segments);
+    plan_segments.push_back(hold(drone, plan, rclcpp::Duration(0)));
+    for (auto &segment : plan_segments) {
+      if (segment.t1_ns >= segment.t0_ns) {
+        index.insert(segment);
+      }
+    }
+  }
+
+  bool PlannerInterface::insert_clear(collision_index::CollisionIndex &index, int drone, nav_msgs::msg::Path &plan,
+                                      const rclcpp::Duration &max_delay, rclcpp::Duration &delay)
+  {
+    delay = rclcpp::Duration(0);
+    if (plan.poses.empty()) {
+      return true;
+    }
+
+    std::vector<collision_index::Segment> plan_segments;
+    segments(drone, plan, plan_segments);
+
+    while (true) {
+      // Shifting the plan in time doesn't change its shape, so shift the segments too
+      collision_index::Conflict conflict{};
+      bool clear = true;
+      for (auto &segment : plan_segments) {
+        collision_index::Segment shifted = segment;
+        shifted.t0_ns += delay.nanoseconds();
+        shifted.t1_ns += delay.nanoseconds();
+        if (index.query(shifted, conflict)) {
+          clear = false;
+          break;
+        }
+      }
+
+      auto wait = hold(drone, plan, delay);
+      if (clear && wait.t1_ns >= wait.t0_ns && index.query(wait, conflict)) {
+        clear = false;
+      }
+
+      if (clear) {
+        break;
+      }
+
+      if (delay.nanoseconds() + DELAY_STEP.nanoseconds() > max_delay.nanoseconds()) {
+        char buffer[100];
+        snprintf(buffer, sizeof(buffer), "plans %d and %d are %.2fm apart, even with a %.1fs delay",
+                 conflict.drone_a, conflict.drone_b, conflict.distance, delay.seconds());
+        error_ = buffer;
+        return false;
+      }
+
+      delay = delay + DELAY_STEP;
+    }
+
+    if (delay.nanoseconds() > 0) {
+      for (auto &pose : plan.poses) {
+        pose.header.stamp = rclcpp::Time(pose.header.stamp) + delay;
+      }
+    }
+
+    for (auto &segment : plan_segments) {
+      segment.t0_ns += delay.nanoseconds();
+      segment.t1_ns += delay.nanoseconds();
+      index.insert(segment);
+    }
+
+    // The plan has been shifted, so the hold ends at the new first timestamp
+    auto wait = hold(drone, plan, rclcpp::Duration(0));
+    if (wait.t1_ns >= wait.t0_ns) {
+      index.insert(wait);
+    }
+
+    return true;
+  }
+
+} // namespace planner_node
@@ -1,6 +1,15 @@
 #include "planner_node.hpp"
 
+#include <algorithm>
+#include <chrono>
+
+#include "rclcpp_components/register_node_macro.hpp"
+
+#include "drone_pose.hpp"
+#include "plan_codec.hpp"
+#include "qos_profiles.hpp"
 #include "simple_planner.hpp"
+#include "spline_planner.hpp"
 
 namespace planner_node
 {
@@ -17,6 +26,12 @@ namespace planner_node
   const double MIN_ARENA_XY = 2.0;
   const double GROUND_EPSILON = 1.2;
 
+// The takeoff is done when the drone is this far above the landing pose
+  const double AIRBORNE_Z = 0.5;
+
+// Waypoint 0 timing when each drone takes off on its own, includes time to send plan and send takeoff command and takeoff
+  const rclcpp::Duration TAKEOFF{9000000000};
+
 //====================
 // Utilities
 //====================
@@ -31,13 +46,24 @@ namespace planner_node
 // DroneInfo
 //====================
 
-  DroneInfo::DroneInfo(rclcpp::Node *node, std::string ns) : ns_{ns}, valid_landing_pose_{false}
+  DroneInfo::DroneInfo(rclcpp::Node *node, std::string ns, const rclcpp::QoS &odom_qos, bool compact_plans,
+                       size_t stream_window, double stream_lookahead_sec) :
+    ns_{ns}, valid_landing_pose_{false}, valid_pose_{false}, clock_{node->get_clock()}, stream_window_{stream_window},
+    stream_lookahead_ns_{static_cast<int64_t>(RCL_S_TO_NS(stream_lookahead_sec))}, takeoff_start_{0, RCL_ROS_TIME}
   {
     auto odom_cb = std::bind(&DroneInfo::odom_callback, this, std::placeholders::_1);
 
     // TODO move topics to cxt
-    odom_sub_ = node->create_subscription<nav_msgs::msg::Odometry>(ns + "/base_odom", 10, odom_cb);
-    plan_pub_ = node->create_publisher<nav_msgs::msg::Path>(ns + "/plan", 1);
+    // The plan is latched, a drone_base that starts late still gets it
+    odom_sub_ = node->create_subscription<nav_msgs::msg::Odometry>(ns + "/base_odom", odom_qos, odom_cb);
+    if (compact_plans || stream_window > 0) {
+      compact_plan_pub_ = node->create_publisher<flock2::msg::CompactPlan>(
+        ns + "/compact_plan", stream_window > 0 ? drone_base::plan_stream_qos() : drone_base::plan_qos(),
+        drone_base::plan_options<rclcpp::PublisherOptions>());
+    } else {
+      plan_pub_ = node->create_publisher<nav_msgs::msg::Path>(ns + "/plan", drone_base::plan_qos(),
+                                                              drone_base::plan_options<rclcpp::PublisherOptions>());
+    }
   }
 
   void DroneInfo::odom_callback(const nav_msgs::msg::Odometry::SharedPtr msg)
@@ -48,13 +74,74 @@ namespace planner_node
       landing_pose_.pose.position.z = 0;
       valid_landing_pose_ = true;
     }
+
+    if (takeoff_start_.nanoseconds() > 0 && valid_landing_pose_ &&
+        msg->pose.pose.position.z - landing_pose_.pose.position.z > AIRBORNE_Z) {
+      takeoff_stats_.add((rclcpp::Time(msg->header.stamp) - takeoff_start_).seconds());
+      takeoff_start_ = rclcpp::Time(0, RCL_ROS_TIME);
+    }
+
+    pose_ = msg->pose.pose;
+    valid_pose_ = true;
+  }
+
+  void DroneInfo::publish_plan(nav_msgs::msg::Path &&plan)
+  {
+    plan_ = std::move(plan);
+    if (stream_window_ > 0) {
+      // The first window goes out now, the rest as the drone needs them
+      next_index_ = 0;
+      stream_plan();
+    } else if (compact_plan_pub_) {
+      auto msg = std::make_unique<flock2::msg::CompactPlan>();
+      drone_base::to_compact(plan_, *msg);
+      compact_plan_pub_->publish(std::move(msg));
+    } else {
+      // Plans don't use intra-process comms, so publishing by reference doesn't cost a copy
+      plan_pub_->publish(plan_);
+    }
+  }
+
+  void DroneInfo::stream_plan()
+  {
+    // Don't send more windows than the topic keeps, the rest go out at the next tick
+    int64_t horizon_ns = clock_->now().nanoseconds() + stream_lookahead_ns_;
+    for (size_t sent = 0; sent < drone_base::PLAN_STREAM_DEPTH && next_index_ < plan_.poses.size() &&
+                          (next_index_ == 0 ||
+                           drone_base::PoseUtil::to_ns(plan_.poses[next_index_ - 1].header.stamp) < horizon_ns);
+         sent++) {
+      auto msg = std::make_unique<flock2::msg::CompactPlan>();
+      drone_base::to_compact(plan_, *msg, next_index_, stream_window_);
+      next_index_ += msg->dt_ms.size();
+      compact_plan_pub_->publish(std::move(msg));
+    }
+  }
+
+//====================
+// Planner factory
+//====================
+
+  bool known_planner(const std::string &name)
+  {
+    return name == "simple" || name == "spline";
+  }
+
+  std::unique_ptr<PlannerInterface> make_planner(const std::string &name,
+                                                 const std::vector<geometry_msgs::msg::PoseStamped> &landing_poses,
+                                                 const PlannerParams &params)
+  {
+    if (name == "spline") {
+      return std::make_unique<spline_planner::SplinePlanner>(landing_poses, params);
+    } else {
+      return std::make_unique<simple_planner::SimplePlanner>(landing_poses, params.stabilize);
+    }
   }
 
 //====================
 // PlannerNode
 //====================
 
-  PlannerNode::PlannerNode() : Node{"planner_node"}
+  PlannerNode::PlannerNode(const rclcpp::NodeOptions &options) : Node{"planner_node", options}
   {
 #undef CXT_MACRO_MEMBER
 #define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOAD_PARAMETER((*this), cxt_, n, t, d)
@@ -79,13 +166,28 @@ namespace planner_node
 
     start_mission_sub_ = create_subscription<std_msgs::msg::Empty>("/start_mission", 10, start_mission_cb);
     stop_mission_sub_ = create_subscription<std_msgs::msg::Empty>("/stop_mission", 10, stop_mission_cb);
+    flock_airborne_sub_ = create_subscription<std_msgs::msg::Header>(
+      "/flock_airborne", 10, std::bind(&PlannerNode::flock_airborne_callback, this, std::placeholders::_1));
 
     for (auto i = cxt_.drones_.begin(); i != cxt_.drones_.end(); i++) {
-      drones_.push_back(std::make_shared<DroneInfo>(this, *i));
+      drones_.push_back(std::make_shared<DroneInfo>(this, *i, drone_base::stream_qos(cxt_.sensor_qos_),
+                                                    cxt_.compact_plans_, cxt_.stream_window_,
+                                                    cxt_.stream_lookahead_sec_));
+    }
+
+    replan_timer_ = create_wall_timer(std::chrono::seconds(1), std::bind(&PlannerNode::replan_timer_callback, this));
+
+    if (cxt_.stream_window_ > 0) {
+      stream_timer_ = create_wall_timer(std::chrono::milliseconds(1000 / SPIN_RATE), [this]()
+      {
+        for (auto &drone : drones_) {
+          drone->stream_plan();
+        }
+      });
     }
   }
 
-  void PlannerNode::create_and_publish_plans()
+  void PlannerNode::create_and_publish_plans(const rclcpp::Time &start, const rclcpp::Duration &takeoff)
   {
     // Check arena volume
     if (std::abs(cxt_.arena_x_) < MIN_ARENA_XY || std::abs(cxt_.arena_y_) < MIN_ARENA_XY ||
@@ -103,65 +205,207 @@ namespace planner_node
     }
 
     // Create N plans
-    std::vector<geometry_msgs::msg::PoseStamped> landing_poses;
-    for (auto i = drones_.begin(); i != drones_.end(); i++) {
-      landing_poses.push_back((*i)->landing_pose());
+    auto build_start = std::chrono::steady_clock::now();
+    update_planner();
+    planner_->set_takeoff(takeoff);
+    plans_.resize(drones_.size());
+    for (size_t i = 0; i < drones_.size(); i++) {
+      // Planning may fail, and replanning and streaming need the current plan
+      if (drones_[i]->plan().poses.empty()) {
+        plans_[i] = drones_[i]->take_plan();
+      }
+    }
+    planner_->fill_plans(start, plans_);
+    if (plans_.empty()) {
+      RCLCPP_ERROR(get_logger(), "no plan: %s", planner_->error().c_str());
+      planner_.reset();
+      return;
+    }
+
+    // Delay plans that come too close to the plans before them
+    collision_index::CollisionIndex index(cxt_.min_separation_);
+    for (int i = 0; i < plans_.size(); i++) {
+      rclcpp::Duration delay(0);
+      if (!planner_->insert_clear(index, i, plans_[i], max_delay(), delay)) {
+        RCLCPP_ERROR(get_logger(), "no plan: %s", planner_->error().c_str());
+        planner_.reset();
+        return;
+      }
+      if (delay.nanoseconds() > 0) {
+        RCLCPP_INFO(get_logger(), "%s delayed %.1fs to keep clear", drones_[i]->ns().c_str(), delay.seconds());
+      }
     }
-    simple_planner::SimplePlanner planner(landing_poses);
-    std::vector<nav_msgs::msg::Path> plans = planner.plans(now());
-    RCLCPP_INFO(get_logger(), "plan(s) created");
+
+    auto elapsed = std::chrono::steady_clock::now() - build_start;
+    RCLCPP_INFO(get_logger(), "%s plan(s) created and checked in %.2fms, %zu index entries", cxt_.planner_.c_str(),
+                std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() / 1000., index.num_pieces());
 
     // Publish N plans
     for (int i = 0; i < drones_.size(); i++) {
-      drones_[i]->plan_pub()->publish(plans[i]);
+      drones_[i]->publish_plan(std::move(plans_[i]));
     }
   }
 
+  void PlannerNode::update_planner()
+  {
+    PlannerParams params{cxt_.arena_x_, cxt_.arena_y_, cxt_.arena_z_, cxt_.max_speed_, cxt_.min_separation_,
+                         cxt_.stabilize_time_sec_};
+    bool same = planner_ && planner_name_ == cxt_.planner_ && planner_params_ == params &&
+                landing_poses_.size() == drones_.size();
+
+    // Refresh the landing poses in place, the vector keeps its storage
+    landing_poses_.resize(drones_.size());
+    for (size_t i = 0; i < drones_.size(); i++) {
+      const auto &p0 = landing_poses_[i].pose.position;
+      const auto &p1 = drones_[i]->landing_pose().pose.position;
+      same = same && p0.x == p1.x && p0.y == p1.y && p0.z == p1.z;
+      landing_poses_[i] = drones_[i]->landing_pose();
+    }
+
+    if (!same) {
+      planner_ = make_planner(cxt_.planner_, landing_poses_, params);
+      planner_name_ = cxt_.planner_;
+      planner_params_ = params;
+    }
+  }
+
+  // Recompute the rest of the plan for any drone that's falling behind, leave the other plans alone
+  void PlannerNode::replan_timer_callback()
+  {
+    if (!cxt_.replan_ || !planner_) {
+      return;
+    }
+
+    auto t = now();
+    for (int i = 0; i < drones_.size(); i++) {
+      auto &drone = drones_[i];
+      if (!drone->valid_pose() || drone->plan().poses.empty()) {
+        continue;
+      }
+
+      double lag = planner_->lag(drone->plan(), drone->pose(), t);
+      if (lag < cxt_.replan_lag_) {
+        continue;
+      }
+
+      // The new plan must keep clear of everyone else's current plan
+      collision_index::CollisionIndex index(cxt_.min_separation_);
+      for (int j = 0; j < drones_.size(); j++) {
+        if (j != i) {
+          planner_->insert(index, j, drones_[j]->plan());
+        }
+      }
+
+      nav_msgs::msg::Path plan;
+      rclcpp::Duration delay(0);
+      if (planner_->replan(drone->plan(), drone->pose(), t, plan) &&
+          planner_->insert_clear(index, i, plan, max_delay(), delay)) {
+        RCLCPP_INFO(get_logger(), "%s is %.2fm behind, replanned %zu waypoints, delay %.1fs",
+                    drone->ns().c_str(), lag, plan.poses.size(), delay.seconds());
+        drone->publish_plan(std::move(plan));
+      } else {
+        RCLCPP_WARN(get_logger(), "%s is %.2fm behind, can't replan: %s",
+                    drone->ns().c_str(), lag, planner_->error().c_str());
+        drone->clear_plan();
+      }
+    }
+  }
+
+  rclcpp::Duration PlannerNode::takeoff_buffer() const
+  {
+    if (!cxt_.adaptive_timing_) {
+      return TAKEOFF;
+    }
+
+    // Wait for the slowest drone, fall back to TAKEOFF until every drone has taken off a few times
+    double sec = 0;
+    for (auto &drone : drones_) {
+      if (drone->takeoff_stats().count() < drone_base::RunningStats::MIN_SAMPLES) {
+        return TAKEOFF;
+      }
+      sec = std::max(sec, drone->takeoff_stats().bound(cxt_.timing_sigmas_, 0));
+    }
+    sec += cxt_.takeoff_margin_sec_;
+
+    RCLCPP_INFO(get_logger(), "takeoff buffer %.2fs, was %.2fs", sec, TAKEOFF.seconds());
+    return rclcpp::Duration(static_cast<int64_t>(RCL_S_TO_NS(sec)));
+  }
+
   void PlannerNode::start_mission_callback(const std_msgs::msg::Empty::SharedPtr msg)
   {
     (void) msg;
     RCLCPP_INFO(get_logger(), "start mission");
-    create_and_publish_plans();
+    for (auto &drone : drones_) {
+      drone->start_takeoff_timer(now());
+    }
+
+    if (cxt_.flock_takeoff_) {
+      waiting_for_airborne_ = true;
+    } else {
+      create_and_publish_plans(now(), takeoff_buffer());
+    }
+  }
+
+  void PlannerNode::flock_airborne_callback(const std_msgs::msg::Header::SharedPtr msg)
+  {
+    if (!waiting_for_airborne_) {
+      return;
+    }
+    waiting_for_airborne_ = false;
+
+    // Start from the barrier time, or from now if the message was slow to arrive
+    rclcpp::Time barrier(msg->stamp, get_clock()->get_clock_type());
+    rclcpp::Time start = barrier.nanoseconds() > now().nanoseconds() ? barrier : now();
+    RCLCPP_INFO(get_logger(), "flock is airborne, %.2fs ago", (now() - barrier).seconds());
+    create_and_publish_plans(start, rclcpp::Duration(static_cast<int64_t>(RCL_S_TO_NS(cxt_.airborne_buffer_sec_))));
   }
 
   void PlannerNode::stop_mission_callback(const std_msgs::msg::Empty::SharedPtr msg)
   {
     (void) msg;
     RCLCPP_INFO(get_logger(), "stop mission");
+    waiting_for_airborne_ = false;
+    for (auto &drone : drones_) {
+      drone->clear_plan();
+    }
   }
 
   void PlannerNode::validate_parameters()
   {
-    RCLCPP_INFO(get_logger(), "PlannerNode Parameters");
+    if (cxt_.max_delay_sec_ < 0) {
+      cxt_.max_delay_sec_ = 0;
+    }
 
-#undef CXT_MACRO_MEMBER
-#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOG_PARAMETER(RCLCPP_INFO, get_logger(), cxt_, n, t, d)
-    PLANNER_NODE_ALL_PARAMS
-  }
+    if (cxt_.stabilize_time_sec_ < 0) {
+      cxt_.stabilize_time_sec_ = 0;
+    }
 
-} // namespace planner_node
+    if (cxt_.stream_window_ < 0) {
+      cxt_.stream_window_ = 0;
+    }
 
-//====================
-// main
-//====================
+    if (!drone_base::valid_reliability(cxt_.sensor_qos_)) {
+      RCLCPP_WARN(get_logger(), "sensor_qos must be best_effort or reliable, using best_effort");
+      cxt_.sensor_qos_ = "best_effort";
+    }
 
-int main(int argc, char **argv)
-{
-  // Force flush of the stdout buffer
-  setvbuf(stdout, NULL, _IONBF, BUFSIZ);
+    if (!known_planner(cxt_.planner_)) {
+      RCLCPP_WARN(get_logger(), "unknown planner '%s', using simple", cxt_.planner_.c_str());
+      cxt_.planner_ = "simple";
+    }
 
-  // Init ROS
-  rclcpp::init(argc, argv);
+    if (cxt_.max_speed_ <= 0) {
+      RCLCPP_WARN(get_logger(), "max_speed must be > 0, using 0.3");
+      cxt_.max_speed_ = 0.3;
+    }
 
-  // Create node
-  auto node = std::make_shared<planner_node::PlannerNode>();
-  auto result = rcutils_logging_set_logger_level(node->get_logger().get_name(), RCUTILS_LOG_SEVERITY_DEBUG);
+    RCLCPP_INFO(get_logger(), "PlannerNode Parameters");
 
-  // Spin until rclcpp::ok() returns false
-  rclcpp::spin(node);
+#undef CXT_MACRO_MEMBER
+#define CXT_MACRO_MEMBER(n, t, d) CXT_MACRO_LOG_PARAMETER(RCLCPP_INFO, get_logger(), cxt_, n, t, d)
+    PLANNER_NODE_ALL_PARAMS
+  }
 
-  // Shut down ROS
-  rclcpp::shutdown();
+} // namespace planner_node
 
-  return 0;
-}
\ No newline at end of file
+RCLCPP_COMPONENTS_REGISTER_NODE(planner_node::PlannerNode)
@@ -0,0 +1,26 @@
+#include "planner_node.hpp"
+
+//====================
+// main
+//====================
+
+int main(int argc, char **argv)
+{
+  // Force flush of the stdout buffer
+  setvbuf(stdout, NULL, _IONBF, BUFSIZ);
+
+  // Init ROS
+  rclcpp::init(argc, argv);
+
+  // Create node
+  auto node = std::make_shared<planner_node::PlannerNode>();
+  auto result = rcutils_logging_set_logger_level(node->get_logger().get_name(), RCUTILS_LOG_SEVERITY_DEBUG);
+
+  // Spin until rclcpp::ok() returns false
+  rclcpp::spin(node);
+
+  // Shut down ROS
+  rclcpp::shutdown();
+
+  return 0;
+}
@@ -4,6 +4,8 @@
 
 #include "tf2_geometry_msgs/tf2_geometry_msgs.h"
 
+#include "drone_pose.hpp"
+
 namespace simple_planner
 {
 
@@ -16,7 +18,8 @@ namespace simple_planner
 
 // Timestamps:
 //    Mission time starts at node->now().
-//    Plan will include a time buffer at each waypoint (TAKEOFF_NS, STABILIZE_NS).
+//    Plan will include a time buffer before waypoint 0 (takeoff_), and the controller's stabilize time at each
+//    waypoint after that.
 //    Drone must get to waypoint by the indicated timestamp or earlier.
 //    Drone should start moving to the first waypoint as soon as the plan is received.
 //    Drone should start moving to the next waypoint at the timestamp of the previous waypoint.
@@ -32,7 +35,6 @@ namespace simple_planner
   const double SEPARATION = 4.0;      // m
   const double SPEED = 0.2;           // m/s
 
-  const rclcpp::Duration TAKEOFF{9000000000};  // includes time to send plan and send takeoff command and takeoff.
   const rclcpp::Duration STABILIZE{9000000000};
 
 #define SUPER_SIMPLE
@@ -64,7 +66,9 @@ namespace simple_planner
     return sqrt(pow(p2.x - p1.x, 2) + pow(p2.y - p1.y, 2) + pow(p2.z - p1.z, 2));
   }
 
-  SimplePlanner::SimplePlanner(const std::vector<geometry_msgs::msg::PoseStamped> &landing_poses)
+  SimplePlanner::SimplePlanner(const std::vector<geometry_msgs::msg::PoseStamped> &landing_poses,
+                               double stabilize_sec) :
+    stabilize_ns_{static_cast<int64_t>(RCL_S_TO_NS(stabilize_sec))}
   {
     assert(landing_poses.size() > 0);
 
@@ -107,46 +111,112 @@ namespace simple_planner
       waypoints_.push_back(p);
     }
 #endif
+
+    // Compute time to fly from each waypoint to the next, around the ring
+    ring_ns_.reserve(waypoints_.size() + 1);
+    ring_ns_.push_back(0);
+    for (size_t i = 0; i < waypoints_.size(); i++) {
+      size_t next = (i + 1) % waypoints_.size();
+      ring_ns_.push_back(ring_ns_.back() + leg_ns(waypoints_[i].pose.position, waypoints_[next].pose.position));
+    }
+  }
+
+  // Assume instant acceleration and constant speed
+  // The controller's deadline is stabilize_ns_ before the timestamp, so the flight itself gets the distance / SPEED
+  int64_t SimplePlanner::leg_ns(const geometry_msgs::msg::Point &p1, const geometry_msgs::msg::Point &p2) const
+  {
+    return static_cast<int64_t>(RCL_S_TO_NS(distance(p1, p2) / SPEED)) + stabilize_ns_;
   }
 
-  std::vector<nav_msgs::msg::Path> SimplePlanner::plans(const rclcpp::Time &now) const
+  std::vector<nav_msgs::msg::Path> SimplePlanner::plans(const rclcpp::Time &now)
   {
     std::vector<nav_msgs::msg::Path> plans;
+    fill_plans(now, plans);
+    return plans;
+  }
 
-    // Compute time to fly from this waypoint to next waypoint
-    // Assume instant acceleration and constant speed
-    std::vector<rclcpp::Duration> flight_time;
-    for (int i = 0; i < waypoints_.size(); i++) {
-      int next = (i + 1) % waypoints_.size();
-      flight_time.emplace_back(distance(waypoints_[next].pose.position, waypoints_[i].pose.position) / SPEED * 1e9);
+  // Create num_drones_ plans, each with waypoints_.size() + 1 waypoints
+  void SimplePlanner::fill_plans(const rclcpp::Time &now, std::vector<nav_msgs::msg::Path> &plans)
+  {
+    plans.resize(num_drones_);
+    int64_t waypoint0_ns = now.nanoseconds() + takeoff_.nanoseconds();
+    for (int i = 0; i < num_drones_; i++) {
+      plans[i].header.stamp = now;
+      fill_plan(i, waypoint0_ns, plans[i]);
     }
+  }
 
-    // Create num_drones_ plans, each with waypoints_.size() waypoints_
-    for (int i = 0; i < num_drones_; i++) {
-      // Init path
-      nav_msgs::msg::Path path;
-      path.header.stamp = now;
-      plans.push_back(path);
-
-      // Timestamp for waypoint 0
-      rclcpp::Time timestamp = now + TAKEOFF;
-
-      // Add waypoints to path
-      for (int j = 0; j < waypoints_.size(); j++) {
-        int curr = (i + j) % waypoints_.size();
-        plans[i].poses.push_back(waypoints_[curr]);
-        plans[i].poses[j].header.stamp = timestamp;
-
-        // Timestamp for waypoint j + 1
-        timestamp = timestamp + flight_time[curr];
-      }
-
-      // Last waypoint returns to the spot just above the landing pose
-      plans[i].poses.push_back(waypoints_[i]);
-      plans[i].poses[waypoints_.size()].header.stamp = timestamp;
+  void SimplePlanner::fill_plan(int drone, int64_t waypoint0_ns, nav_msgs::msg::Path &path) const
+  {
+    size_t n = waypoints_.size();
+    int64_t lap_ns = ring_ns_[n];
+    path.poses.resize(n + 1);
+
+    // The last waypoint returns to the spot just above the landing pose, one lap after waypoint 0
+    for (size_t j = 0; j <= n; j++) {
+      size_t curr = (drone + j) % n;
+      int64_t elapsed_ns = ring_ns_[curr] - ring_ns_[drone] + (drone + j >= n ? lap_ns : 0);
+
+      auto &pose = path.poses[j];
+      pose.header.frame_id = waypoints_[curr].header.frame_id;
+      drone_base::PoseUtil::from_ns(waypoint0_ns + elapsed_ns, pose.header.stamp);
+      pose.pose = waypoints_[curr].pose;
     }
+  }
 
-    return plans;
+  // The drone flies a straight line from waypoint i - 1 to waypoint i, it should be there by the timestamp of waypoint i
+  double SimplePlanner::lag(const nav_msgs::msg::Path &plan, const geometry_msgs::msg::Pose &pose,
+                            const rclcpp::Time &t) const
+  {
+    size_t next = next_waypoint(plan, t);
+    if (next == 0 || next >= plan.poses.size()) {
+      // Taking off, or done
+      return 0;
+    }
+
+    const auto &prev_wp = plan.poses[next - 1];
+    const auto &next_wp = plan.poses[next];
+    auto t0 = rclcpp::Time(prev_wp.header.stamp).nanoseconds();
+    auto t1 = rclcpp::Time(next_wp.header.stamp).nanoseconds();
+    double fraction_remaining = static_cast<double>(t1 - t.nanoseconds()) / (t1 - t0);
+
+    // Distance left to fly minus distance left on schedule
+    double behind = distance(pose.position, next_wp.pose.position) -
+                    fraction_remaining * distance(prev_wp.pose.position, next_wp.pose.position);
+    return behind > 0 ? behind : 0;
+  }
+
+  // Fly from the current pose to the next waypoint at SPEED, the rest of the plan is shifted by the delay
+  bool SimplePlanner::replan(const nav_msgs::msg::Path &plan, const geometry_msgs::msg::Pose &pose,
+                             const rclcpp::Time &now, nav_msgs::msg::Path &result)
+  {
+    size_t next = next_waypoint(plan, now);
+    if (next >= plan.poses.size()) {
+      error_ = "plan is complete";
+      return false;
+    }
+
+    result.header.stamp = now;
+    result.header.frame_id = plan.header.frame_id;
+    result.poses.clear();
+
+    // Waypoint 0 is the current pose, timestamped now, so segment 1 is the rest of the segment the drone is flying
+    geometry_msgs::msg::PoseStamped start;
+    start.header.stamp = now;
+    start.header.frame_id = plan.poses[next].header.frame_id;
+    start.pose = pose;
+    result.poses.push_back(start);
+
+    // Same timing as the legs in the ring, a short leg still leaves the controller time to fly it
+    rclcpp::Duration flight_time(leg_ns(pose.position, plan.poses[next].pose.position));
+    rclcpp::Duration delay = now + flight_time - rclcpp::Time(plan.poses[next].header.stamp);
+
+    for (size_t i = next; i < plan.poses.size(); i++) {
+      result.poses.push_back(plan.poses[i]);
+      result.poses.back().header.stamp = rclcpp::Time(plan.poses[i].header.stamp) + delay;
+    }
+
+    return true;
   }
 
 } // namespace simple_planner
@@ -0,0 +1,219 @@
+#include "spline_planner.hpp"
+
+#include <math.h>
+
+#include <future>
+
+#include "cubic_spline.hpp"
+#include "simple_planner.hpp"
+
+namespace spline_planner
+{
+
+// Plan:
+//    Same waypoints and the same ring route as SimplePlanner.
+//    Each drone follows a minimum acceleration cubic spline through its waypoints, starting and ending at rest.
+//    Leg j takes the same time for every drone, long enough for the slowest drone, so the flock moves together.
+//    The trajectories are sampled and checked against the arena bounds.
+//    planner_node checks the sampled trajectories for pairwise separation.
+
+// Timestamps:
+//    Waypoint 0 is at now + takeoff_, same as SimplePlanner.
+//    The trajectory controller should be at the position given by the spline at every instant, and needs no
+//    stabilize time. Every leg still gets params.stabilize on top of the spline time, so the basic controller can
+//    fly it; set it to 0 with the trajectory controller.
+
+  const double PEAK_SPEED_RATIO = 1.5;  // Peak speed / average speed of a cubic that starts and stops at rest
+  const double MIN_LEG_TIME = 1.0;      // s
+  const double SAMPLE_DT = 0.1;         // s
+
+  double distance(const geometry_msgs::msg::Point &p1, const geometry_msgs::msg::Point &p2)
+  {
+    return sqrt(pow(p2.x - p1.x, 2) + pow(p2.y - p1.y, 2) + pow(p2.z - p1.z, 2));
+  }
+
+  inline bool outside(double v, double limit)
+  {
+    return v < std::min(0., limit) || v > std::max(0., limit);
+  }
+
+  SplinePlanner::SplinePlanner(const std::vector<geometry_msgs::msg::PoseStamped> &landing_poses,
+                               const planner_node::PlannerParams &params) : params_{params}
+  {
+    assert(landing_poses.size() > 0);
+
+    num_drones_ = landing_poses.size();
+    waypoints_ = simple_planner::SimplePlanner(landing_poses).waypoints();
+
+    // Leg j for drone i flies from waypoint (i + j) to waypoint (i + j + 1)
+    leg_times_.resize(waypoints_.size(), 0);
+    for (int i = 0; i < num_drones_; i++) {
+      for (int j = 0; j < waypoints_.size(); j++) {
+        int curr = (i + j) % waypoints_.size();
+        int next = (curr + 1) % waypoints_.size();
+        leg_times_[j] = std::max(leg_times_[j], leg_time(waypoints_[curr].pose.position, waypoints_[next].pose.position));
+      }
+    }
+  }
+
+  double SplinePlanner::leg_time(const geometry_msgs::msg::Point &p1, const geometry_msgs::msg::Point &p2) const
+  {
+    return std::max(MIN_LEG_TIME, PEAK_SPEED_RATIO * distance(p1, p2) / params_.max_speed) + params_.stabilize;
+  }
+
+  std::string SplinePlanner::check_bounds(const nav_msgs::msg::Path &path) const
+  {
+    spline::PoseSpline trajectory;
+    if (!trajectory.fit(path)) {
+      return "can't fit spline";
+    }
+
+    int num_samples = static_cast<int>(trajectory.duration() / SAMPLE_DT) + 1;
+    int cursor = 0;
+    for (int s = 0; s < num_samples; s++) {
+      auto p = trajectory.eval(trajectory.t0_ns() + static_cast<int64_t>(RCL_S_TO_NS(s * SAMPLE_DT)), cursor);
+
+      if (outside(p.x, params_.arena_x) || outside(p.y, params_.arena_y) || outside(p.z, params_.arena_z)) {
+        char buffer[100];
+        snprintf(buffer, sizeof(buffer), "leaves the arena at (%.2f, %.2f, %.2f), t=%.1fs",
+                 p.x, p.y, p.z, s * SAMPLE_DT);
+        return buffer;
+      }
+    }
+
+    return "";
+  }
+
+  void SplinePlanner::segments(int drone, const nav_msgs::msg::Path &plan,
+                               std::vector<collision_index::Segment> &segments) const
+  {
+    segments.clear();
+
+    spline::PoseSpline trajectory;
+    if (!trajectory.fit(plan)) {
+      return;
+    }
+
+    int num_samples = static_cast<int>(trajectory.duration() / SAMPLE_DT) + 1;
+    int cursor = 0;
+    int64_t prev_ns = trajectory.t0_ns();
+    auto prev = trajectory.eval(prev_ns, cursor);
+    for (int s = 1; s <= num_samples; s++) {
+      int64_t t_ns = std::min(trajectory.t0_ns() + static_cast<int64_t>(RCL_S_TO_NS(s * SAMPLE_DT)),
+                              trajectory.t0_ns() + static_cast<int64_t>(RCL_S_TO_NS(trajectory.duration())));
+      if (t_ns <= prev_ns) {
+        break;
+      }
+
+      auto p = trajectory.eval(t_ns, cursor);
+      segments.push_back(collision_index::Segment{drone, prev_ns, t_ns, {prev.x, prev.y, prev.z}, {p.x, p.y, p.z}});
+      prev_ns = t_ns;
+      prev = p;
+    }
+  }
+
+  std::vector<nav_msgs::msg::Path> SplinePlanner::plans(const rclcpp::Time &now)
+  {
+    std::vector<nav_msgs::msg::Path> plans(num_drones_);
+    error_.clear();
+
+    // Timestamps are shared by all plans
+    std::vector<rclcpp::Time> timestamps;
+    timestamps.push_back(now + takeoff_);
+    for (auto leg_time : leg_times_) {
+      timestamps.push_back(timestamps.back() + rclcpp::Duration(static_cast<int64_t>(RCL_S_TO_NS(leg_time))));
+    }
+
+    // Build, fit and check each plan in parallel, each task only touches its own plan
+    std::vector<std::future<std::string>> results;
+    for (int i = 0; i < num_drones_; i++) {
+      results.push_back(std::async(std::launch::async, [&, i]() -> std::string
+      {
+        nav_msgs::msg::Path &path = plans[i];
+        path.header.stamp = now;
+        path.header.frame_id = waypoints_[i].header.frame_id;
+
+        // The last waypoint returns to the spot just above the landing pose
+        for (int j = 0; j <= waypoints_.size(); j++) {
+          path.poses.push_back(waypoints_[(i + j) % waypoints_.size()]);
+          path.poses.back().header.stamp = timestamps[j];
+        }
+
+        return check_bounds(path);
+      }));
+    }
+
+    for (int i = 0; i < num_drones_; i++) {
+      std::string result = results[i].get();
+      if (!result.empty() && error_.empty()) {
+        error_ = "plan " + std::to_string(i) + " " + result;
+      }
+    }
+
+    if (!error_.empty()) {
+      return std::vector<nav_msgs::msg::Path>();
+    }
+
+    return plans;
+  }
+
+  // The drone should be on the spline at every instant
+  double SplinePlanner::lag(const nav_msgs::msg::Path &plan, const geometry_msgs::msg::Pose &pose,
+                            const rclcpp::Time &t) const
+  {
+    size_t next = next_waypoint(plan, t);
+    if (next == 0 || next >= plan.poses.size()) {
+      // Taking off, or done
+      return 0;
+    }
+
+    spline::PoseSpline trajectory;
+    if (!trajectory.fit(plan)) {
+      return 0;
+    }
+
+    int cursor = 0;
+    auto p = trajectory.eval(t.nanoseconds(), cursor);
+    geometry_msgs::msg::Point expected;
+    expected.x = p.x;
+    expected.y = p.y;
+    expected.z = p.z;
+    return distance(pose.position, expected);
+  }
+
+  // Fly from the current pose to the next waypoint, the rest of the plan is shifted by the delay
+  bool SplinePlanner::replan(const nav_msgs::msg::Path &plan, const geometry_msgs::msg::Pose &pose,
+                             const rclcpp::Time &now, nav_msgs::msg::Path &result)
+  {
+    size_t next = next_waypoint(plan, now);
+    if (next >= plan.poses.size()) {
+      error_ = "plan is complete";
+      return false;
+    }
+
+    result.header.stamp = now;
+    result.header.frame_id = plan.header.frame_id;
+    result.poses.clear();
+
+    // Waypoint 0 is the current pose
+    geometry_msgs::msg::PoseStamped start;
+    start.header.stamp = now;
+    start.header.frame_id = plan.poses[next].header.frame_id;
+    start.pose = pose;
+    result.poses.push_back(start);
+
+    double sec = leg_time(pose.position, plan.poses[next].pose.position);
+    rclcpp::Duration flight_time(static_cast<int64_t>(RCL_S_TO_NS(sec)));
+    rclcpp::Duration delay = now + flight_time - rclcpp::Time(plan.poses[next].header.stamp);
+
+    for (size_t i = next; i < plan.poses.size(); i++) {
+      result.poses.push_back(plan.poses[i]);
+      result.poses.back().header.stamp = rclcpp::Time(plan.poses[i].header.stamp) + delay;
+    }
+
+    // The new first leg might swing outside the arena
+    error_ = check_bounds(result);
+    return error_.empty();
+  }
+
+} // namespace spline_planner
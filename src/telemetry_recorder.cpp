@@ -0,0 +1,116 @@
+#include "telemetry_recorder.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+
+namespace drone_base
+{
+
+  // The background thread wakes up this often
+  const std::chrono::milliseconds FLUSH_PERIOD{100};
+
+  TelemetryRecorder::TelemetryRecorder(const std::string &path) :
+    ring_(RING_SIZE)
+  {
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0 || !grow(CHUNK_SIZE)) {
+      return;
+    }
+
+    TelemetryHeader header{};
+    memcpy(header.magic, TELEMETRY_MAGIC, sizeof(header.magic));
+    header.version = TELEMETRY_VERSION;
+    header.record_size = sizeof(TelemetryRecord);
+    memcpy(map_, &header, sizeof(header));
+    file_size_ = sizeof(header);
+
+    thread_ = std::thread(&TelemetryRecorder::run, this);
+  }
+
+  TelemetryRecorder::~TelemetryRecorder()
+  {
+    stop_ = true;
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+
+    if (map_) {
+      munmap(map_, map_size_);
+    }
+
+    if (fd_ >= 0) {
+      // Trim the unused part of the last chunk
+      if (ftruncate(fd_, file_size_) != 0) {
+        // Nothing to do, the decoder ignores the zero-filled tail
+      }
+      close(fd_);
+    }
+  }
+
+  bool TelemetryRecorder::grow(size_t min_size)
+  {
+    size_t size = map_size_;
+    while (size < min_size) {
+      size += CHUNK_SIZE;
+    }
+
+    if (map_) {
+      munmap(map_, map_size_);
+      map_ = nullptr;
+      map_size_ = 0;
+    }
+
+    if (ftruncate(fd_, size) != 0) {
+      return false;
+    }
+
+    void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+      return false;
+    }
+
+    map_ = static_cast<char *>(map);
+    map_size_ = size;
+    return true;
+  }
+
+  void TelemetryRecorder::flush()
+  {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    uint64_t head = head_.load(std::memory_order_acquire);
+    if (tail == head) {
+      return;
+    }
+
+    size_t bytes = (head - tail) * sizeof(TelemetryRecord);
+    if (!map_ || (file_size_ + bytes > map_size_ && !grow(file_size_ + bytes))) {
+      // Out of disk space, drop everything
+      dropped_.fetch_add(head - tail, std::memory_order_relaxed);
+      tail_.store(head, std::memory_order_release);
+      return;
+    }
+
+    for (; tail < head; tail++) {
+      memcpy(map_ + file_size_, &ring_[tail & (RING_SIZE - 1)], sizeof(TelemetryRecord));
+      file_size_ += sizeof(TelemetryRecord);
+    }
+
+    tail_.store(tail, std::memory_order_release);
+  }
+
+  void TelemetryRecorder::run()
+  {
+    while (!stop_) {
+      std::this_thread::sleep_for(FLUSH_PERIOD);
+      flush();
+    }
+
+    // Pick up the last few records
+    flush();
+  }
+
+} // namespace drone_base
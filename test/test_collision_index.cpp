@@ -0,0 +1,201 @@
+#include "gtest/gtest.h"
+
+#include "collision_index.hpp"
+#include "drone_pose.hpp"
+#include "planner_interface.hpp"
+
+//=============================================================================
+// CollisionIndex, and PlannerInterface::insert_clear delaying or rejecting a plan
+//=============================================================================
+
+namespace
+{
+  using collision_index::CollisionIndex;
+  using collision_index::Conflict;
+  using collision_index::Segment;
+
+  const int64_t BASE_NS = RCL_S_TO_NS(100);
+  const double MIN_SEPARATION = 0.4;
+
+  // Straight lines between the waypoints, the default segments()
+  class LinePlanner : public planner_node::PlannerInterface
+  {
+  public:
+    std::vector<nav_msgs::msg::Path> plans(const rclcpp::Time &now) override
+    {
+      (void) now;
+      return std::vector<nav_msgs::msg::Path>();
+    }
+
+    double lag(const nav_msgs::msg::Path &plan, const geometry_msgs::msg::Pose &pose,
+               const rclcpp::Time &t) const override
+    {
+      (void) plan;
+      (void) pose;
+      (void) t;
+      return 0;
+    }
+
+    bool replan(const nav_msgs::msg::Path &plan, const geometry_msgs::msg::Pose &pose,
+                const rclcpp::Time &now, nav_msgs::msg::Path &result) override
+    {
+      (void) plan;
+      (void) pose;
+      (void) now;
+      (void) result;
+      return false;
+    }
+  };
+
+  struct Waypoint
+  {
+    double x, y, z;
+    double t_sec;           // After BASE_NS
+  };
+
+  // The plan is sent at BASE_NS
+  nav_msgs::msg::Path make_path(const std::vector<Waypoint> &waypoints)
+  {
+    nav_msgs::msg::Path path;
+    path.header.frame_id = "map";
+    drone_base::PoseUtil::from_ns(BASE_NS, path.header.stamp);
+    for (auto &w : waypoints) {
+      geometry_msgs::msg::PoseStamped pose;
+      pose.header.frame_id = "map";
+      drone_base::PoseUtil::from_ns(BASE_NS + static_cast<int64_t>(RCL_S_TO_NS(w.t_sec)), pose.header.stamp);
+      pose.pose.position.x = w.x;
+      pose.pose.position.y = w.y;
+      pose.pose.position.z = w.z;
+      pose.pose.orientation.w = 1;
+      path.poses.push_back(pose);
+    }
+    return path;
+  }
+
+  // Drone 0 waits at (0, 0, 1) until 5.5s
+  nav_msgs::msg::Path hover_path()
+  {
+    return make_path({{0, 0, 1, 1}, {0, 0, 1, 5.5}});
+  }
+
+  // Drone 1 flies through (0, 0, 1) at 2 m/s, 2s after the start
+  nav_msgs::msg::Path crossing_path()
+  {
+    return make_path({{2, 0, 1, 1}, {-2, 0, 1, 3}});
+  }
+}
+
+TEST(CollisionIndex, closest_approach)
+{
+  Segment a{0, 0, RCL_S_TO_NS(2), {-1, 0, 1}, {1, 0, 1}};
+  Segment b{1, 0, RCL_S_TO_NS(2), {0, -1, 1}, {0, 1, 1}};
+
+  double distance;
+  int64_t t_ns;
+  ASSERT_TRUE(CollisionIndex::closest_approach(a, b, distance, t_ns));
+  EXPECT_NEAR(distance, 0, 1e-9);
+  EXPECT_NEAR(static_cast<double>(t_ns), RCL_S_TO_NS(1), 1e6);
+
+  // No overlap in time
+  Segment c{1, RCL_S_TO_NS(3), RCL_S_TO_NS(4), {0, -1, 1}, {0, 1, 1}};
+  EXPECT_FALSE(CollisionIndex::closest_approach(a, c, distance, t_ns));
+}
+
+TEST(CollisionIndex, query)
+{
+  CollisionIndex index(MIN_SEPARATION);
+  index.insert(Segment{0, 0, RCL_S_TO_NS(2), {-1, 0, 1}, {1, 0, 1}});
+  EXPECT_GT(index.num_pieces(), 0u);
+
+  // Crosses the segment in the index
+  Conflict conflict{};
+  ASSERT_TRUE(index.query(Segment{1, 0, RCL_S_TO_NS(2), {0, -1, 1}, {0, 1, 1}}, conflict));
+  EXPECT_EQ(conflict.drone_a, 1);
+  EXPECT_EQ(conflict.drone_b, 0);
+  EXPECT_LT(conflict.distance, MIN_SEPARATION);
+
+  // Same path, later
+  EXPECT_FALSE(index.query(Segment{1, RCL_S_TO_NS(3), RCL_S_TO_NS(5), {0, -1, 1}, {0, 1, 1}}, conflict));
+
+  // Parallel, 1m away
+  EXPECT_FALSE(index.query(Segment{1, 0, RCL_S_TO_NS(2), {-1, 1, 1}, {1, 1, 1}}, conflict));
+
+  // A drone doesn't conflict with itself
+  EXPECT_FALSE(index.query(Segment{0, 0, RCL_S_TO_NS(2), {0, -1, 1}, {0, 1, 1}}, conflict));
+}
+
+TEST(InsertClear, clear_plan_is_not_delayed)
+{
+  LinePlanner planner;
+  CollisionIndex index(MIN_SEPARATION);
+  planner.insert(index, 0, hover_path());
+
+  auto path = make_path({{2, 2, 1, 1}, {2, -2, 1, 3}});
+  auto before = path;
+  rclcpp::Duration delay(0);
+  ASSERT_TRUE(planner.insert_clear(index, 1, path, rclcpp::Duration(RCL_S_TO_NS(10)), delay));
+  EXPECT_EQ(delay.nanoseconds(), 0);
+  EXPECT_EQ(path, before);
+}
+
+TEST(InsertClear, conflict_is_delayed)
+{
+  LinePlanner planner;
+  CollisionIndex index(MIN_SEPARATION);
+  planner.insert(index, 0, hover_path());
+
+  // Crossing at 2s, 3s, 4s or 5s hits the hovering drone, 6s is clear
+  auto path = crossing_path();
+  auto before = path;
+  rclcpp::Duration delay(0);
+  ASSERT_TRUE(planner.insert_clear(index, 1, path, rclcpp::Duration(RCL_S_TO_NS(10)), delay));
+  EXPECT_EQ(delay.nanoseconds(), RCL_S_TO_NS(4));
+
+  ASSERT_EQ(path.poses.size(), before.poses.size());
+  for (size_t i = 0; i < path.poses.size(); i++) {
+    EXPECT_EQ(rclcpp::Time(path.poses[i].header.stamp).nanoseconds(),
+              rclcpp::Time(before.poses[i].header.stamp).nanoseconds() + delay.nanoseconds());
+  }
+
+  // The delayed plan is in the index, a third drone on the same path at the same time conflicts with it
+  auto same = path;
+  rclcpp::Duration same_delay(0);
+  EXPECT_FALSE(planner.insert_clear(index, 2, same, rclcpp::Duration(0), same_delay));
+}
+
+TEST(InsertClear, max_delay_bound)
+{
+  // A delay of exactly max_delay is allowed
+  {
+    LinePlanner planner;
+    CollisionIndex index(MIN_SEPARATION);
+    planner.insert(index, 0, hover_path());
+
+    auto path = crossing_path();
+    rclcpp::Duration delay(0);
+    EXPECT_TRUE(planner.insert_clear(index, 1, path, rclcpp::Duration(RCL_S_TO_NS(4)), delay));
+    EXPECT_EQ(delay.nanoseconds(), RCL_S_TO_NS(4));
+  }
+
+  // Anything less and the plan is rejected, unchanged and not in the index
+  {
+    LinePlanner planner;
+    CollisionIndex index(MIN_SEPARATION);
+    planner.insert(index, 0, hover_path());
+    size_t num_pieces = index.num_pieces();
+
+    auto path = crossing_path();
+    auto before = path;
+    rclcpp::Duration delay(0);
+    EXPECT_FALSE(planner.insert_clear(index, 1, path, rclcpp::Duration(RCL_S_TO_NS(3)), delay));
+    EXPECT_FALSE(planner.error().empty());
+    EXPECT_EQ(path, before);
+    EXPECT_EQ(index.num_pieces(), num_pieces);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
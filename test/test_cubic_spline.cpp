@@ -0,0 +1,79 @@
+#include "gtest/gtest.h"
+
+#include "cubic_spline.hpp"
+
+//=============================================================================
+// Minimum acceleration cubic spline
+//=============================================================================
+
+TEST(CubicSpline, passes_through_knots)
+{
+  std::vector<double> ts{0, 1, 3, 4, 7};
+  std::vector<double> ys{0, 1, -0.5, 2, 2};
+
+  spline::CubicSpline s;
+  ASSERT_TRUE(s.fit(ts, ys, 0.5, -0.25));
+  EXPECT_EQ(s.num_segments(), 4);
+
+  for (size_t i = 0; i < ts.size(); i++) {
+    EXPECT_NEAR(s.eval(ts[i]).y, ys[i], 1e-9);
+  }
+  EXPECT_NEAR(s.eval(ts.front()).y_dot, 0.5, 1e-9);
+  EXPECT_NEAR(s.eval(ts.back()).y_dot, -0.25, 1e-9);
+
+  // Times outside the spline are clamped
+  EXPECT_NEAR(s.eval(-1).y, ys.front(), 1e-9);
+  EXPECT_NEAR(s.eval(10).y, ys.back(), 1e-9);
+}
+
+TEST(CubicSpline, c2_continuous)
+{
+  std::vector<double> ts{0, 1, 3, 4, 7};
+  std::vector<double> ys{0, 1, -0.5, 2, 2};
+
+  spline::CubicSpline s;
+  ASSERT_TRUE(s.fit(ts, ys));
+
+  // Velocity and acceleration match on both sides of every interior knot
+  const double EPS = 1e-6;
+  for (size_t i = 1; i + 1 < ts.size(); i++) {
+    auto before = s.eval(ts[i] - EPS);
+    auto after = s.eval(ts[i] + EPS);
+    EXPECT_NEAR(before.y_dot, after.y_dot, 1e-4);
+    EXPECT_NEAR(before.y_dotdot, after.y_dotdot, 1e-4);
+  }
+}
+
+TEST(CubicSpline, cursor)
+{
+  std::vector<double> ts{0, 1, 2, 3, 4};
+  std::vector<double> ys{0, 1, 0, 1, 0};
+
+  spline::CubicSpline s;
+  ASSERT_TRUE(s.fit(ts, ys));
+
+  // A cursor left anywhere gives the same answer as a fresh search
+  int cursor = 3;
+  for (double t = 0; t <= 4; t += 0.25) {
+    EXPECT_NEAR(s.eval(t, cursor).y, s.eval(t).y, 1e-12);
+  }
+  for (double t = 4; t >= 0; t -= 0.25) {
+    EXPECT_NEAR(s.eval(t, cursor).y, s.eval(t).y, 1e-12);
+  }
+}
+
+TEST(CubicSpline, bad_knots)
+{
+  spline::CubicSpline s;
+  EXPECT_FALSE(s.fit({0}, {0}));
+  EXPECT_FALSE(s.fit({0, 1}, {0}));
+  EXPECT_FALSE(s.fit({0, 1, 1}, {0, 1, 2}));
+  EXPECT_FALSE(s.fit({0, 2, 1}, {0, 1, 2}));
+  EXPECT_TRUE(s.empty());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
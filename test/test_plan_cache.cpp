@@ -0,0 +1,138 @@
+#include "gtest/gtest.h"
+
+#include "drone_pose.hpp"
+#include "plan_cache.hpp"
+
+//=============================================================================
+// PlanCache segments, deadlines and velocities
+//=============================================================================
+
+namespace
+{
+  using drone_base::PlanCache;
+  using drone_base::PlanSegment;
+  using drone_base::PoseUtil;
+
+  const int64_t BASE_NS = RCL_S_TO_NS(100);
+  const int64_t OFFSET_NS = RCL_S_TO_NS(5);
+
+  struct Waypoint
+  {
+    double x, y, z;
+    double t_sec;           // After BASE_NS
+  };
+
+  nav_msgs::msg::Path::ConstSharedPtr make_path(const std::vector<Waypoint> &waypoints)
+  {
+    auto path = std::make_shared<nav_msgs::msg::Path>();
+    path->header.frame_id = "map";
+    PoseUtil::from_ns(BASE_NS, path->header.stamp);
+    for (auto &w : waypoints) {
+      geometry_msgs::msg::PoseStamped pose;
+      pose.header.frame_id = "map";
+      PoseUtil::from_ns(BASE_NS + static_cast<int64_t>(RCL_S_TO_NS(w.t_sec)), pose.header.stamp);
+      pose.pose.position.x = w.x;
+      pose.pose.position.y = w.y;
+      pose.pose.position.z = w.z;
+      pose.pose.orientation.w = 1;
+      path->poses.push_back(pose);
+    }
+    return path;
+  }
+}
+
+TEST(PlanCache, segments)
+{
+  PlanCache cache;
+  cache.build(make_path({{0, 0, 1, 10}, {2, 0, 1, 20}}), OFFSET_NS);
+  ASSERT_EQ(cache.size(), 2);
+  EXPECT_TRUE(cache.complete());
+
+  // Takeoff segment: starts and ends at waypoint 0, no velocity
+  const PlanSegment &takeoff = cache[0];
+  EXPECT_EQ(takeoff.start_ns, 0);
+  EXPECT_EQ(takeoff.end_ns, BASE_NS + RCL_S_TO_NS(10) - OFFSET_NS);
+  EXPECT_DOUBLE_EQ(takeoff.start.x, takeoff.end.x);
+  EXPECT_EQ(takeoff.vx, 0);
+
+  // Leave at the waypoint 0 timestamp, reach waypoint 1 by its timestamp minus the offset: 2m in 5s
+  const PlanSegment &leg = cache[1];
+  EXPECT_EQ(leg.start_ns, BASE_NS + RCL_S_TO_NS(10));
+  EXPECT_EQ(leg.end_ns, BASE_NS + RCL_S_TO_NS(20) - OFFSET_NS);
+  EXPECT_DOUBLE_EQ(leg.start.x, 0);
+  EXPECT_DOUBLE_EQ(leg.end.x, 2);
+  EXPECT_NEAR(leg.vx, 0.4, 1e-9);
+  EXPECT_EQ(leg.vy, 0);
+  EXPECT_EQ(leg.vz, 0);
+}
+
+TEST(PlanCache, zero_flight_time)
+{
+  // Legs no longer than the offset leave no time to fly, they start at their end so a controller that tracks
+  // from the segment start aims straight at the waypoint
+  PlanCache cache;
+  cache.build(make_path({{0, 0, 1, 10}, {1, 0, 1, 15}, {1, 1, 1, 17}}), OFFSET_NS);
+  ASSERT_EQ(cache.size(), 3);
+
+  for (int i = 1; i < cache.size(); i++) {
+    const PlanSegment &segment = cache[i];
+    EXPECT_LE(segment.end_ns, segment.start_ns);
+    EXPECT_DOUBLE_EQ(segment.start.x, segment.end.x);
+    EXPECT_DOUBLE_EQ(segment.start.y, segment.end.y);
+    EXPECT_DOUBLE_EQ(segment.start.z, segment.end.z);
+    EXPECT_EQ(segment.vx, 0);
+    EXPECT_EQ(segment.vy, 0);
+    EXPECT_EQ(segment.vz, 0);
+    EXPECT_EQ(segment.vyaw, 0);
+  }
+
+  // With no offset the same legs can be flown
+  cache.build(make_path({{0, 0, 1, 10}, {1, 0, 1, 15}}), 0);
+  EXPECT_DOUBLE_EQ(cache[1].start.x, 0);
+  EXPECT_NEAR(cache[1].vx, 0.2, 1e-9);
+}
+
+TEST(PlanCache, stream_windows)
+{
+  auto path = make_path({{0, 0, 1, 10}, {2, 0, 1, 20}, {2, 2, 1, 30}, {0, 2, 1, 40}});
+
+  PlanCache cache;
+  cache.start_stream(4, OFFSET_NS);
+  EXPECT_TRUE(cache.empty());
+  EXPECT_FALSE(cache.complete());
+
+  flock2::msg::CompactPlan window;
+  drone_base::to_compact(*path, window, 0, 2);
+  ASSERT_TRUE(cache.append(window, 0));
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_FALSE(cache.complete());
+
+  // A window can't leave a gap
+  drone_base::to_compact(*path, window, 3, 1);
+  EXPECT_FALSE(cache.append(window, 0));
+
+  drone_base::to_compact(*path, window, 2, 2);
+  ASSERT_TRUE(cache.append(window, 1));
+  EXPECT_EQ(cache.size(), 4);
+  EXPECT_TRUE(cache.complete());
+
+  // Same segments as the whole plan, the velocities are linked across the window boundary
+  PlanCache whole;
+  whole.build(path, OFFSET_NS);
+  for (int i = 1; i < whole.size(); i++) {
+    EXPECT_EQ(cache[i].start_ns, whole[i].start_ns);
+    EXPECT_EQ(cache[i].end_ns, whole[i].end_ns);
+    EXPECT_NEAR(cache[i].vx, whole[i].vx, 1e-6);
+    EXPECT_NEAR(cache[i].vy, whole[i].vy, 1e-6);
+  }
+
+  // Invalid windows are refused
+  window.x.pop_back();
+  EXPECT_FALSE(cache.append(window, 1));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
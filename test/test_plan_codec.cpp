@@ -0,0 +1,137 @@
+#include "gtest/gtest.h"
+
+#include "drone_pose.hpp"
+#include "plan_codec.hpp"
+
+//=============================================================================
+// nav_msgs/Path <-> flock2/CompactPlan
+//=============================================================================
+
+namespace
+{
+  using drone_base::DronePose;
+  using drone_base::PoseUtil;
+
+  const int64_t BASE_NS = RCL_S_TO_NS(1000) + RCL_MS_TO_NS(500);
+
+  // Waypoint i is offsets_us[i] after the plan stamp
+  nav_msgs::msg::Path make_path(const std::vector<int64_t> &offsets_us)
+  {
+    nav_msgs::msg::Path path;
+    path.header.frame_id = "map";
+    PoseUtil::from_ns(BASE_NS, path.header.stamp);
+    for (size_t i = 0; i < offsets_us.size(); i++) {
+      geometry_msgs::msg::PoseStamped pose;
+      pose.header.frame_id = "map";
+      PoseUtil::from_ns(BASE_NS + RCL_US_TO_NS(offsets_us[i]), pose.header.stamp);
+
+      DronePose p;
+      p.x = 0.1 * i - 1;
+      p.y = 2.5 - 0.3 * i;
+      p.z = 1 + 0.01 * i;
+      p.yaw = PoseUtil::norm_angle(0.7 * i);
+      p.toMsg(pose.pose);
+      path.poses.push_back(pose);
+    }
+    return path;
+  }
+
+  void expect_same_plan(const nav_msgs::msg::Path &a, const nav_msgs::msg::Path &b)
+  {
+    EXPECT_EQ(a.header.frame_id, b.header.frame_id);
+    EXPECT_EQ(PoseUtil::to_ns(a.header.stamp), PoseUtil::to_ns(b.header.stamp));
+    ASSERT_EQ(a.poses.size(), b.poses.size());
+
+    for (size_t i = 0; i < a.poses.size(); i++) {
+      DronePose pa, pb;
+      pa.fromMsg(a.poses[i].pose);
+      pb.fromMsg(b.poses[i].pose);
+
+      // Poses are float32, times are ms
+      EXPECT_NEAR(pa.x, pb.x, 1e-5);
+      EXPECT_NEAR(pa.y, pb.y, 1e-5);
+      EXPECT_NEAR(pa.z, pb.z, 1e-5);
+      EXPECT_NEAR(PoseUtil::norm_angle(pa.yaw - pb.yaw), 0, 1e-6);
+      EXPECT_NEAR(static_cast<double>(PoseUtil::to_ns(a.poses[i].header.stamp)),
+                  static_cast<double>(PoseUtil::to_ns(b.poses[i].header.stamp)), RCL_MS_TO_NS(1) / 2.);
+      EXPECT_EQ(b.poses[i].header.frame_id, a.header.frame_id);
+    }
+  }
+}
+
+TEST(PlanCodec, round_trip)
+{
+  // Not on ms boundaries, so every timestamp is rounded
+  auto path = make_path({400, 1000400, 2500600, 4000000, 9000300, 60000700});
+
+  flock2::msg::CompactPlan compact;
+  drone_base::to_compact(path, compact);
+  EXPECT_TRUE(drone_base::valid_compact(compact));
+  EXPECT_EQ(compact.first_index, 0u);
+  EXPECT_TRUE(compact.end_of_plan);
+  EXPECT_EQ(compact.dt_ms.size(), path.poses.size());
+
+  nav_msgs::msg::Path decoded;
+  ASSERT_TRUE(drone_base::from_compact(compact, decoded));
+  expect_same_plan(path, decoded);
+}
+
+TEST(PlanCodec, rounding_doesnt_accumulate)
+{
+  // 100 waypoints 1.4ms apart, rounding each delta would drift by 40ms
+  std::vector<int64_t> offsets_us;
+  for (int64_t i = 0; i < 100; i++) {
+    offsets_us.push_back(i * 1400);
+  }
+  auto path = make_path(offsets_us);
+
+  flock2::msg::CompactPlan compact;
+  drone_base::to_compact(path, compact);
+  nav_msgs::msg::Path decoded;
+  ASSERT_TRUE(drone_base::from_compact(compact, decoded));
+  expect_same_plan(path, decoded);
+}
+
+TEST(PlanCodec, windows)
+{
+  auto path = make_path({0, 1000000, 2000000, 3000000, 4000000});
+
+  flock2::msg::CompactPlan window;
+  drone_base::to_compact(path, window, 1, 2);
+  EXPECT_EQ(window.first_index, 1u);
+  EXPECT_FALSE(window.end_of_plan);
+  EXPECT_EQ(window.dt_ms.size(), 2u);
+
+  // Every window is relative to the plan stamp, so it decodes on its own
+  nav_msgs::msg::Path decoded;
+  ASSERT_TRUE(drone_base::from_compact(window, decoded));
+  nav_msgs::msg::Path expected = path;
+  expected.poses = {path.poses[1], path.poses[2]};
+  expect_same_plan(expected, decoded);
+
+  // The last window ends the plan, count is clamped
+  drone_base::to_compact(path, window, 3);
+  EXPECT_EQ(window.first_index, 3u);
+  EXPECT_TRUE(window.end_of_plan);
+  EXPECT_EQ(window.dt_ms.size(), 2u);
+}
+
+TEST(PlanCodec, invalid_plan_is_rejected)
+{
+  auto path = make_path({0, 1000000, 2000000});
+  flock2::msg::CompactPlan compact;
+  drone_base::to_compact(path, compact);
+  compact.yaw.pop_back();
+  EXPECT_FALSE(drone_base::valid_compact(compact));
+
+  // The path is left alone
+  nav_msgs::msg::Path decoded = path;
+  EXPECT_FALSE(drone_base::from_compact(compact, decoded));
+  EXPECT_EQ(decoded, path);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}